@@ -0,0 +1,72 @@
+/*
+ * JArena.h
+ *
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Arena for the large, long-lived structures of a reusable JDiff (see JEngine):
+ *  alloc    Take a block from the arena
+ *
+ * The arena is one block, allocated once through JHugeMem (zeroed, on huge
+ * pages when possible), from which the hashtables, file buffers and matching
+ * table take their memory at construction. Blocks are never released one by
+ * one: the owners reset their contents instead, and the whole arena is released
+ * at once when it is destroyed, after its users.
+ *******************************************************************************/
+
+#ifndef JARENA_H_
+#define JARENA_H_
+
+#include <stddef.h>
+
+#include "JDefs.h"
+
+#define ARN_ALN 64                      // Alignment of the blocks (cache line)
+
+namespace JojoDiff {
+
+class JArena {
+public:
+    /**
+     * Create an arena.
+     * @param alSze     total size in bytes (see size)
+     */
+    JArena(size_t alSze) ;
+
+    virtual ~JArena() ;
+
+    /* Take a zeroed block of the given size: null when the arena is full */
+    void *alloc(size_t alSze) ;
+
+    /* Size to reserve in an arena for a block of the given size (alignment included) */
+    static size_t size(size_t alSze) { return (alSze + ARN_ALN - 1) & ~((size_t) ARN_ALN - 1) ; }
+
+    /* return the size of the arena */
+    size_t get_size(){return mlSze;}
+
+    /* return the number of bytes taken from the arena */
+    size_t get_used(){return mlUsd;}
+
+private:
+    char  *mpMem ;          /* the arena                                            */
+    size_t mlSze ;          /* size of the arena                                    */
+    size_t mlUsd ;          /* number of bytes taken                                */
+};
+}
+#endif /* JARENA_H_ */
@@ -0,0 +1,159 @@
+/*
+ * JBatch.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Batch of file pairs, compared on a pool of worker threads:
+ *  load     Read the manifest: one "original new output" triple per line
+ *  run      Compare all pairs on a pool of workers, one JEngine per worker
+ *  report   Write the result of each pair and the totals
+ *
+ * Scheduling is size-aware work-stealing:
+ * - the pairs are sorted on size (original + new), largest first, and dealt out
+ *   round-robin to the workers' queues. Each worker starts with one of the
+ *   largest pairs and continues with the next largest of its own queue.
+ * - a worker whose queue is empty steals the smallest pair from the queue with
+ *   the most bytes left, so that small pairs fill the gaps while the large ones
+ *   are still running.
+ * Each queue has its own lock: workers only meet when stealing.
+ *
+ * Each worker reuses its engine (see JEngine), so a pair costs no process start
+ * and no table allocation. The output of a pair does not depend on the worker
+ * nor on the order in which the pairs are compared, provided the engines do not
+ * decide compares on measured seek times (CMP_CST): main uses CMP_ALL instead.
+ *******************************************************************************/
+
+#ifndef JBATCH_H_
+#define JBATCH_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "JDefs.h"
+#include "JEngine.h"
+
+namespace JojoDiff {
+
+class JBatch {
+public:
+    /* Create an empty batch */
+    JBatch();
+
+    virtual ~JBatch();
+
+    /**
+     * Read the pairs from a manifest: one "original new output" triple per line,
+     * separated by tabs (when the line contains one) or by blanks. Empty lines and
+     * lines starting with # are skipped.
+     * @param asMan     name of the manifest ("-" = standard input)
+     * @return 0 = ok, - EXI_FRT = cannot open manifest, > 0 = line number of an invalid line
+     */
+    int load (const char *asMan) ;
+
+    /**
+     * Compare all pairs.
+     * @param apEng     one engine per worker
+     * @param aiThrCnt  number of workers (threads)
+     * @return 0 = all pairs ok, < 0 = error of the first failed pair (see JEngine::diff)
+     */
+    int run (JEngine **apEng, int aiThrCnt) ;
+
+    /**
+     * Add a pair.
+     * @param asOrg     name of the original file, null = none (engines on a shared original)
+     * @param asOut     name of the output file, null = temporary file (see getTmp)
+     * @return number of the pair
+     */
+    int add (const char *asOrg, const char *asNew, const char *asOut) ;
+
+    /* Write the result of each pair (in manifest order) and the totals */
+    void report (FILE *apFil) ;
+
+    /* Result of a pair (see run) */
+    int getRet(int aiJob){return mpJob[aiJob].iiRet;};
+
+    /* Temporary output of a pair, rewound (null = none) */
+    FILE * getTmp(int aiJob) ;
+
+    /* Size of the output of a pair */
+    off_t getSzeOut(int aiJob){return mpJob[aiJob].izSzeOut;};
+
+    /* getters */
+    int getJobCnt(){return miJobCnt;};
+    int getThrCnt(){return miThrCnt;};
+    off_t getMaxOrg(){return mzMaxOrg;};    /* size of the largest original file */
+    off_t getMaxNew(){return mzMaxNew;};    /* size of the largest new file */
+
+private:
+    /* Pair of files */
+    typedef struct tJob {
+        char *isOrg ;       // name of the original file (or null)
+        char *isNew ;       // name of the new file
+        char *isOut ;       // name of the output file (null = temporary file)
+        FILE *ipTmp ;       // temporary output file
+        off_t izSzeOrg ;    // size of the original file
+        off_t izSzeNew ;    // size of the new file
+        off_t izSzeOut ;    // size of the patch
+        int   iiRet ;       // result of JEngine::diff
+        bool  ibEql ;       // no differences found ?
+        int   iiWrk ;       // worker that compared the pair
+        bool  ibStl ;       // stolen from another worker's queue ?
+        long long ilTim ;   // time taken (us)
+        int   iiHshHit ;    // statistics of the pair's JDiff
+        int   iiHshErr ;
+        int   iiHshRpr ;
+    } rJob ;
+
+    /* Worker and its queue */
+    typedef struct tWrk {
+        JBatch *ipBat ;     // the batch
+        int   iiWrk ;       // worker number
+        int  *ipQue ;       // queue: job numbers, largest first
+        int   iiBeg ;       // next job to take (owner)
+        int   iiEnd ;       // end of the queue (thieves take before it)
+        off_t izPnd ;       // bytes left in the queue
+        pthread_mutex_t itMtx ; // lock on the queue
+    } rWrk ;
+
+    /* Jobs */
+    rJob *mpJob ;               /* pairs, in manifest order                         */
+    int miJobCnt ;              /* number of pairs                                  */
+    int miJobMax ;              /* allocated number of pairs                        */
+    off_t mzMaxOrg ;            /* size of the largest original file                */
+    off_t mzMaxNew ;            /* size of the largest new file                     */
+
+    /* Workers */
+    rWrk *mpWrk ;               /* workers                                          */
+    int miThrCnt ;              /* number of workers                                */
+    JEngine **mpEng ;           /* engines, one per worker (during run)             */
+
+    /* Statistics */
+    long long mlTim ;           /* time taken by run (us)                           */
+
+    /* Thread: compare pairs until no queue has any left */
+    static void *ufThr (void *apWrk) ;
+
+    /* Take the next job for a worker: own queue first, then steal (-1 = none left) */
+    int ufTke (int aiWrk, bool &abStl) ;
+
+    /* Compare one pair on the given worker's engine */
+    void ufJob (int aiWrk, int aiJob) ;
+};
+}
+#endif /* JBATCH_H_ */
@@ -104,6 +104,7 @@ typedef unsigned long long int  hkey ;  // 64-bit hash keys
 typedef unsigned long int hkey ;        // 32-bit hash keys
 #define PRIhkey "lx"                    // format to print a hkey
 #endif /* _LARGESAMPLE */
+typedef unsigned long long int fkey ;   // 64-bit strong fingerprints
 const int SMPSZE = (int) sizeof(hkey) * 8 ;                                         // Number of bytes in a sample
 const off_t MAX_OFF_T = (((off_t)-1) ^ (((off_t) 1) << (sizeof(off_t) * 8 - 1))) ;  // Largest positive offset
 
@@ -119,6 +120,7 @@ const off_t MAX_OFF_T = (((off_t)-1) ^ (((off_t) 1) << (sizeof(off_t) * 8 - 1)))
 #define EXI_RED  8                      // Error reading file
 #define EXI_WRI  9                      // Error writing file
 #define EXI_MEM  10                     // Error allocating memory
+#define EXI_CNL  11                     // Cancelled (output is closed but incomplete)
 #define EXI_ERR  20                     // Spurious error occured
 
 /**
@@ -131,4 +133,21 @@ const off_t MAX_OFF_T = (((off_t)-1) ^ (((off_t) 1) << (sizeof(off_t) * 8 - 1)))
 #define EQL     0xA3    /* Equal        */
 #define BKT     0xA2    /* Backtrace    */
 
+/**
+ * Directory patch container (jdiff --dir, jptch --dir): a header, then one entry
+ * per line, with paths relative to the roots of the trees:
+ *   V <size> <original>\n                    member of the virtual original (see X)
+ *   P <len> <original>\t<new>\n<len bytes>   new = original patched with a jdiff patch
+ *   X <len> <new>\n<len bytes>               new = virtual original patched with a jdiff patch
+ *   N <len> <new>\n<len bytes>               new file, stored as is
+ *   C <original>\t<new>\n                    new = copy of original (unchanged or renamed)
+ *   M <new>\n                                directory
+ *   D <original>\n                           deleted (informational)
+ *   E\n                                      end of the container
+ * The virtual original is the concatenation of the V members, in order (jdiff --dir
+ * --cross): all V entries come before the first X entry.
+ */
+#define JDC_HDR "JDC 1\n"                 /* Header       */
+#define JDC_LIN (16 * 1024)               /* Maximum length of an entry line */
+
 #endif /* _JDEFS_H */
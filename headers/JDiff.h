@@ -27,6 +27,8 @@
  * If you want to reuse JojoDiff, you need following files:
  * - JDiff.h/cpp        The main JojoDiff class
  * - JHashPos.h/cpp     The hash table collection of (sample-key, position)
+ * - JHashIdx.h/cpp     The external index of (sample-key, position), for very large files
+ * - JHugeMem.h/cpp     Huge-page allocator for the hashtable and file buffers
  * - JMatchTable.h/cpp  The matching table logic
  * - JDefs.h            Global definitions
  * - JDebug.h/cpp       Debugging definitions
@@ -142,8 +144,21 @@
 #include "JDefs.h"
 #include "JFile.h"
 #include "JHashPos.h"
+#include "JHashIdx.h"
 #include "JMatchTable.h"
 #include "JOut.h"
+#include "JProgress.h"
+
+#define SYN_DST 16                      // Resync probe: bytes to go ahead on the new file
+#define SYN_SFT 8                       // Resync probe: maximum insert/delete shift
+#define SYN_EXT 128                     // Resync probe: number of equal bytes required
+
+#define AHD_MIN (16 * 1024)             // Adaptive lookahead: default minimum range (bytes)
+#define AHD_HST 32                      // Adaptive lookahead: number of distance classes (powers of 2)
+#define AHD_UPD 16                      // Adaptive lookahead: matches between two adjustments
+#define AHD_AGE 256                     // Adaptive lookahead: matches before the histogram is halved
+#define AHD_PCT 95                      // Adaptive lookahead: percentile of distances to cover
+#define AHD_MRG 4                       // Adaptive lookahead: margin on that percentile
 
 namespace JojoDiff {
 
@@ -163,6 +178,17 @@ public:
      * @param aiMchMax  Maximum entries in matching table (default = 8)
      * @param aiMchMin  Minimum entries in matching table (default = 4)
      * @param aiAhdMax  Maximum bytes to find ahead (default = 256kB)
+     * @param aiCmpMod  Compare out-of-buffer matches: CMP_NVR, CMP_ALL or CMP_CST (default = CMP_ALL)
+     * @param aiLclSze  Local hashtable size in number of elements, 0=none (default = 131072)
+     * @param aiIdxRat  External index sample rate, 0=none (default = none)
+     * @param asIdxDir  Directory for the external index files (default = system temp)
+     * @param abFpr     Verify samples with strong fingerprints (default = no)
+     * @param aiMchSze  Size of the matching table (default = 256)
+     * @param abOpt     Select matches on encoded patch size (default = no)
+     * @param aiBlkAln  Size of the aligned blocks to compare first, 0=none (default = none)
+     * @param aiAhdMin  Minimum bytes to find ahead, adapted up to aiAhdMax on observed
+     *                  match distances; aiAhdMax or more = fixed range (default = AHD_MIN)
+     * @param apAra     Arena for the hashtables and matching table (default = none)
      */
     JDiff(JFile * const apFilOrg, JFile * const apFilNew, JOut * const apOut,
         const int aiHshSze = 8388608, const
@@ -172,7 +198,27 @@ public:
         const int aiMchMax=8,
         const int aiMchMin=4,
         const int aiAhdMax=256*1024,
-        const bool abCmpAll = true);
+        const int aiCmpMod = CMP_ALL,
+        const int aiLclSze = 131072,
+        const int aiIdxRat = 0,
+        const char *asIdxDir = null,
+        const bool abFpr = false,
+        const int aiMchSze = MCH_MAX,
+        const bool abOpt = false,
+        const int aiBlkAln = 0,
+        const int aiAhdMin = AHD_MIN,
+        JArena *apAra = null);
+
+    /**
+     * Create JDiff for working on a part of the files (see setRange), sharing the
+     * settings and the prescanned hashtable (or external index) of a master JDiff.
+     * The master must have been prescanned (see prescan) and must outlive this one.
+     * @param aoMst     Master JDiff.
+     * @param apFilOrg  Original file (own instance: files are not shared).
+     * @param apFilNew  New file (own instance).
+     * @param apOut     Output handler.
+     */
+    JDiff(JDiff const &aoMst, JFile * const apFilOrg, JFile * const apFilNew, JOut * const apOut);
 
 	/**
 	 * Destroys JDiff object.
@@ -195,11 +241,66 @@ public:
     * @return EXI_MEM  10   Error allocating memory
     * @return EXI_ERR  20   Spurious error occured
 	*******************************************************************************/
-	int jdiff ();
+	virtual int jdiff ();
+
+	/**
+	 * Prescan the original file now instead of on the first lookahead.
+	 * Afterwards, the hashtable is no longer modified and may be shared.
+	 * @return 0 = ok, < 0 = error (see jdiff)
+	 */
+	int prescan ();
+
+	/**
+	 * Prepare for another pair of files, keeping the tables: the hashtables are
+	 * emptied and sized for the new original file (up to their size at construction),
+	 * the state and statistics are cleared. The files and the output must have been
+	 * restarted by the caller (see JEngine).
+	 * A JDiff sharing a master's tables keeps them: only its local hashtable and
+	 * matching table are emptied, for another new file against the same original
+	 * (azSzeOrg is not used). Call setRange afterwards to start elsewhere.
+	 * @param azSzeOrg  size of the original file
+	 * @return 0 = ok, - EXI_ERR = not possible (own external index)
+	 */
+	int reset (off_t azSzeOrg) ;
+
+	/**
+	 * Limit jdiff to the part [azBegNew, azEndNew) of the new file, starting at
+	 * position azBegOrg on the original file. Lookahead may read beyond azEndNew.
+	 */
+	void setRange(off_t azBegOrg, off_t azBegNew, off_t azEndNew){
+	    mzBegOrg = azBegOrg ; mzBegNew = azBegNew ; mzEndNew = azEndNew ;
+	};
+
+	/**
+	 * Report progress to, and check for cancellation on, the given handler (null = none).
+	 * A JDiff sharing a master's tables (see above) only checks for cancellation.
+	 * On cancellation, jdiff closes the output and returns - EXI_CNL.
+	 */
+	void setProgress(JProgress *apPrg){ mpPrg = apPrg ; };
 
 	/* getters */
 	JHashPos * getHsh(){return gpHsh;};
+	JHashPos * getHshLcl(){return gpHshLcl;};
+	JHashIdx * getIdx(){return gpIdx;};
+	JMatchTable * getMch(){return gpMch;};
 	int getHshErr(){return giHshErr;};
+	int getSynHit(){return giSynHit;};
+	off_t getEndOrg(){return mzEndOrg;};	/* position on the original file after jdiff */
+	JProgress * getProgress(){return mpPrg;};
+	off_t getBlkCnt(){return mzBlkCnt;};	/* number of aligned blocks compared */
+	off_t getBlkEql(){return mzBlkEql;};	/* number of equal aligned blocks */
+	int getAhdMin(){return miAhdMin;};	/* lookahead range: lower bound */
+	int getAhdMax(){return miAhdMax;};	/* lookahead range: upper bound */
+	int getAhdCur(){return miAhdCur;};	/* lookahead range: current */
+
+protected:
+	/**
+	 * Difference function for given concrete file and output types.
+	 * With final classes, the calls in the main loop are resolved (and inlined)
+	 * at compile time. JFile/JOut gives the generic (virtual) version.
+	 * Instantiated in JDiff.cpp for the file and output classes of JojoDiff.
+	 */
+	template <class TFile, class TOut> int ufJDiff () ;
 
 private:
 	/* Context */
@@ -207,7 +308,10 @@ private:
 	JFile * const mpFilNew ;    // New file to read
 	JOut  * const mpOut ;       // Output handler
 	JHashPos * gpHsh ;          // Hashtable containing hashes from mpFilOrg.
+	JHashPos * gpHshLcl ;       // Local hashtable: dense samples around the read position on mpFilOrg.
+	JHashIdx * gpIdx ;          // External index replacing gpHsh on very large files (or null).
 	JMatchTable * gpMch ;       // Table of matches
+	JProgress * mpPrg ;         // Progress handler (or null)
 
 	/* Settings */
 	const int miVerbse;     /* Vebosity level */
@@ -215,9 +319,23 @@ private:
 	const int miMchMax;     /* Max number of matches to find */
 	const int miMchMin;     /* Min number oif matches to find */
 	const int miAhdMax ;    /* Max number of bytes to look ahead */
-    const bool mbCmpAll ;   /* Compare all matches, even if data not in buffer? */
+	const int miAhdMin ;    /* Min number of bytes to look ahead (adaptive range) */
+    const int miCmpMod ;    /* Compare out-of-buffer matches: CMP_NVR, CMP_ALL, CMP_CST */
+    const bool mbFpr ;      /* Verify samples with strong fingerprints? */
+    const int miLclSze ;    /* Local hashtable size (for sharing) */
+    const bool mbOpt ;      /* Select matches on encoded patch size? (for sharing) */
+    const bool mbShr ;      /* Hashtable, index and block map are shared with a master JDiff? */
+    const int miBlkAln ;    /* Size of the aligned blocks, 0=none */
+    const int miHshSze ;    /* Hashtable size at construction (for reset) */
+    const int miSrcCfg ;    /* Prescan original file: 0=no, 1=yes (for reset) */
     int  miSrcScn;          /* Prescan original file: 0=no, 1=yes, 2=done */
 
+    /* Range */
+	off_t mzBegOrg;        // Start position on original file
+	off_t mzBegNew;        // Start position on new file
+	off_t mzEndNew;        // End position (exclusive) on new file
+	off_t mzEndOrg;        // Position reached on the original file at the end
+
     /* State */
 	off_t mzAhdOrg;        // Current ahead position on original file
 	off_t mzAhdNew;        // Current ahead position on new file
@@ -227,6 +345,35 @@ private:
 	int miValNew;          // Current file value
 	int miEqlOrg;          // Indicator for equal bytes in current sample
 	int miEqlNew;          // Indicator for equal bytes in current sample
+	off_t mzExtOrg;        // Start of the equal region found by ufFndAhd on original file
+	off_t mzExtNew;        // Start of the equal region found by ufFndAhd on new file
+	off_t mzExtLen;        // Length of the equal region found by ufFndAhd (0 = none)
+	rFpr mrFprOrg;         // Current fingerprint for original file
+	rFpr mrFprNew;         // Current fingerprint for new file
+
+	/* Local hashtable state */
+	int   miLclWin;        // Size of the local window (bytes around the read position)
+	off_t mzLclOrg;        // Current local position on original file (-1 = reset)
+	hkey  mlHshLcl;        // Current local hash value for original file
+	int   miValLcl;        // Current local file value
+	int   miEqlLcl;        // Indicator for equal bytes in current local sample
+
+	/* Aligned blocks: one bit per block, set if equal at the same offset in both files */
+	uchar *mpBlkEql;       // Bitmap of equal blocks (null = not yet compared)
+	off_t mzBlkCnt;        // Number of blocks compared
+	off_t mzBlkEql;        // Number of equal blocks
+
+	/* Adaptive lookahead range */
+	int   miAhdCur;            // Current number of bytes to look ahead (miAhdMin..miAhdMax)
+	int   miAhdHst[AHD_HST];   // Distances at which matches were found (log2 classes, aged)
+	int   miAhdCnt;            // Number of distances added to the histogram
+
+	/* External index lookup queue */
+	hkey  mkBatHsh[IDX_BAT];   // Queued keys from the new file
+	off_t mzBatNew[IDX_BAT];   // Positions of the queued keys in the new file
+	off_t mzBatOrg[IDX_BAT];   // Positions found in the original file (-1 = not found)
+	int   miBatEql[IDX_BAT];   // Quality of the queued samples
+	int   miBatCnt;            // Number of queued keys
 
 	/**
 	 * Flush pending output
@@ -253,15 +400,68 @@ private:
     /** Scans the original file and fills up the hashtable. */
     int ufFndAhdScn () ;
 
+    /** Slides the local hashtable window up to the given read position. */
+    int ufFndAhdLcl (off_t const &azRedOrg) ;
+
+    /** Adds a found position to the table of matches: returns false to stop the lookahead. */
+    bool ufFndAhdAdd (off_t const &azFndOrg, off_t const &azFndNew, off_t const &azRedNew,
+                      int aiEqlNew, off_t const &azBseOrg, int aiBck, int &aiFnd, int &aiMax,
+                      bool abVfy = false) ;
+
+    /** Looks up the queued keys in the external index: returns false to stop the lookahead. */
+    bool ufFndAhdBat (off_t const &azRedNew, off_t const &azBseOrg, int aiBck, int &aiFnd, int &aiMax) ;
+
     /** Hashes the next byte from specified file. */
     void ufFndAhdGet(JFile *apFil, const off_t &azPos, int &aiVal, int &aiEql, int aiSft) ;
 
+    /** Probes for a nearby resynchronization: returns the length of the equal region found (0 = none). */
+    off_t ufFndSyn (off_t const &azRedOrg, off_t const &azRedNew, off_t const &azBseOrg,
+                    off_t &azFndOrg, off_t &azFndNew) ;
+
+    /** Compares both files in aligned blocks and fills up the block map. */
+    int ufBlkScn () ;
+
+    /** Returns the number of bytes from azPos up to the end of a run of equal blocks (0 = none). */
+    off_t ufBlkRun (off_t const &azPos) ;
+
+    /** Returns the start of the first equal block from azPos up to azMax (-1 = none). */
+    off_t ufBlkNxt (off_t const &azPos, off_t const &azMax) ;
+
+    /** Adds a distance at which a match was found and adjusts the lookahead range. */
+    void ufAhdAdd (off_t const &azDst) ;
+
+    /** Calculates the offsets to reach a found position. */
+    void ufFndAhdSkp (off_t const &azRedOrg, off_t const &azRedNew,
+                      off_t const &azFndOrg, off_t const &azFndNew,
+                      off_t &azSkpOrg, off_t &azSkpNew, off_t &azAhd) ;
+
 public:
     /*
-     * Statistics about operations
+     * Statistics about operations: counted here, not in the (shared) tables
      */
+    int giHshHit ;         /* Number of hits in the hashtable                   */
+    int giLclHit ;         /* Number of hits in the local hashtable             */
+    int giIdxHit ;         /* Number of hits in the external index              */
     int giHshErr ;         /* Number of false hash hits                         */
+    int giSynHit ;         /* Number of differences resolved by the resync probe */
+    int giAhdGrw ;         /* Number of times the lookahead range was grown     */
+    int giAhdShr ;         /* Number of times the lookahead range was shrunk    */
 }; // class JDiff
 
+/**
+ * JDiff specialized at compile time for a file type and an output type, e.g.
+ * JDiffT<JFileIStreamAhead, JOutBin>. Both files must be of type TFile, the
+ * output of type TOut. Only the instantiations of JDiff.cpp are available.
+ */
+template <class TFile, class TOut>
+class JDiffT final : public JDiff {
+public:
+    using JDiff::JDiff ;
+
+    virtual int jdiff () {
+        return ufJDiff<TFile, TOut>() ;
+    }
+};
+
 } // namespace JojoDiff
 #endif /* JDIFF_H_ */
@@ -0,0 +1,160 @@
+/*
+ * JDiffPar.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Parallel difference: the new file is split into chunks of a fixed size, each
+ * chunk is compared on its own thread and the results are stitched together.
+ *
+ * - the master JDiff prescans the original file once. All chunks share its
+ *   hashtable (or external index), which is read-only from then on.
+ * - each chunk has its own files, matching table, local hashtable and output
+ *   (a temporary file). A chunk starts at the same position on the original
+ *   file as on the new file and stops at the end of its part of the new file.
+ *   Its lookahead may read beyond that end, into the next chunk (the overlapping
+ *   margin), so that the equal regions crossing the border are still found.
+ * - stitching copies the outputs in order, inserting a DEL or BKT wherever the
+ *   position reached on the original file by one chunk differs from the start
+ *   position of the next.
+ *
+ * The chunks depend on the chunk size only (or are given, e.g. on the members of
+ * a tar archive), never on the number of threads or on the order in which they
+ * complete, so the output is the same for any number of threads.
+ *******************************************************************************/
+
+#ifndef JDIFFPAR_H_
+#define JDIFFPAR_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "JDefs.h"
+#include "JDiff.h"
+#include "JOut.h"
+
+#define PAR_CHK (64 * 1024)             // Default chunk size (kB)
+
+namespace JojoDiff {
+
+/*
+ * Parallel chunked JDiff.
+ */
+class JDiffPar {
+public:
+    /**
+     * Create a parallel JDiff.
+     *
+     * @param apMst     master JDiff: settings and prescanned hashtable (see JDiff::prescan)
+     * @param asFilOrg  name of the original file
+     * @param asFilNew  name of the new file
+     * @param azSzeOrg  size of the original file
+     * @param azSzeNew  size of the new file
+     * @param apFilOut  output file
+     * @param apOut     binary output handler writing to apFilOut
+     * @param aiThrCnt  number of threads
+     * @param azChkSze  size of a chunk on the new file (bytes)
+     * @param alBufSze  buffer size per file and per chunk
+     * @param aiBlkSze  block size for reading
+     */
+    JDiffPar(JDiff *apMst, const char *asFilOrg, const char *asFilNew,
+             off_t azSzeOrg, off_t azSzeNew, FILE *apFilOut, JOut *apOut,
+             int aiThrCnt, off_t azChkSze, long alBufSze, int aiBlkSze);
+
+    /**
+     * Create a parallel JDiff on given chunks (e.g. the members of an archive, see JTar):
+     * chunk i runs from apBegNew[i] up to apBegNew[i + 1] (the last one up to azSzeNew)
+     * and starts on the original file at apBegOrg[i].
+     */
+    JDiffPar(JDiff *apMst, const char *asFilOrg, const char *asFilNew,
+             off_t azSzeNew, FILE *apFilOut, JOut *apOut,
+             int aiThrCnt, int aiChkCnt, const off_t *apBegOrg, const off_t *apBegNew,
+             long alBufSze, int aiBlkSze);
+
+    virtual ~JDiffPar();
+
+    /**
+     * Compare all chunks and write out the stitched result.
+     * @return 0 = ok, < 0 = error (see JDiff::jdiff)
+     */
+    int jdiff () ;
+
+    /* getters */
+    int getChkCnt(){return miChkCnt;};
+    long getSekCnt(){return mlSekCnt;};
+
+private:
+    /* Chunk */
+    typedef struct tChk {
+        off_t izBegOrg ;    // start position on the original file
+        off_t izBegNew ;    // start position on the new file
+        off_t izEndNew ;    // end position (exclusive) on the new file
+        off_t izEndOrg ;    // position reached on the original file
+        FILE *ipFil ;       // temporary output file
+        JOut *ipOut ;       // output handler (statistics)
+        int   iiRet ;       // result of JDiff::jdiff
+        int   iiHshHit ;    // statistics of the chunk's JDiff
+        int   iiLclHit ;
+        int   iiIdxHit ;
+        int   iiHshErr ;
+        int   iiSynHit ;
+        int   iiAhdGrw ;
+        int   iiAhdShr ;
+        int   iiHshRpr ;    // statistics of the chunk's matching table
+        int   iiFprHit ;
+        int   iiChkMem ;
+        int   iiCmpSft ;
+        int   iiOptSel ;
+    } rChk ;
+
+    /* Context */
+    JDiff * const mpMst ;       /* master JDiff                                     */
+    const char *msFilOrg ;      /* name of the original file                        */
+    const char *msFilNew ;      /* name of the new file                             */
+    FILE *mpFilOut ;            /* output file                                      */
+    JOut *mpOut ;               /* output handler                                   */
+
+    /* Settings */
+    int miThrCnt ;              /* number of threads                                */
+    long mlBufSze ;             /* buffer size per file and per chunk               */
+    int miBlkSze ;              /* block size                                       */
+
+    /* Chunks */
+    rChk *mpChk ;               /* chunks                                           */
+    int miChkCnt ;              /* number of chunks                                 */
+    int miChkNxt ;              /* next chunk to compare (protected by mtMtx)       */
+    pthread_mutex_t mtMtx ;     /* lock on the shared members                       */
+
+    /* Statistics (protected by mtMtx) */
+    off_t mzPrgNew ;            /* size of the compared chunks (progress)           */
+    long mlSekCnt ;             /* number of seeks on all chunks' files             */
+
+    /* Thread: compare chunks until none are left */
+    static void *ufThr (void *apPar) ;
+
+    /* Initialize a chunk */
+    void ufSetChk (int aiChk, off_t azBegOrg, off_t azBegNew, off_t azEndNew) ;
+
+    /* Compare one chunk */
+    void ufChk (int aiChk) ;
+
+    /* Stitch the chunks' outputs together */
+    int ufStc () ;
+};
+}
+#endif /* JDIFFPAR_H_ */
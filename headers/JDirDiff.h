@@ -0,0 +1,166 @@
+/*
+ * JDirDiff.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Difference between two directory trees:
+ *  scan     Walk both trees, pair the files and add the pairs to diff to a batch
+ *  write    Write the container (see JDC_HDR in JDefs.h) once the batch has run
+ *  report   Write the number of files of each kind
+ *
+ * Files are paired on their path relative to the roots of the trees:
+ * - a file with the same size and modification time in both trees is taken as
+ *   unchanged without reading it. With the same size only, the contents are
+ *   compared. Unchanged files are copied by jptch.
+ * - a new file without an original of the same path is looked up among the
+ *   originals that are not paired: first on size and a sampled hash (a few
+ *   blocks at the start, middle and end), then on the file name. A renamed file
+ *   with the same contents is copied, a renamed and modified file is diffed
+ *   against its previous version.
+ * - other new files are stored as is, originals that are not used are listed
+ *   as deleted.
+ * All pairs are diffed by the batch, on its pool of workers.
+ *
+ * With cross-file matching, all original files together form one virtual
+ * original (see JFileConcat), so content that moved from one file to another is
+ * found as well. Modified, renamed and new files are then all diffed against the
+ * virtual original, starting on their previous version when they have one.
+ *
+ * Only directories and regular files are handled: symbolic links and special
+ * files are skipped, as are names containing a tab or a newline.
+ *******************************************************************************/
+
+#ifndef JDIRDIFF_H_
+#define JDIRDIFF_H_
+
+#include <stdio.h>
+
+#include "JDefs.h"
+#include "JBatch.h"
+#include "JFileConcat.h"
+
+#define DIR_SMP 4096                    // Size of a block of the sampled hash
+
+namespace JojoDiff {
+
+class JDirDiff {
+public:
+    /**
+     * Create a tree difference.
+     * @param asDirOrg  root of the original tree
+     * @param asDirNew  root of the new tree
+     */
+    JDirDiff(const char *asDirOrg, const char *asDirNew);
+
+    virtual ~JDirDiff();
+
+    /**
+     * Walk both trees, pair the files and add the pairs to diff to the batch
+     * (with temporary outputs).
+     * @param apCat     cross-file matching: the original files are added to apCat,
+     *                  the pairs are to be diffed against it (null = pairs of files)
+     * @return 0 = ok, - EXI_FRT/SCD = original/new tree cannot be read
+     */
+    int scan (JBatch &aoBat, JFileConcat *apCat = null) ;
+
+    /**
+     * Write the container, after the batch has run.
+     * @return 0 = ok, < 0 = error of the first failed pair or - EXI_WRI
+     */
+    int write (JBatch &aoBat, FILE *apOut) ;
+
+    /* Write the number of files of each kind */
+    void report (FILE *apFil) ;
+
+private:
+    /* File or directory of a tree */
+    typedef struct tFil {
+        char *isPth ;       // path relative to the root
+        off_t izSze ;       // size
+        long long ilTim ;   // modification time (ns)
+        bool ibDir ;        // directory ?
+        bool ibUsd ;        // paired on path ?
+        bool ibRen ;        // original: base of a renamed file ?
+        bool ibSmp ;        // sampled hash computed ?
+        fkey ikSmp ;        // sampled hash
+    } rFil ;
+
+    /* Tree */
+    typedef struct tTre {
+        const char *isDir ; // root
+        rFil *ipFil ;       // files and directories, sorted on path
+        int iiCnt ;         // number of files and directories
+        int iiMax ;         // allocated number
+    } rTre ;
+
+    /* Container entry */
+    typedef struct tEnt {
+        char icTyp ;        // P, X, N, C, M or D (see JDC_HDR)
+        int iiOrg ;         // original file (-1 = none)
+        int iiNew ;         // new file (-1 = none)
+        int iiJob ;         // pair in the batch (P only)
+    } rEnt ;
+
+    rTre mrOrg ;                /* original tree                                    */
+    rTre mrNew ;                /* new tree                                         */
+    JFileConcat *mpCat ;        /* virtual original (cross-file matching, or null)  */
+    rEnt *mpEnt ;               /* entries, in the order of the new tree            */
+    int miEntCnt ;              /* number of entries                                */
+    int miEntMax ;              /* allocated number of entries                      */
+
+    /* Statistics */
+    int miUncMta ;              /* unchanged on size and time                       */
+    int miUncCnt ;              /* unchanged on contents                            */
+    int miRen ;                 /* renamed, unchanged                               */
+    int miRenMod ;              /* renamed and modified                             */
+    int miMod ;                 /* modified                                         */
+    int miAdd ;                 /* new files stored as is                           */
+    int miDel ;                 /* deleted files                                    */
+    int miSkp ;                 /* skipped: links, special files or names           */
+    off_t mzOut ;               /* size of the container                            */
+
+    /* Walk a (sub)directory of a tree */
+    int ufWlk (rTre &arTre, const char *asRel) ;
+
+    /* Add a file or directory to a tree */
+    void ufAddFil (rTre &arTre, const char *asPth, off_t azSze, long long alTim, bool abDir) ;
+
+    /* Add a container entry */
+    void ufAddEnt (char acTyp, int aiOrg, int aiNew, int aiJob) ;
+
+    /* Find the original for a new file without an original of the same path (-1 = none) */
+    int ufRen (int aiNew, bool &abEql) ;
+
+    /* Full name of a file of a tree */
+    static const char *ufPth (rTre const &arTre, int aiFil, char *acBuf) ;
+
+    /* Sampled hash of a file of a tree */
+    fkey ufSmp (rTre &arTre, int aiFil) ;
+
+    /* Compare the contents of two files */
+    static bool ufEql (const char *asOne, const char *asTwo) ;
+
+    /* Copy azLen bytes from one file to another */
+    static int ufCpy (FILE *apInp, FILE *apOut, off_t azLen) ;
+
+    /* Compare two files on path (qsort) */
+    static int ufCmpPth (const void *apOne, const void *apTwo) ;
+};
+}
+#endif /* JDIRDIFF_H_ */
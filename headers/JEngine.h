@@ -0,0 +1,134 @@
+/*
+ * JEngine.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Reusable diff engine for batches of file pairs:
+ *  diff     Compare one pair of files and write the binary patch
+ *
+ * Building a JDiff allocates (and clears) the hashtables, the file buffers and
+ * the matching table, which costs more than the comparison itself on small
+ * files. An engine builds them once, in one arena sized for the settings, and
+ * only resets them between two pairs:
+ * - the files and the output are restarted on the new handles;
+ * - the hashtables are emptied and sized for the new original file, never above
+ *   their size at construction, so only the part in use is cleared;
+ * - the matching table is put back on its freelist.
+ * After the first pair, diffing does not allocate any large structure anymore.
+ *
+ * An engine can also compare new files against a shared original (see JFileConcat):
+ * a master JDiff prescans the original once, and each pair is compared by a JDiff
+ * sharing its hashtable, starting on the original at the given member. Only the
+ * new file, the matching table and the output then belong to the engine.
+ *
+ * An engine is not thread-safe: use one engine per thread.
+ *******************************************************************************/
+
+#ifndef JENGINE_H_
+#define JENGINE_H_
+
+#include <stdio.h>
+
+#include "JDefs.h"
+#include "JArena.h"
+#include "JDiff.h"
+#include "JOutBin.h"
+#include "JFileConcat.h"
+#ifdef __MINGW32__
+#include "JFileAhead.h"
+#else
+#include <fstream>
+#include "JFileIStreamAhead.h"
+#endif
+
+namespace JojoDiff {
+
+/* File class for the engine */
+#ifdef __MINGW32__
+typedef JFileAhead JFileEng ;
+#else
+typedef JFileIStreamAhead JFileEng ;
+#endif
+
+class JEngine {
+public:
+    /**
+     * Create an engine: see JDiff for the settings (no external index).
+     *
+     * @param aiHshSze  hashtable size (samples): maximum over all original files
+     * @param alBufSze  buffer size per file
+     * @param aiBlkSze  block size for reading
+     */
+    JEngine(const int aiHshSze, const long alBufSze, const int aiBlkSze,
+            const int aiVerbse, const int abSrcBkt, const int aiSrcScn,
+            const int aiMchMax, const int aiMchMin,
+            const int aiAhdMax, const int aiCmpMod,
+            const int aiLclSze, const bool abFpr, const int aiMchSze,
+            const bool abOpt, const int aiBlkAln, const int aiAhdMin);
+
+    /**
+     * Create an engine on a shared original.
+     *
+     * @param apMst     master JDiff: settings and prescanned hashtable (see JDiff::prescan)
+     * @param aoCat     the master's original: the engine reads it through its own cache
+     * @param alBufSze  buffer size per file
+     * @param aiBlkSze  block size for reading
+     */
+    JEngine(JDiff *apMst, JFileConcat const &aoCat, const long alBufSze, const int aiBlkSze);
+
+    virtual ~JEngine();
+
+    /**
+     * Compare one pair of files.
+     * @param asFilOrg  name of the original file (shared original: member to start
+     *                  on, null = start of the original)
+     * @param asFilNew  name of the new file
+     * @param apFilOut  output file for the binary patch
+     * @return 0 = ok, < 0 = error (see JDiff::jdiff), - EXI_FRT/SCD = cannot open a file
+     */
+    int diff (const char *asFilOrg, const char *asFilNew, FILE *apFilOut) ;
+
+    /* getters */
+    JDiff * getDiff(){return mpDiff;};
+    JOutBin * getOut(){return mpOut;};
+    JArena * getArena(){return mpAra;};
+    JFileEng * getFilOrg(){return mpFilOrg;};
+    JFileEng * getFilNew(){return mpFilNew;};
+
+private:
+    JArena *mpAra ;             /* arena for the tables and buffers                 */
+#ifdef __MINGW32__
+    FILE *mpHdlOrg ;            /* original file handle                             */
+    FILE *mpHdlNew ;            /* new file handle                                  */
+#else
+    ifstream moHdlOrg ;         /* original file stream (reopened for each pair)    */
+    ifstream moHdlNew ;         /* new file stream (reopened for each pair)         */
+#endif
+    JFileEng *mpFilOrg ;        /* original file                                    */
+    JFileEng *mpFilNew ;        /* new file                                         */
+    JOutBin *mpOut ;            /* binary output                                    */
+    JDiff *mpDiff ;             /* the diff, reset for each pair                    */
+    JDiff *mpMst ;              /* master JDiff of a shared original (or null)      */
+    JFileConcat *mpCat ;        /* shared original (or null)                        */
+
+    /* Compare a new file against the shared original */
+    int ufDiffCat (const char *asFilOrg, const char *asFilNew, FILE *apFilOut) ;
+};
+}
+#endif /* JENGINE_H_ */
@@ -22,6 +22,8 @@
 #ifndef JFILE_H_
 #define JFILE_H_
 #include <stdio.h>
+#include <sys/time.h>
+#include "JDefs.h"
 
 namespace JojoDiff {
 
@@ -48,10 +50,41 @@ public:
 	    const int aiTyp     /* 0=read, 1=hard ahead, 2=soft ahead   */
 	) = 0 ;
 
+	/**
+	 * Get the address of buffered data at specified position, without reading from the file.
+	 * Allows callers to process buffered data in bulk instead of byte per byte.
+	 *
+	 * @param azPos		position to look for
+	 * @param aiLen		out: number of contiguous bytes available at the returned address
+	 * @return 			address of the data, or null if the position is not buffered
+	 */
+	virtual const uchar *getbuf (
+	    const off_t &azPos,	/* position to look for                 */
+	    int &aiLen          /* out: number of contiguous bytes      */
+	) {
+	    aiLen = 0 ;
+	    return null ;
+	}
+
 	/**
 	 * Return number of seek operations performed.
 	 */
 	virtual long seekcount() = 0;
+
+	/**
+	 * Return the measured average latency of a seek (seek + read of one block), in microseconds.
+	 * Returns 0 when unknown (no seeks performed yet, or not measured).
+	 */
+	virtual long seektime() {
+	    return 0 ;
+	}
+
+	/* Current time in microseconds (seek latency and progress measurements) */
+	static long long ustime() {
+	    struct timeval ltTim ;
+	    gettimeofday(&ltTim, null) ;
+	    return (long long) ltTim.tv_sec * 1000000 + ltTim.tv_usec ;
+	}
 };
 } /* namespace */
 #endif /* JFILE_H_ */
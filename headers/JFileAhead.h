@@ -26,6 +26,8 @@ using namespace std;
 
 #include "JDefs.h"
 #include "JFile.h"
+#include "JDebug.h"
+#include "JArena.h"
 
 namespace JojoDiff {
 /**
@@ -33,18 +35,46 @@ namespace JojoDiff {
  * accesses files, that is reading ahead to find equal regions and then coming
  * back to the base position for actual comparisons.
  */
-class JFileAhead: public JFile {
+class JFileAhead final : public JFile {
 public:
-    JFileAhead(FILE * apFil, const char *asFid, const long alBufSze = 256*1024, const int aiBlkSze = 4096 );
+    JFileAhead(FILE * apFil, const char *asFid, const long alBufSze = 256*1024, const int aiBlkSze = 4096,
+            JArena *apAra = null );
     virtual ~JFileAhead();
 
+    /**
+     * Restart on another file (or the same one, reopened), keeping the buffer.
+     */
+    void reset(FILE * apFil);
+
     /**
      * Get one byte from the file at given position. Position is incremented by one.
      * Soft reading returns EOB when requested data is not in the buffer.
+     * Inline: sequential reads from the buffer are resolved without a call.
      */
     int get(
         const off_t &azPos,   /* position to read from                */
         const int aiTyp 	  /* 0=read, 1=hard ahead, 2=soft ahead   */
+    ) {
+        if ((miRedSze > 0) && (azPos == mzPosRed)) {
+            mzPosRed++ ;
+            miRedSze--;
+            #if debug
+            if (JDebug::gbDbg[DBGRED])
+              fprintf(JDebug::stddbg, "ufFabGet(%s,"P8zd",%d)->%2x (mem %p).\n",
+                 msFid, azPos, aiTyp, *mpRed, mpRed);
+            #endif
+            return *mpRed++;
+        } else {
+            return get_frombuffer(azPos, aiTyp);
+        }
+    }
+
+    /**
+     * Get the address of buffered data at given position (null if not buffered).
+     */
+    const uchar *getbuf(
+        const off_t &azPos,   /* position to look for                 */
+        int &aiLen            /* out: number of contiguous bytes      */
     );
 
     /**
@@ -52,6 +82,11 @@ public:
      */
     long seekcount();
 
+    /**
+     * Return average seek latency in microseconds.
+     */
+    long seektime();
+
 private:
     /**
      * Tries to get data from the buffer. Calls get_outofbuffer if that is not possible.
@@ -87,6 +122,7 @@ private:
 
     /* Settings */
     long mlBufSze;      /* File lookahead buffer size                   */
+    JArena *mpAra;      /* arena holding the buffer (or null)           */
     int miBlkSze;       /* Read file in blocks of 4096 bytes            */
 
     /* Buffer state */
@@ -102,6 +138,7 @@ private:
 
     /* Statistics */
     long mlFabSek ;      /* Number of times an fseek operation was performed  */
+    long long mlFabTim ; /* Time spent in seeking reads (microseconds)        */
 };
 }
 #endif /* JFILEAHEAD_H_ */
@@ -0,0 +1,173 @@
+/*
+ * JFileConcat.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Concatenation of files, as one virtual file:
+ *  add      Append a file (a member) to the concatenation
+ *  find     Look up a member on name
+ *  get      Read from the virtual file (see JFile)
+ *
+ * The members are laid out one after the other: member n starts where member
+ * n - 1 ends, so one JDiff (and one prescanned hashtable) covers all of them and
+ * content that moved from one file to another is found as any other match.
+ *
+ * Reads go through a cache of blocks, mapped on the block number in the virtual
+ * file. A block crossing the end of a member is filled from both members. Only
+ * one member is open at a time: sequential reads (the prescan) open each member
+ * once, random reads (the lookahead) are mostly served from the cache.
+ *
+ * The member list can be shared by several concatenations (see the copy
+ * constructor), one per thread, each with its own cache and file handle. The
+ * list must then not change anymore, and it belongs to the first one.
+ *******************************************************************************/
+
+#ifndef JFILECONCAT_H_
+#define JFILECONCAT_H_
+
+#include <stdio.h>
+
+#include "JDefs.h"
+#include "JFile.h"
+#include "JArena.h"
+
+namespace JojoDiff {
+
+class JFileConcat final : public JFile {
+public:
+    /**
+     * Create an empty concatenation.
+     * @param asFid     file id (for debugging)
+     * @param alBufSze  size of the block cache
+     * @param aiBlkSze  block size for reading
+     * @param apAra     arena holding the cache (or null)
+     */
+    JFileConcat(const char *asFid, const long alBufSze = 256*1024, const int aiBlkSze = 4096,
+                JArena *apAra = null);
+
+    /**
+     * Create a concatenation of the same members, with its own cache and file handle.
+     */
+    JFileConcat(JFileConcat const &aoCat, const long alBufSze, const int aiBlkSze,
+                JArena *apAra = null);
+
+    virtual ~JFileConcat();
+
+    /**
+     * Append a member.
+     * @param asFil     name of the file
+     * @param azSze     size of the file
+     * @return number of the member
+     */
+    int add (const char *asFil, off_t azSze) ;
+
+    /* Number of a member on name (-1 = none) */
+    int find (const char *asFil) const ;
+
+    /**
+     * Get one byte at the given position of the virtual file.
+     * Soft reading returns EOB when the block is not in the cache.
+     */
+    int get (
+        const off_t &azPos,   /* position to read from                */
+        const int aiTyp       /* 0=read, 1=hard ahead, 2=soft ahead   */
+    ) {
+        if (azPos >= mzCurBeg && azPos < mzCurEnd)
+            return mpCur[azPos - mzCurBeg] ;
+        return get_fromcache(azPos, aiTyp) ;
+    }
+
+    /**
+     * Get the address of cached data at given position (null if not cached).
+     */
+    const uchar *getbuf (
+        const off_t &azPos,   /* position to look for                 */
+        int &aiLen            /* out: number of contiguous bytes      */
+    ) ;
+
+    /* Return number of seek operations performed */
+    long seekcount() { return mlSekCnt ; }
+
+    /* Return average seek latency in microseconds */
+    long seektime() { return mlSekCnt == 0 ? 0 : (long) (mlSekTim / mlSekCnt) ; }
+
+    /* getters */
+    int count() const {return mpLst->iiCnt;};                       /* number of members */
+    off_t size() const {return mpLst->izSze;};                      /* size of the virtual file */
+    const char *name(int aiMbr) const {return mpLst->ipMbr[aiMbr].isFil;};
+    off_t offset(int aiMbr) const {return mpLst->ipMbr[aiMbr].izBeg;};
+
+private:
+    /* Member */
+    typedef struct tMbr {
+        char *isFil ;       // name of the file
+        off_t izBeg ;       // start position in the virtual file
+        off_t izSze ;       // size of the file
+    } rMbr ;
+
+    /* Member list (shared) */
+    typedef struct tLst {
+        rMbr *ipMbr ;       // members, in order
+        int  *ipSrt ;       // member numbers, sorted on name
+        int   iiCnt ;       // number of members
+        int   iiMax ;       // allocated number of members
+        off_t izSze ;       // size of the virtual file
+    } rLst ;
+
+    /* Context */
+    const char *msFid ;         /* file id (for debugging)                          */
+    rLst *mpLst ;               /* member list                                      */
+    bool mbOwn ;                /* member list belongs to this concatenation?       */
+
+    /* Cache */
+    JArena *mpAra ;             /* arena holding the cache (or null)                */
+    long mlBufSze ;             /* size of the cache                                */
+    int miBlkSze ;              /* block size                                       */
+    int miBlkCnt ;              /* number of blocks in the cache                    */
+    uchar *mpBuf ;              /* cache                                            */
+    off_t *mpTag ;              /* block number held by each cache block (-1=none)  */
+
+    /* Current block (fast path of get) */
+    off_t mzCurBeg ;            /* start position of the current block              */
+    off_t mzCurEnd ;            /* end position of the current block                */
+    const uchar *mpCur ;        /* data of the current block                        */
+
+    /* Open member */
+    FILE *mpHdl ;               /* file handle (or null)                            */
+    int miHdlMbr ;              /* member that is open (-1 = none)                  */
+    off_t mzHdlPos ;            /* position within the open member                  */
+
+    /* Statistics */
+    long mlSekCnt ;             /* number of seeks (and reopens)                    */
+    long long mlSekTim ;        /* time spent in seeking reads (microseconds)       */
+
+    /* Allocate the cache */
+    void ufAlc () ;
+
+    /* Read a byte through the cache */
+    int get_fromcache (const off_t &azPos, const int aiTyp) ;
+
+    /* Read a block into the cache: 0 = ok, < 0 = error */
+    int ufRed (off_t azBlk, int aiSlt) ;
+
+    /* Member holding the given position */
+    int ufMbr (off_t azPos) const ;
+};
+}
+#endif /* JFILECONCAT_H_ */
@@ -34,7 +34,7 @@ namespace JojoDiff {
 /*
  * Unbuffered IStream access: all calls to JFile go straight through to istream.
  */
-class JFileIStream: public JFile {
+class JFileIStream final : public JFile {
 public:
     /**
      * Construct an unbuffered JFile on an istream.
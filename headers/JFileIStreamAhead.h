@@ -27,6 +27,8 @@ using namespace std;
 
 #include "JDefs.h"
 #include "JFile.h"
+#include "JDebug.h"
+#include "JArena.h"
 
 namespace JojoDiff {
 /**
@@ -34,18 +36,46 @@ namespace JojoDiff {
  * accesses files, that is reading ahead to find equal regions and then coming
  * back to the base position for actual comparisons.
  */
-class JFileIStreamAhead: public JFile {
+class JFileIStreamAhead final : public JFile {
 public:
-    JFileIStreamAhead(istream * apFil, const char *asFid, const long alBufSze = 256*1024, const int aiBlkSze = 4096 );
+    JFileIStreamAhead(istream * apFil, const char *asFid, const long alBufSze = 256*1024, const int aiBlkSze = 4096,
+            JArena *apAra = null );
     virtual ~JFileIStreamAhead();
 
+    /**
+     * Restart on another file (or the same one, reopened), keeping the buffer.
+     */
+    void reset(istream * apFil);
+
     /**
      * Get one byte from the file at given position. Position is incremented by one.
      * Soft reading returns EOB when requested data is not in the buffer.
+     * Inline: sequential reads from the buffer are resolved without a call.
      */
     int get(
         const off_t &azPos,   /* position to read from                */
         const int aiTyp 	  /* 0=read, 1=hard ahead, 2=soft ahead   */
+    ) {
+        if ((miRedSze > 0) && (azPos == mzPosRed)) {
+            mzPosRed++ ;
+            miRedSze--;
+            #if debug
+            if (JDebug::gbDbg[DBGRED])
+              fprintf(JDebug::stddbg, "ufFabGet(%s,"P8zd",%d)->%2x (mem %p).\n",
+                 msFid, azPos, aiTyp, *mpRed, mpRed);
+            #endif
+            return *mpRed++;
+        } else {
+            return get_frombuffer(azPos, aiTyp);
+        }
+    }
+
+    /**
+     * Get the address of buffered data at given position (null if not buffered).
+     */
+    const uchar *getbuf(
+        const off_t &azPos,   /* position to look for                 */
+        int &aiLen            /* out: number of contiguous bytes      */
     );
 
     /**
@@ -53,6 +83,11 @@ public:
      */
     long seekcount();
 
+    /**
+     * Return average seek latency in microseconds.
+     */
+    long seektime();
+
 private:
     /**
      * Tries to get data from the buffer. Calls get_outofbuffer if that is not possible.
@@ -88,6 +123,7 @@ private:
 
     /* Settings */
     long mlBufSze;      /* File lookahead buffer size                   */
+    JArena *mpAra;      /* arena holding the buffer (or null)           */
     int miBlkSze;       /* Read file in blocks of 4096 bytes            */
 
     /* Buffer state */
@@ -103,6 +139,7 @@ private:
 
     /* Statistics */
     long mlFabSek ;      /* Number of times an fseek operation was performed  */
+    long long mlFabTim ; /* Time spent in seeking reads (microseconds)        */
 };
 }
 #endif /* JFileIStreamAhead_H_ */
@@ -0,0 +1,140 @@
+/*
+ * JHashIdx.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * External (out-of-core) index of (sample-key, position) pairs:
+ *  add      Insert a sample during the prescan
+ *  close    Sort and merge the runs into the final index
+ *  get      Batched lookup into the index
+ *
+ * The in-memory JHashPos cannot keep a useful sample density on originals that
+ * are much larger than the memory we can give to the hashtable. The external
+ * index stores its samples on disk instead:
+ * - during the prescan, samples are collected in a run buffer. Each time the
+ *   buffer is full, it is sorted on key and written to a temporary file.
+ * - at the end of the prescan, the runs are merged (at most IDX_FAN runs at a
+ *   time) into one sorted index file, which is then mapped into memory.
+ * - lookups are done in batches: keys are sorted and resolved in one ascending
+ *   sweep over the index, so that the accessed pages are visited in order.
+ *
+ * Samples are selected on content (the key), not on position: a sample is only
+ * stored (and looked up) when its mixed key is a multiple of the sample rate.
+ * Equal regions in both files therefore always select the same samples, whatever
+ * their positions, and the index grows with the original file size / rate.
+ *******************************************************************************/
+
+#ifndef JHASHIDX_H_
+#define JHASHIDX_H_
+
+#include <stdio.h>
+
+#include "JDefs.h"
+#include "JDebug.h"
+
+#define IDX_BAT 256                     // Number of keys in a lookup batch
+#define IDX_FAN 256                     // Maximum number of runs to merge at once
+#define IDX_RUN (4 * 1024 * 1024)       // Default number of samples in a run
+
+namespace JojoDiff {
+
+/*
+ * External sorted index of file positions for JDiff.
+ */
+class JHashIdx {
+public:
+    /**
+     * Create a new external index.
+     *
+     * @param aiSmpRat  sample rate: keep one sample out of aiSmpRat (on average)
+     * @param asDir     directory for temporary files (null = system default)
+     * @param alRunSze  number of samples in a run (in-memory sort buffer)
+     */
+    JHashIdx(int aiSmpRat, const char *asDir = null, long alRunSze = IDX_RUN);
+
+    virtual ~JHashIdx();
+
+    /* Does the given key belong to the sampled set ? */
+    inline bool sample(hkey akCurHsh) const {
+        return (((unsigned long long) akCurHsh * 0x9E3779B97F4A7C15ULL) >> 32) % miSmpRat == 0 ;
+    }
+
+    /* Index insert (prescan): only sampled keys are kept */
+    int add (hkey akCurHsh, off_t azPos, int aiEqlCnt) ;
+
+    /* Terminate the prescan: merge all runs into the final index */
+    int close () ;
+
+    /* Batched index lookup: azPos[i] is set to -1 when akCurHsh[i] is not found.
+     * Returns the number of keys found. */
+    int get (hkey const *akCurHsh, off_t *azPos, int aiCnt) ;
+
+    /* return sample rate */
+    int get_samplerate(){return miSmpRat;}
+
+    /* return number of samples in the index */
+    off_t get_count(){return mzIdxCnt;}
+
+    /* return number of runs written during the prescan */
+    int get_runs(){return miRunTot;}
+
+private:
+    /* Index elements */
+    typedef struct tIdx {
+        hkey  ikHsh ;       // sample key
+        off_t izPos ;       // position within the original file
+    } rIdx ;
+
+    /* Settings */
+    int miSmpRat ;          /* sample rate                                          */
+    const char *msDir ;     /* directory for temporary files                        */
+
+    /* Run buffer */
+    rIdx *mpRun ;           /* run buffer                                           */
+    long mlRunSze ;         /* size of the run buffer                               */
+    long mlRunCnt ;         /* number of samples in the run buffer                  */
+
+    /* Written runs */
+    FILE **mpRunFil ;       /* run files                                            */
+    int miRunCnt ;          /* number of run files                                  */
+    int miRunMax ;          /* allocated number of run files                        */
+    int miRunTot ;          /* total number of runs written                         */
+
+    /* Final index */
+    FILE *mpIdxFil ;        /* index file                                           */
+    rIdx *mpIdx ;           /* mapped index                                         */
+    off_t mzIdxCnt ;        /* number of samples in the index                       */
+
+    /* Create a temporary file */
+    FILE *ufTmpFil () ;
+
+    /* Sort and write out the run buffer */
+    int ufRunWri () ;
+
+    /* Merge the given runs into one run */
+    FILE *ufRunMrg (FILE **apRun, int aiCnt) ;
+
+    /* Map the final index into memory */
+    int ufIdxMap () ;
+
+    /* Compare two index elements (qsort) */
+    static int ufCmp (const void *apOne, const void *apTwo) ;
+};
+}
+#endif /* JHASHIDX_H_ */
@@ -72,6 +72,19 @@
  * copy/insert algorithm (simulated with insert/delete/modify and backtrace
  * instructions). Without prescan/backtrace, the algorithm behaves like an
  * insert/delete algorithm.
+ *
+ * A hashtable can also be created in sliding window mode. In this mode, every
+ * new sample overrides the existing entry, such that the table always contains
+ * a dense set of samples of the most recently added region. JDiff uses such a
+ * small table over a window around the current read position on the original
+ * file, on top of the large table covering the whole file.
+ *
+ * Optionally, the hashtable also stores a strong 64-bit fingerprint of every
+ * stored sample: a rolling polynomial hash over exactly the SMPSZE bytes of the
+ * sample, modulo the prime 2^61-1. When the fingerprint of a sample on the new
+ * file equals the stored one, both samples are equal with near certainty (two
+ * different samples collide with a probability below SMPSZE / 2^61), without
+ * reading the original file.
  *******************************************************************************/
 
 #ifndef JHASHPOS_H_
@@ -79,9 +92,19 @@
 
 #include "JDefs.h"
 #include "JDebug.h"
+#include "JArena.h"
 
 namespace JojoDiff {
 
+/*
+ * Rolling fingerprint state: fingerprint and the last SMPSZE bytes.
+ */
+typedef struct tFpr {
+    fkey  ikFpr ;           // fingerprint of the last SMPSZE bytes
+    int   iiIdx ;           // index of the oldest byte in icWin
+    uchar icWin[SMPSZE] ;   // the last SMPSZE bytes
+} rFpr ;
+
 /*
  * Hashtable of file positions for JDiff.
  */
@@ -95,8 +118,11 @@ public:
      * of 8191 elements.
      *
      * @param aiSze   size, in number of elements.
+     * @param abSld   sliding window: every new sample overrides (default = no).
+     * @param abFpr   also store strong fingerprints (default = no).
+     * @param apAra   arena to take the table from (default = none: own allocation).
      */
-	JHashPos(int aiSze);
+	JHashPos(int aiSze, bool abSld=false, bool abFpr=false, JArena *apAra=null);
 
 	virtual ~JHashPos();
 
@@ -116,6 +142,27 @@ public:
 	    #endif
 	}
 
+	/* The fingerprint function:
+	 * Roll the fingerprint over one byte: add the new byte, remove the byte
+	 * that was added SMPSZE bytes ago.
+	 */
+	inline void fingerprint ( int const acNew, rFpr &arFpr ) const {
+	    fkey lkFpr = ufFprMul(arFpr.ikFpr, FPR_MUL) + acNew
+	               + (FPR_PME - ufFprMul(arFpr.icWin[arFpr.iiIdx], mkFprOut)) ;
+	    lkFpr = (lkFpr & FPR_PME) + (lkFpr >> 61) ;
+	    arFpr.ikFpr = (lkFpr >= FPR_PME) ? lkFpr - FPR_PME : lkFpr ;
+	    arFpr.icWin[arFpr.iiIdx] = (uchar) acNew ;
+	    arFpr.iiIdx = (arFpr.iiIdx + 1) % SMPSZE ;
+	}
+
+	/* Reset a fingerprint state (as if preceded by SMPSZE zeroes) */
+	static void fingerprint_reset ( rFpr &arFpr ) ;
+
+	/* Does this hashtable store fingerprints ? */
+	inline bool has_fingerprints() const {
+	    return mkHshTblFpr != null ;
+	}
+
 	/* Return the reliability range: reliability decreases as the hashtable load
 	 * increases. This function returns an estimation of the number of bytes to verify
 	 * before deciding that regions do not match.
@@ -124,11 +171,20 @@ public:
 		return miHshRlb ;
 	}
 
+	/* Override the reliability range, e.g. when samples are taken at a lower density */
+	inline void set_reliability(int aiHshRlb) {
+		miHshRlb = aiHshRlb ;
+	}
+
 	/* Hastable insert */
-	void add (hkey akCurHsh, off_t azPos, int aiEqlCnt ) ;
+	void add (hkey akCurHsh, off_t azPos, int aiEqlCnt, fkey akFpr = 0 ) ;
 
-	/* Hashtable lookup */
-	bool get (const hkey akCurHsh, off_t &azPos) ;
+	/* Hashtable lookup: also returns the stored fingerprint when apFpr is given */
+	bool get (const hkey akCurHsh, off_t &azPos, fkey *apFpr = null) ;
+
+	/* Empty the table for reuse, with a size not larger than the given size nor than
+	 * the size at construction. Only the part in use is cleared. */
+	void reset (int aiSze) ;
 
 	/* Hashtable printout */
 	void print() ;
@@ -139,6 +195,12 @@ public:
 	/* Return the index to use to create a hashtable of at most the given size. */
 	static int get_size_index(int sze);
 
+	/* Return the size to use for a hashtable on an original file of the given length. */
+	static int get_size(int aiMax, off_t azOrgSze);
+
+	/* Return the memory (bytes) taken by a hashtable of the given size. */
+	static size_t memsize(int aiSze, bool abFpr=false);
+
 	/* return hashtable primme number */
 	int get_hashprime(){return miHshPme;}
 
@@ -148,28 +210,43 @@ public:
 	/* return hastable collision override threshold */
 	int get_hashcolmax(){return miHshColMax;}
 
-	/* return number of hits found by this hashtable */
-	int get_hashhits(){return miHshHit;}
-
 private:
 	/* The hash table. Using a struct causes certain compilers (gcc) to align        */
 	/* fields on 64-bit boundaries, causing 25% memory loss. Therefore, I use        */
 	/* two arrays instead of an array of structs.                                    */
 	off_t *mzHshTblPos ;    /* Hash values: positions within the original file       */
 	hkey  *mkHshTblHsh ;    /* Hash keys                                             */
+	fkey  *mkHshTblFpr ;    /* Fingerprints (or null)                                */
+
+	/* Fingerprint modulus (2^61-1), multiplier and its SMPSZE'th power */
+	static const fkey FPR_PME = 0x1FFFFFFFFFFFFFFFULL ;
+	static const fkey FPR_MUL = 0x1F3D5B79A2C4E68BULL ;
+	fkey mkFprOut ;
+
+	/* Multiplication modulo FPR_PME of two numbers below FPR_PME, in 64 bits */
+	static inline fkey ufFprMul ( fkey const akOne, fkey const akTwo ) {
+	    fkey lkOneHgh = akOne >> 31, lkOneLow = akOne & 0x7FFFFFFFULL ;
+	    fkey lkTwoHgh = akTwo >> 31, lkTwoLow = akTwo & 0x7FFFFFFFULL ;
+	    fkey lkMid = lkOneLow * lkTwoHgh + lkOneHgh * lkTwoLow ;
+	    fkey lkRes = ((lkOneHgh * lkTwoHgh) << 1) + (lkMid >> 30)
+	               + ((lkMid & 0x3FFFFFFFULL) << 31) + lkOneLow * lkTwoLow ;
+	    lkRes = (lkRes & FPR_PME) + (lkRes >> 61) ;
+	    return (lkRes >= FPR_PME) ? lkRes - FPR_PME : lkRes ;
+	}
+	/* Settings */
+	const bool mbSld ;      /* sliding window: newest sample always wins, no overloading     */
 
 	/* Size */
 	int miHshPme  ;         /* prime number for size and hashing              				*/
 	int miHshSze ;          /* Actual size in bytes of the hashtable          				*/
+	int miHshCap ;          /* prime number at construction (capacity)        				*/
+	JArena *mpAra ;         /* arena holding the table (or null)              				*/
 
     /* State */
 	int miHshColMax;        /* max number of collisions before override       				*/
 	int miHshColCnt;        /* current number of subsequent collisions.               		*/
 	int miHshRlb ;          /* hashtable reliability: decreases as the overloading grows 	*/
     int miLodCnt ;          /* hashtable load-counter                                       */
-
-    /* Statistics */
-    int miHshHit;           /* number of hits found by this hashtable                       */
 };
 }
 #endif /* JHASHPOS_H_ */
@@ -0,0 +1,68 @@
+/*
+ * JHugeMem.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Allocator for large, randomly accessed structures (hashtable, file buffers):
+ *  alloc    Allocate a zeroed block
+ *  free     Release a block allocated by alloc
+ *
+ * Random lookups into a hashtable of hundreds of megabytes cause a TLB miss on
+ * nearly every access when the table is backed by 4 kB pages. Blocks of at least
+ * HUG_SZE bytes are therefore mapped on a HUG_SZE boundary and marked for
+ * transparent huge pages (madvise MADV_HUGEPAGE). When huge pages are unavailable,
+ * the block is simply backed by normal pages. Smaller blocks, and all blocks on
+ * platforms without mmap, use calloc.
+ *******************************************************************************/
+
+#ifndef JHUGEMEM_H_
+#define JHUGEMEM_H_
+
+#include <stddef.h>
+#include <atomic>
+
+#include "JDefs.h"
+
+#define HUG_SZE (2 * 1024 * 1024)       // Huge page size (and alignment)
+
+namespace JojoDiff {
+
+class JHugeMem {
+public:
+    /* Allocate a zeroed block of the given size (null on failure) */
+    static void *alloc(size_t alSze) ;
+
+    /* Release a block allocated by alloc: the size must be the same as given to alloc */
+    static void free(void *apMem, size_t alSze) ;
+
+    /* Memory taken by a block of the given size: huge blocks are rounded up to HUG_SZE */
+    static size_t size(size_t alSze) {
+        return (alSze >= HUG_SZE) ? (alSze + HUG_SZE - 1) & ~((size_t) HUG_SZE - 1) : alSze ;
+    }
+
+    /* Return the number of kB currently backed by huge pages in this process (-1 = unknown) */
+    static long hugepages() ;
+
+    /* Statistics: atomic, as engines allocate from worker threads (--batch, --dir, -j) */
+    static std::atomic<long> glHugReq ;  /* number of bytes requested as huge pages     */
+    static std::atomic<int>  giHugAdv ;  /* number of blocks for which madvise succeeded */
+    static std::atomic<int>  giHugErr ;  /* number of blocks for which madvise failed    */
+};
+}
+#endif /* JHUGEMEM_H_ */
@@ -25,9 +25,19 @@
 #include "JDefs.h"
 #include "JFile.h"
 #include "JHashPos.h"
+#include "JArena.h"
 
-#define MCH_PME 127                     // Matching hashtable prime
-#define MCH_MAX 256                     // Maximum size of matching table
+#define MCH_MAX 256                     // Default size of matching table
+#define MCH_MIN 16                      // Minimum size of matching table
+#define MCH_LIM 65536                   // Maximum size of matching table
+
+#define CMP_NVR 0                       // Compare out-of-buffer matches: never (soft reads only)
+#define CMP_ALL 1                       // Compare out-of-buffer matches: always (hard reads)
+#define CMP_CST 2                       // Compare out-of-buffer matches: when worth the seek
+#define CMP_USB 1                       // Seek time (microseconds) worth spending per byte of gain
+
+#define OPT_MAX 32                      // Number of verified candidates for optimal selection
+#define OPT_WIN 4096                    // Maximum length of an equal region for optimal selection
 
 namespace JojoDiff {
 
@@ -35,8 +45,21 @@ namespace JojoDiff {
  * between two files and allows to select the "best" match from the table. */
 class JMatchTable {
 public:
-	/* Construct a matching table for specified hashtable, original and new files. */
-	JMatchTable(JHashPos const * cpHsh,  JFile  * apFilOrg, JFile  * apFilNew, const bool abCmpAll = true);
+	/* Construct a matching table for specified hashtable, original and new files,
+	 * holding at most aiMchSze matches (between MCH_MIN and MCH_LIM).
+	 * aiCmpMod tells when to compare out-of-buffer data: CMP_NVR, CMP_ALL or CMP_CST.
+	 * The pool is taken from apAra when given. */
+	JMatchTable(JHashPos const * cpHsh,  JFile  * apFilOrg, JFile  * apFilNew, const int aiCmpMod = CMP_ALL,
+	        const int aiMchSze = MCH_MAX, const bool abOpt = false, JArena *apAra = null);
+
+	/* Return the number of matches the table can hold */
+	int get_size() const { return miMchSze; }
+
+	/* Return the memory (bytes) taken by a table holding aiMchSze matches */
+	static size_t memsize(int aiMchSze) ;
+
+	/* Empty the table for reuse */
+	void reset () ;
 
 	/* Destructor */
 	virtual ~JMatchTable();
@@ -50,22 +73,38 @@ public:
 	 *   0   if a new entry has been added and table is full
 	 *   1   if a new entry has been added
 	 *   2   if an existing entry has been enlarged
+	 * A verified match (equal fingerprints) is accepted without compare when
+	 * its data is out of buffer.
 	 * ---------------------------------------------------------------------------*/
 	int add (
 	  off_t const &czFndOrgAdd,      /* match to add               */
 	  off_t const &czFndNewAdd,
 	  off_t const &czBseNew,
-	  int   ciEqlNew
+	  int   ciEqlNew,
+	  bool  cbVfy = false            /* verified by fingerprint ?  */
 	);
 
 	/* -----------------------------------------------------------------------------
 	 * Get the nearest optimized and valid match from the array of matches.
+	 * Not const: the outcome of each check is memoized in the table.
 	 * ---------------------------------------------------------------------------*/
 	bool get (
 	  off_t const &azBseOrg,       /* base positions       */
 	  off_t const &azBseNew,
 	  off_t &azBstOrg,             /* best position found  */
 	  off_t &azBstNew
+	) ;
+
+	/* -----------------------------------------------------------------------------
+	 * Extend an equal region in both directions, within the buffered data:
+	 * moves azPosOrg/azPosNew back to the exact start of the region (not before
+	 * azMinOrg/azMinNew) and returns the exact length of the region.
+	 * ---------------------------------------------------------------------------*/
+	off_t extend (
+	  off_t &azPosOrg,             /* in/out: position within the equal region */
+	  off_t &azPosNew,
+	  off_t const &azMinOrg,       /* do not extend before these positions     */
+	  off_t const &azMinNew
 	) const;
 
 	/* -----------------------------------------------------------------------------
@@ -95,6 +134,40 @@ private:
 	    int aiLen, int aiSft
 	    ) const ;
 
+	/* -----------------------------------------------------------------------------
+	 * Compare policy for one candidate: returns 1 (hard read) when verifying the
+	 * candidate is worth the expected seeks, 2 (soft read) otherwise.
+	 * ---------------------------------------------------------------------------*/
+	int ufCmpTyp (
+	    off_t const &azTstOrg, off_t const &azTstNew,
+	    off_t const &azRedOrg, off_t const &azRedNew,
+	    int aiDst, int aiCnt
+	    ) ;
+
+	/* -----------------------------------------------------------------------------
+	 * Optimal selection: among the verified candidates, select the one that starts
+	 * the sequence of jumps and equal regions with the smallest encoded size.
+	 * ---------------------------------------------------------------------------*/
+	int ufOptSel (
+	    off_t const &azRedOrg, off_t const &azRedNew,
+	    off_t *azOptOrg, off_t *azOptNew, int aiOptCnt
+	    ) ;
+
+	/* Encoded size of going from one position to another (jumps and data). */
+	int ufOptJmp (
+	    off_t const &azFroOrg, off_t const &azFroNew,
+	    off_t const &azTooOrg, off_t const &azTooNew
+	    ) const ;
+
+	/* Return the number of leading equal bytes in contiguous buffered data. */
+	static int ufExtSpn ( const uchar *apOrg, const uchar *apNew, int aiSpn ) ;
+
+	/* Compare contiguous buffered data for check(): returns the number of bytes compared. */
+	static int ufChkSpn (
+	    const uchar *apOrg, const uchar *apNew,
+	    int aiSpn, int aiLen, int &aiEql, int &aiRet
+	    ) ;
+
 	/*
 	 * Context: we need the hashtable and the two source files
 	 */
@@ -104,32 +177,61 @@ private:
 
 	/*
 	 * Matchtable elements
+	 *
+	 * Elements are stored as a structure of arrays, indexed by element number, in one
+	 * pool allocated at construction. Elements are linked by element numbers (-1 = end
+	 * of list):
+	 * - in a collision list per bucket of the hashtable on izDlt (or in the freelist),
+	 * - in a double linked list of live elements ordered on izBeg.
+	 * get() walks the ordered list and stops as soon as no further element can beat the
+	 * best solution found, cleanup() only visits live elements.
 	 */
-	typedef struct tMch {
-	    struct tMch *ipNxt ;   /* next element in collision list */
-
-	    int iiCnt ;         // number of colliding matches
-	    int iiTyp ;         // type of match:  0=unknown, 1=colliding, -1=gliding
-	    off_t izBeg ;       // first found match (new file position)
-	    off_t izNew ;       // last  found match (new file position)
-	    off_t izOrg ;       // last  found match (org file position)
-	    off_t izDlt ;       // delta: izOrg = izNew + izDlt
-
-        // int iiCmp ;         // compare status: 0=equal, 1=maybe equal, 2=not equal, 7=unverified unequal
-	} rMch ;
-
-	rMch *msMch ;               /* table of matches */
-	rMch *mpMch[MCH_PME];       /* hastable on izDlt with matches       */
-	rMch *mpMchFre ;            /* freelist of matches (iiCnt == -1)    */
-    rMch *mpMchGld ;            /* last gliding match */
-    off_t mzGldDlt ;            /* last gliding match next delta */
+	int   *miCnt ;          // number of colliding matches
+	int   *miTyp ;          // type of match:  0=unknown, 1=colliding, -1=gliding
+	off_t *mzBeg ;          // first found match (new file position)
+	off_t *mzNew ;          // last  found match (new file position)
+	off_t *mzOrg ;          // last  found match (org file position)
+	off_t *mzDlt ;          // delta: izOrg = izNew + izDlt
+	off_t *mzVfyNew ;       // last sample verified by fingerprint (new file position, -1 = none)
+	off_t *mzVfyOrg ;       // last sample verified by fingerprint (org file position)
+	off_t *mzChkBeg ;       // last check: begin of tested range (new file position)
+	off_t *mzChkEnd ;       // last check: end of tested range (new file position)
+	off_t *mzChkDlt ;       // last check: delta between tested positions
+	off_t *mzChkRun ;       // last check: begin of equal run found (new file position)
+	int   *miChkRes ;       // last check: 0=run found, 2=no run in range, 1=unknown (not reusable)
+	int   *miHshNxt ;       // next element in collision list (or freelist)
+	int   *miLstNxt ;       // next element in ordered list
+	int   *miLstPrv ;       // previous element in ordered list
+
+	int *miMch ;            /* hastable on izDlt with matches       */
+	int miMchSze ;          /* number of elements in the pool       */
+	int miMchMsk ;          /* number of buckets - 1 (power of two) */
+	int miMchFre ;          /* freelist of matches                  */
+	JArena *mpAra ;         /* arena holding the pool (or null)     */
+	int miLstFst ;          /* first element of the ordered list    */
+	int miLstLst ;          /* last element of the ordered list     */
+	int miMchGld ;          /* last gliding match                   */
+	off_t mzGldDlt ;        /* last gliding match next delta        */
+
+	/* Bucket of the hashtable for given delta */
+	inline int ufBck ( off_t const &azDlt ) const {
+	    return (int) ((azDlt ^ (azDlt >> 16)) & miMchMsk) ;
+	}
+
+	/* Remove an element from its collision list, the ordered list, and add it to the freelist */
+	void ufFre ( int aiCur ) ;
 
 	/* settings */
-	bool mbCmpAll ;             /* Compare all matches, even if data not in buffer? */
+	int miCmpMod ;              /* Compare out-of-buffer matches: CMP_NVR, CMP_ALL, CMP_CST */
+	bool mbOpt ;                /* Select matches on encoded size (ufOptSel)?        */
 
 public:
-	/* statistics */
-	static int siHshRpr;        /* Number of repaired hash hits (by compare)         */
+	/* statistics, per table: tables of concurrent JDiffs are counted apart */
+	int miHshRpr;               /* Number of repaired hash hits (by compare)         */
+	int miFprHit;               /* Number of matches accepted on fingerprint         */
+	int miChkMem;               /* Number of compares avoided by reusing a check     */
+	int miCmpSft;               /* Number of hard compares declined as too costly    */
+	int miOptSel;               /* Number of selections changed by ufOptSel          */
 };
 
 }
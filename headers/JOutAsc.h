@@ -29,7 +29,7 @@
 
 namespace JojoDiff {
 
-class JOutAsc: public JOut {
+class JOutAsc final : public JOut {
 public:
     JOutAsc(FILE *apFilOut );
     virtual ~JOutAsc();
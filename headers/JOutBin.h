@@ -31,11 +31,14 @@
 
 namespace JojoDiff {
 
-class JOutBin: public JOut {
+class JOutBin final : public JOut {
 public:
     JOutBin(FILE *apFilOut );
     virtual ~JOutBin();
 
+    /* Restart on another output file, clearing the statistics */
+    void reset(FILE *apFilOut);
+
     virtual bool put (
       int   aiOpr,
       off_t azLen,
@@ -45,6 +48,9 @@ public:
       off_t azPosNew
     );
 
+    /* Size of an encoded length (for estimating patch sizes) */
+    static int ufPutSze ( off_t azLen ) ;
+
 private:
     FILE *mpFilOut ;    // output file
 
@@ -55,7 +61,6 @@ private:
 
     void ufPutByt ( int aiByt ) ;
     void ufPutOpr ( int aiOpr ) ;
-    int  ufPutSze ( off_t azLen ) ;
     void ufPutLen ( off_t azLen ) ;
 };
 
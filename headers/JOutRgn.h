@@ -30,7 +30,7 @@
 
 namespace JojoDiff {
 
-class JOutRgn: public JojoDiff::JOut {
+class JOutRgn final : public JojoDiff::JOut {
 public:
     JOutRgn(FILE *apFilOut );
     virtual ~JOutRgn();
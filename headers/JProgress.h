@@ -0,0 +1,100 @@
+/*
+ * JProgress.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Progress reporting and cooperative cancellation for JDiff.
+ *
+ * JDiff calls update at safe points (about every PRG_STP bytes) with the current
+ * phase and positions. update calculates the throughput and estimated time to
+ * completion of the phase, calls report at most once per interval (and on every
+ * change of phase), and returns false once cancel has been called. JDiff then
+ * stops, closes the output stream and returns - EXI_CNL.
+ *
+ * cancel only sets a flag, so it may be called from a signal handler or from
+ * another thread.
+ *******************************************************************************/
+
+#ifndef JPROGRESS_H_
+#define JPROGRESS_H_
+
+#include <signal.h>
+
+#include "JDefs.h"
+
+#define PRG_SCN 0                       // Phase: comparing blocks or prescanning the original file
+#define PRG_DIF 1                       // Phase: comparing the files
+#define PRG_END 2                       // Phase: done
+#define PRG_STP (1024 * 1024)           // Bytes between two calls to update
+
+namespace JojoDiff {
+
+/**
+ * Abstract progress handler.
+ */
+class JProgress {
+public:
+    /**
+     * @param azSzeOrg  size of the original file
+     * @param azSzeNew  size of the new file
+     * @param alItv     minimum interval between two reports (microseconds)
+     */
+    JProgress(off_t azSzeOrg, off_t azSzeNew, long alItv = 1000000) ;
+    virtual ~JProgress(){};
+
+    /**
+     * Progress update, called by JDiff at safe points.
+     * @param aiPhs     phase: PRG_SCN, PRG_DIF or PRG_END
+     * @param azPosOrg  bytes processed in the original file
+     * @param azPosNew  bytes processed in the new file
+     * @return false = cancelled
+     */
+    bool update(int aiPhs, off_t azPosOrg, off_t azPosNew) ;
+
+    /** Request cancellation (async-signal-safe). */
+    void cancel(){ mbCnl = 1 ; }
+
+    /** Has cancellation been requested ? */
+    bool cancelled() const { return mbCnl != 0 ; }
+
+protected:
+    /**
+     * Report progress.
+     * @param aiPhs     phase: PRG_SCN, PRG_DIF or PRG_END
+     * @param azPosOrg  bytes processed in the original file
+     * @param azPosNew  bytes processed in the new file
+     * @param adPct     percentage of the phase done
+     * @param adBps     throughput of the phase (bytes per second)
+     * @param alEta     estimated seconds to the end of the phase (-1 = unknown)
+     */
+    virtual void report(int aiPhs, off_t azPosOrg, off_t azPosNew,
+                        double adPct, double adBps, long alEta) = 0 ;
+
+    off_t mzSzeOrg ;            /* size of the original file                */
+    off_t mzSzeNew ;            /* size of the new file                     */
+
+private:
+    volatile sig_atomic_t mbCnl ;   /* cancellation requested               */
+    long  mlItv ;               /* minimum interval between reports (us)    */
+    int   miPhs ;               /* current phase (-1 = none yet)            */
+    long long mlPhsTim ;        /* start time of the current phase (us)     */
+    long long mlRptTim ;        /* time of the last report (us)             */
+};
+}
+#endif /* JPROGRESS_H_ */
@@ -0,0 +1,51 @@
+/*
+ * JProgressOut.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Machine-readable progress output (jdiff -p), one line per report:
+ *   progress phase=<prescan|diff|done> org=<bytes> new=<bytes> orgsize=<bytes>
+ *            newsize=<bytes> percent=<0.0-100.0> rate=<bytes/s> eta=<s|-1>
+ *******************************************************************************/
+
+#ifndef JPROGRESSOUT_H_
+#define JPROGRESSOUT_H_
+
+#include <stdio.h>
+
+#include "JProgress.h"
+
+namespace JojoDiff {
+
+class JProgressOut final : public JProgress {
+public:
+    /**
+     * @param apFilOut  file to write the progress lines to (null = cancellation only)
+     */
+    JProgressOut(FILE *apFilOut, off_t azSzeOrg, off_t azSzeNew, long alItv = 1000000) ;
+
+protected:
+    virtual void report(int aiPhs, off_t azPosOrg, off_t azPosNew,
+                        double adPct, double adBps, long alEta) ;
+
+private:
+    FILE *mpFilOut ;    // progress output
+};
+}
+#endif /* JPROGRESSOUT_H_ */
@@ -0,0 +1,129 @@
+/*
+ * JTar.h
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ * Members of a tar archive, for chunked diffing of archives (see JDiffPar):
+ *  load     Read the member headers of an archive
+ *  pair     Pair the members with those of the original archive and lay out the
+ *           chunks of the new archive
+ *
+ * Headers are ustar (name and prefix), pax (path and size of the extended
+ * header) or GNU (long name). The extended headers belong to the member that
+ * follows them: a member runs from its first header to the end of its data.
+ * Parsing stops at the end-of-archive blocks or at the first invalid header;
+ * the rest of the archive is then the trailer.
+ *
+ * Chunks start on member boundaries:
+ * - a member starts on the original archive at the member of the same name, or,
+ *   when there is none, where the previous member ended on the original. Its
+ *   chunk's local hashtable so starts on its previous version, and the global
+ *   (prescanned) hashtable finds contents moved in from other members.
+ * - a new chunk starts at a member when the member's start on the original does
+ *   not follow from the current chunk, or when the chunk is large enough. Small
+ *   members are kept together, large members are split into chunks.
+ * So a member that is added or removed early in the archive does not shift all
+ * the following ones: their chunks start on their counterparts.
+ *******************************************************************************/
+
+#ifndef JTAR_H_
+#define JTAR_H_
+
+#include <stdio.h>
+
+#include "JDefs.h"
+
+#define TAR_BLK 512                     // Size of a tar block
+#define TAR_MIN (64 * 1024)             // Minimum size of a chunk started at a member
+
+namespace JojoDiff {
+
+class JTar {
+public:
+    /* Create an empty list of members */
+    JTar();
+
+    virtual ~JTar();
+
+    /**
+     * Read the member headers of an archive.
+     * @param asFil     name of the archive
+     * @return 0 = ok, - EXI_FRT = cannot open, - EXI_RED = not a tar archive
+     */
+    int load (const char *asFil) ;
+
+    /**
+     * Pair the members with those of the original archive and lay out the chunks
+     * of this (new) archive.
+     * @param aoOrg     members of the original archive
+     * @param azSzeOrg  size of the original archive
+     * @param azSzeNew  size of this archive
+     * @param azChkSze  maximum size of a chunk
+     */
+    void pair (JTar const &aoOrg, off_t azSzeOrg, off_t azSzeNew, off_t azChkSze) ;
+
+    /* Number of a member on name (-1 = none): the first of that name */
+    int find (const char *asNam) const ;
+
+    /* getters */
+    int getMbrCnt(){return miMbrCnt;};      /* number of members                    */
+    int getParCnt(){return miParCnt;};      /* number of members paired on name     */
+    int getChkCnt(){return miChkCnt;};      /* number of chunks                     */
+    const off_t *getBegOrg(){return mpBegOrg;};  /* chunks' start on the original  */
+    const off_t *getBegNew(){return mpBegNew;};  /* chunks' start on this archive  */
+
+private:
+    /* Member */
+    typedef struct tMbr {
+        char *isNam ;       // name
+        off_t izBeg ;       // position of the first header
+        off_t izEnd ;       // end of the data (padded)
+    } rMbr ;
+
+    rMbr *mpMbr ;               /* members, in archive order                        */
+    int  *mpSrt ;               /* member numbers, sorted on name                   */
+    int miMbrCnt ;              /* number of members                                */
+    int miMbrMax ;              /* allocated number of members                      */
+    off_t mzEnd ;               /* end of the last member (start of the trailer)    */
+
+    /* Chunks */
+    off_t *mpBegOrg ;           /* start of each chunk on the original              */
+    off_t *mpBegNew ;           /* start of each chunk on this archive              */
+    int miChkCnt ;              /* number of chunks                                 */
+    int miChkMax ;              /* allocated number of chunks                       */
+    int miParCnt ;              /* number of members paired on name                 */
+
+    /* Add a member */
+    void ufAddMbr (const char *asNam, off_t azBeg, off_t azEnd) ;
+
+    /* Add a chunk */
+    void ufAddChk (off_t azBegNew, off_t azBegOrg) ;
+
+    /* Lay out the chunks of a region of this archive, starting at azBegOrg on the original */
+    void ufLay (off_t azBegNew, off_t azEndNew, off_t azBegOrg, off_t azSzeOrg, off_t azChkSze,
+                off_t &azChkBeg, off_t &azChkDlt) ;
+
+    /* Numeric header field: octal or base-256 (-1 = invalid) */
+    static off_t ufNum (const uchar *acFld, int aiLen) ;
+
+    /* Value of a pax record in an extended header (null = none) */
+    static char *ufPax (char *asDta, off_t azLen, const char *asKey) ;
+};
+}
+#endif /* JTAR_H_ */
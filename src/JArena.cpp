@@ -0,0 +1,66 @@
+/*
+ * JArena.cpp
+ *
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <new>
+using namespace std;
+
+#include "JArena.h"
+#include "JHugeMem.h"
+
+namespace JojoDiff {
+
+/**
+ * Allocate the arena.
+ */
+JArena::JArena(size_t alSze) : mlSze(size(alSze)), mlUsd(0) {
+    mpMem = (char *) JHugeMem::alloc(mlSze) ;
+#ifndef __MINGW32__
+    if (mpMem == null) {
+        throw bad_alloc() ;
+    }
+#endif
+}
+
+/*
+ * Destructor: releases all blocks at once.
+ */
+JArena::~JArena() {
+    JHugeMem::free(mpMem, mlSze) ;
+}
+
+/**
+ * Take a block from the arena.
+ *
+ * @param alSze     size in bytes
+ * @return pointer to the (zeroed) block, null when the arena is full
+ */
+void *JArena::alloc(size_t alSze){
+    size_t llSze = size(alSze) ;
+    void *lpBlk ;
+
+    if (mpMem == null || llSze > mlSze - mlUsd)
+        return null ;
+    lpBlk = mpMem + mlUsd ;
+    mlUsd += llSze ;
+    return lpBlk ;
+}
+}
@@ -0,0 +1,401 @@
+/*
+ * JBatch.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "JBatch.h"
+#include "JFile.h"
+
+#define BAT_LIN (16 * 1024)             // Maximum length of a manifest line
+
+namespace JojoDiff {
+
+/* Sort key of a pair: size, then manifest order (for qsort) */
+typedef struct tSrt {
+    off_t izSze ;
+    int   iiJob ;
+} rSrt ;
+
+static int ufSrtCmp (const void *apOne, const void *apTwo)
+{
+    const rSrt *lpOne = (const rSrt *) apOne ;
+    const rSrt *lpTwo = (const rSrt *) apTwo ;
+    if (lpOne->izSze != lpTwo->izSze)
+        return (lpOne->izSze > lpTwo->izSze) ? -1 : 1 ;     // largest first
+    return lpOne->iiJob - lpTwo->iiJob ;
+}
+
+/* Error of a pair, as text */
+static const char *ufErrTxt (int aiRet)
+{
+    switch (aiRet) {
+    case - EXI_FRT: return "error opening original" ;
+    case - EXI_SCD: return "error opening new" ;
+    case - EXI_OUT: return "error opening output" ;
+    case - EXI_SEK: return "seek error" ;
+    case - EXI_LRG: return "64-bit offsets not supported" ;
+    case - EXI_RED: return "error reading" ;
+    case - EXI_WRI: return "error writing" ;
+    case - EXI_MEM: return "error allocating memory" ;
+    case - EXI_CNL: return "cancelled" ;
+    default:        return "spurious error" ;
+    }
+}
+
+/**
+ * Create an empty batch.
+ */
+JBatch::JBatch()
+: mpJob(null), miJobCnt(0), miJobMax(0), mzMaxOrg(0), mzMaxNew(0),
+  mpWrk(null), miThrCnt(0), mpEng(null), mlTim(0)
+{
+}
+
+/*
+ * Destructor
+ */
+JBatch::~JBatch() {
+    for (int liJob = 0; liJob < miJobCnt; liJob++){
+        free(mpJob[liJob].isOrg) ;
+        free(mpJob[liJob].isNew) ;
+        free(mpJob[liJob].isOut) ;
+        if (mpJob[liJob].ipTmp != null) fclose(mpJob[liJob].ipTmp) ;
+    }
+    free(mpJob) ;
+    for (int liWrk = 0; liWrk < miThrCnt; liWrk++){
+        delete [] mpWrk[liWrk].ipQue ;
+        pthread_mutex_destroy(&mpWrk[liWrk].itMtx) ;
+    }
+    delete [] mpWrk ;
+}
+
+/**
+ * Read the pairs from a manifest.
+ */
+int JBatch::load (const char *asMan)
+{
+    char lcLin[BAT_LIN] ;
+    char *lsFld[3] ;
+    const char *lsSep ;
+    int liLin = 0 ;
+    int liErr = 0 ;
+    int liFld ;
+    FILE *lpMan ;
+
+    lpMan = (strcmp(asMan, "-") == 0) ? stdin : fopen(asMan, "r") ;
+    if (lpMan == null)
+        return - EXI_FRT ;
+
+    while (liErr == 0 && fgets(lcLin, sizeof(lcLin), lpMan) != null) {
+        liLin++ ;
+        if (strchr(lcLin, '\n') == null && ! feof(lpMan)) {
+            liErr = liLin ;     // line too long
+            break ;
+        }
+        if (lcLin[strspn(lcLin, " \t\r\n")] == '#')
+            continue ;
+
+        /* Split into fields: on tabs if there are any, so that names may contain blanks */
+        lsSep = (strchr(lcLin, '\t') != null) ? "\t\r\n" : " \t\r\n" ;
+        lsFld[0] = strtok(lcLin, lsSep) ;
+        if (lsFld[0] == null)
+            continue ;          // empty line
+        for (liFld = 1; liFld < 3; liFld++)
+            if ((lsFld[liFld] = strtok(null, lsSep)) == null)
+                break ;
+        if (liFld < 3 || strtok(null, lsSep) != null)
+            liErr = liLin ;     // not a triple
+        else
+            add(lsFld[0], lsFld[1], lsFld[2]) ;
+    }
+    if (lpMan != stdin)
+        fclose(lpMan) ;
+    return liErr ;
+} /* load */
+
+/**
+ * Add a pair
+ */
+int JBatch::add (const char *asOrg, const char *asNew, const char *asOut)
+{
+    struct stat ltStt ;
+
+    if (miJobCnt == miJobMax) {
+        miJobMax = (miJobMax == 0) ? 64 : miJobMax * 2 ;
+        mpJob = (rJob *) realloc(mpJob, miJobMax * sizeof(rJob)) ;
+#ifndef __MINGW32__
+        if (mpJob == null)
+            throw bad_alloc() ;
+#endif
+    }
+
+    rJob &lrJob = mpJob[miJobCnt++] ;
+    lrJob.isOrg = (asOrg == null) ? null : strdup(asOrg) ;
+    lrJob.isNew = strdup(asNew) ;
+    lrJob.isOut = (asOut == null) ? null : strdup(asOut) ;
+    lrJob.ipTmp = null ;
+    lrJob.izSzeOrg = (asOrg != null && stat(asOrg, &ltStt) == 0) ? ltStt.st_size : 0 ;
+    lrJob.izSzeNew = (stat(asNew, &ltStt) == 0) ? ltStt.st_size : 0 ;
+    lrJob.izSzeOut = 0 ;
+    lrJob.iiRet = - EXI_CNL ;   // not compared (yet)
+    lrJob.ibEql = false ;
+    lrJob.iiWrk = -1 ;
+    lrJob.ibStl = false ;
+    lrJob.ilTim = 0 ;
+    lrJob.iiHshHit = 0 ;
+    lrJob.iiHshErr = 0 ;
+    lrJob.iiHshRpr = 0 ;
+
+    if (lrJob.izSzeOrg > mzMaxOrg) mzMaxOrg = lrJob.izSzeOrg ;
+    if (lrJob.izSzeNew > mzMaxNew) mzMaxNew = lrJob.izSzeNew ;
+    return miJobCnt - 1 ;
+}
+
+/**
+ * Temporary output of a pair, rewound
+ */
+FILE * JBatch::getTmp (int aiJob)
+{
+    if (mpJob[aiJob].ipTmp != null)
+        rewind(mpJob[aiJob].ipTmp) ;
+    return mpJob[aiJob].ipTmp ;
+}
+
+/**
+ * Compare all pairs on aiThrCnt workers (including this thread).
+ */
+int JBatch::run (JEngine **apEng, int aiThrCnt)
+{
+    pthread_t *lpThr ;
+    rSrt *lpSrt ;
+    int liWrk ;
+    int liJob ;
+    int liRun ;
+    long long llTim ;
+
+    mpEng = apEng ;
+    miThrCnt = (aiThrCnt < 1) ? 1 : aiThrCnt ;
+
+    /* Deal out the pairs, largest first, round-robin over the workers' queues */
+    mpWrk = new rWrk[miThrCnt] ;
+    for (liWrk = 0; liWrk < miThrCnt; liWrk++){
+        mpWrk[liWrk].ipBat = this ;
+        mpWrk[liWrk].iiWrk = liWrk ;
+        mpWrk[liWrk].ipQue = new int[miJobCnt / miThrCnt + 1] ;
+        mpWrk[liWrk].iiBeg = 0 ;
+        mpWrk[liWrk].iiEnd = 0 ;
+        mpWrk[liWrk].izPnd = 0 ;
+        pthread_mutex_init(&mpWrk[liWrk].itMtx, NULL) ;
+    }
+    lpSrt = new rSrt[miJobCnt + 1] ;
+    for (liJob = 0; liJob < miJobCnt; liJob++){
+        lpSrt[liJob].izSze = mpJob[liJob].izSzeOrg + mpJob[liJob].izSzeNew ;
+        lpSrt[liJob].iiJob = liJob ;
+    }
+    qsort(lpSrt, miJobCnt, sizeof(rSrt), ufSrtCmp) ;
+    for (liJob = 0; liJob < miJobCnt; liJob++){
+        rWrk &lrWrk = mpWrk[liJob % miThrCnt] ;
+        lrWrk.ipQue[lrWrk.iiEnd++] = lpSrt[liJob].iiJob ;
+        lrWrk.izPnd += lpSrt[liJob].izSze ;
+    }
+    delete [] lpSrt ;
+
+    /* Go ... */
+    llTim = JFile::ustime() ;
+    lpThr = new pthread_t[miThrCnt] ;
+    for (liRun = 1; liRun < miThrCnt; liRun++){
+        if (pthread_create(&lpThr[liRun], NULL, ufThr, &mpWrk[liRun]) != 0)
+            break ;     // the running workers steal the remaining pairs
+    }
+    ufThr(&mpWrk[0]) ;
+    for (liWrk = 1; liWrk < liRun; liWrk++){
+        pthread_join(lpThr[liWrk], NULL) ;
+    }
+    delete [] lpThr ;
+    mlTim = JFile::ustime() - llTim ;
+    mpEng = null ;
+
+    for (liJob = 0; liJob < miJobCnt; liJob++){
+        if (mpJob[liJob].iiRet < 0)
+            return mpJob[liJob].iiRet ;
+    }
+    return 0 ;
+} /* run */
+
+/**
+ * Thread: take pairs and compare them, until no queue has any left.
+ */
+void *JBatch::ufThr (void *apWrk)
+{
+    rWrk *lpWrk = (rWrk *) apWrk ;
+    JBatch *lpBat = lpWrk->ipBat ;
+    bool lbStl ;
+    int liJob ;
+
+    while ((liJob = lpBat->ufTke(lpWrk->iiWrk, lbStl)) >= 0) {
+        lpBat->mpJob[liJob].ibStl = lbStl ;
+        lpBat->ufJob(lpWrk->iiWrk, liJob) ;
+    }
+    return NULL ;
+} /* ufThr */
+
+/**
+ * Take the next pair for a worker: the largest one of its own queue or, when
+ * that is empty, the smallest one of the queue with the most bytes left.
+ */
+int JBatch::ufTke (int aiWrk, bool &abStl)
+{
+    rWrk &lrOwn = mpWrk[aiWrk] ;
+    int liJob = -1 ;
+    int liVic ;
+    int liWrk ;
+    off_t lzPnd ;
+
+    pthread_mutex_lock(&lrOwn.itMtx) ;
+    if (lrOwn.iiBeg < lrOwn.iiEnd) {
+        liJob = lrOwn.ipQue[lrOwn.iiBeg++] ;
+        lrOwn.izPnd -= mpJob[liJob].izSzeOrg + mpJob[liJob].izSzeNew ;
+    }
+    pthread_mutex_unlock(&lrOwn.itMtx) ;
+    abStl = false ;
+    if (liJob >= 0)
+        return liJob ;
+
+    /* Steal: the victim may be emptied meanwhile, then look again */
+    for (;;) {
+        liVic = -1 ;
+        lzPnd = -1 ;
+        for (liWrk = 0; liWrk < miThrCnt; liWrk++){
+            if (liWrk == aiWrk) continue ;
+            pthread_mutex_lock(&mpWrk[liWrk].itMtx) ;
+            if (mpWrk[liWrk].iiBeg < mpWrk[liWrk].iiEnd && mpWrk[liWrk].izPnd > lzPnd) {
+                liVic = liWrk ;
+                lzPnd = mpWrk[liWrk].izPnd ;
+            }
+            pthread_mutex_unlock(&mpWrk[liWrk].itMtx) ;
+        }
+        if (liVic < 0)
+            return -1 ;     // nothing left anywhere
+
+        rWrk &lrVic = mpWrk[liVic] ;
+        pthread_mutex_lock(&lrVic.itMtx) ;
+        if (lrVic.iiBeg < lrVic.iiEnd) {
+            liJob = lrVic.ipQue[--lrVic.iiEnd] ;
+            lrVic.izPnd -= mpJob[liJob].izSzeOrg + mpJob[liJob].izSzeNew ;
+        }
+        pthread_mutex_unlock(&lrVic.itMtx) ;
+        if (liJob >= 0) {
+            abStl = true ;
+            return liJob ;
+        }
+    }
+} /* ufTke */
+
+/**
+ * Compare one pair on the worker's engine.
+ */
+void JBatch::ufJob (int aiWrk, int aiJob)
+{
+    rJob &lrJob = mpJob[aiJob] ;
+    struct stat ltStt ;
+    long long llTim = JFile::ustime() ;
+    FILE *lpOut ;
+
+    lrJob.iiWrk = aiWrk ;
+    lpOut = (lrJob.isOut == null) ? tmpfile() : fopen(lrJob.isOut, "wb") ;
+    if (lpOut == null) {
+        lrJob.iiRet = - EXI_OUT ;
+    } else {
+        lrJob.iiRet = mpEng[aiWrk]->diff(lrJob.isOrg, lrJob.isNew, lpOut) ;
+        if (lrJob.isOut == null) {
+            lrJob.ipTmp = lpOut ;
+            if (fflush(lpOut) != 0 && lrJob.iiRet == 0)
+                lrJob.iiRet = - EXI_WRI ;
+            lrJob.izSzeOut = jftell(lpOut) ;
+        } else {
+            if (fclose(lpOut) != 0 && lrJob.iiRet == 0)
+                lrJob.iiRet = - EXI_WRI ;
+            lrJob.izSzeOut = (stat(lrJob.isOut, &ltStt) == 0) ? ltStt.st_size : 0 ;
+        }
+        if (lrJob.iiRet == 0) {
+            JOutBin *lpJOut = mpEng[aiWrk]->getOut() ;
+            lrJob.ibEql = (lpJOut->gzOutBytDta == 0 && lpJOut->gzOutBytDel == 0) ;
+        }
+        if (mpEng[aiWrk]->getDiff() != null) {
+            JDiff *lpDiff = mpEng[aiWrk]->getDiff() ;
+            lrJob.iiHshHit = lpDiff->giHshHit + lpDiff->giLclHit ;
+            lrJob.iiHshErr = lpDiff->giHshErr ;
+            lrJob.iiHshRpr = lpDiff->getMch()->miHshRpr ;
+        }
+    }
+    lrJob.ilTim = JFile::ustime() - llTim ;
+} /* ufJob */
+
+/**
+ * Write the result of each pair, in manifest order, and the totals.
+ */
+void JBatch::report (FILE *apFil)
+{
+    int liJob ;
+    int liDif = 0, liEql = 0, liErr = 0, liStl = 0 ;
+    int liHshHit = 0, liHshErr = 0, liHshRpr = 0 ;
+    off_t lzInp = 0, lzOut = 0 ;
+    double ldSec ;
+
+    for (liJob = 0; liJob < miJobCnt; liJob++){
+        rJob &lrJob = mpJob[liJob] ;
+        fprintf(apFil, "%-6s %12" PRIzd " %12" PRIzd " %12" PRIzd " %9.1f ms  w%d%s  %s %s %s",
+                lrJob.iiRet == 0 ? (lrJob.ibEql ? "equal" : "ok") : "FAILED",
+                lrJob.izSzeOrg, lrJob.izSzeNew, lrJob.izSzeOut, lrJob.ilTim / 1000.0,
+                lrJob.iiWrk, lrJob.ibStl ? "s" : " ",
+                lrJob.isOrg == null ? "-" : lrJob.isOrg, lrJob.isNew, lrJob.isOut == null ? "-" : lrJob.isOut) ;
+        if (lrJob.iiRet < 0)
+            fprintf(apFil, ": %s", ufErrTxt(lrJob.iiRet)) ;
+        fprintf(apFil, "\n") ;
+
+        if (lrJob.iiRet < 0)
+            liErr++ ;
+        else if (lrJob.ibEql)
+            liEql++ ;
+        else
+            liDif++ ;
+        if (lrJob.ibStl)
+            liStl++ ;
+        lzInp += lrJob.izSzeOrg + lrJob.izSzeNew ;
+        lzOut += lrJob.izSzeOut ;
+        liHshHit += lrJob.iiHshHit ;
+        liHshErr += lrJob.iiHshErr ;
+        liHshRpr += lrJob.iiHshRpr ;
+    }
+
+    ldSec = (mlTim > 0) ? mlTim / 1000000.0 : 0.000001 ;
+    fprintf(apFil, "Batch pairs             = %d (%d different, %d equal, %d failed)\n",
+            miJobCnt, liDif, liEql, liErr) ;
+    fprintf(apFil, "Batch workers           = %d (%d pairs stolen)\n", miThrCnt, liStl) ;
+    fprintf(apFil, "Batch input bytes       = %" PRIzd "\n", lzInp) ;
+    fprintf(apFil, "Batch output bytes      = %" PRIzd "\n", lzOut) ;
+    fprintf(apFil, "Batch hashtable hits    = %d (%d errors, %d repairs)\n", liHshHit, liHshErr, liHshRpr) ;
+    fprintf(apFil, "Batch time              = %.3f s (%.1f MB/s, %.1f pairs/s)\n",
+            ldSec, lzInp / ldSec / (1024 * 1024), miJobCnt / ldSec) ;
+} /* report */
+}
@@ -62,10 +62,30 @@
  *
  * Method ufFndhdScn scans the left file and creates the hash table.
  *
+ * Method ufFndAhdLcl maintains a small local hashtable with dense samples from a
+ * window around the current read position on the left file. ufFndAhd looks up
+ * this table before the global one, so nearby matches are found sooner.
+ *
+ * Method ufBlkScn compares both files in aligned blocks at the same offsets (-ab),
+ * for disk images and paged databases where unchanged pages stay in place. Runs of
+ * equal blocks are then output without comparing, and ufFndAhd only looks ahead
+ * up to the next equal block.
+ *
  *******************************************************************************/
 #include "JDefs.h"
 #include "JDiff.h"
+#ifdef __MINGW32__
+#include "JFileAhead.h"
+#else
+#include "JFileIStream.h"
+#include "JFileIStreamAhead.h"
+#endif
+#include "JOutBin.h"
+#include "JOutAsc.h"
+#include "JOutRgn.h"
 #include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 #include <omp.h>
 
 #ifdef _FILE_OFFSET_BITS
@@ -86,26 +106,164 @@ JDiff::JDiff(
     const int aiHshSze, const int aiVerbse,
     const int abSrcBkt, const int aiSrcScn,
     const int aiMchMax, const int aiMchMin,
-    const int aiAhdMax, const bool abCmpAll
-) : mpFilOrg(apFilOrg), mpFilNew(apFilNew), mpOut(apOut),
+    const int aiAhdMax, const int aiCmpMod,
+    const int aiLclSze,
+    const int aiIdxRat, const char *asIdxDir,
+    const bool abFpr, const int aiMchSze,
+    const bool abOpt, const int aiBlkAln,
+    const int aiAhdMin, JArena *apAra
+) : mpFilOrg(apFilOrg), mpFilNew(apFilNew), mpOut(apOut), mpPrg(null),
     miVerbse(aiVerbse), mbSrcBkt(abSrcBkt),
     miMchMax(aiMchMax), miMchMin(aiMchMin),
     miAhdMax(aiAhdMax<1024?1024:aiAhdMax),
-    mbCmpAll(abCmpAll), miSrcScn(aiSrcScn),
-    mzAhdOrg(0), mzAhdNew(0), mlHshOrg(0), mlHshNew(0), giHshErr(0)
+    miAhdMin(aiAhdMin<1024?1024:aiAhdMin>miAhdMax?miAhdMax:aiAhdMin),
+    miCmpMod(aiCmpMod), mbFpr(abFpr && !(aiSrcScn > 0 && aiIdxRat > 0)),
+    miLclSze(aiLclSze), mbOpt(abOpt), mbShr(false), miBlkAln(aiBlkAln < SMPSZE ? 0 : aiBlkAln),
+    miHshSze(aiHshSze), miSrcCfg(aiSrcScn), miSrcScn(aiSrcScn),
+    mzBegOrg(0), mzBegNew(0), mzEndNew(MAX_OFF_T), mzEndOrg(0),
+    mzAhdOrg(0), mzAhdNew(0), mlHshOrg(0), mlHshNew(0),
+    mzExtOrg(0), mzExtNew(0), mzExtLen(0),
+    mzLclOrg(-1), mlHshLcl(0), miValLcl(EOF), miEqlLcl(0),
+    mpBlkEql(null), mzBlkCnt(0), mzBlkEql(0),
+    miAhdCur(miAhdMax), miAhdCnt(0),
+    miBatCnt(0), giHshHit(0), giLclHit(0), giIdxHit(0),
+    giHshErr(0), giSynHit(0), giAhdGrw(0), giAhdShr(0)
+{
+	memset(miAhdHst, 0, sizeof(miAhdHst)) ;
+	JHashPos::fingerprint_reset(mrFprOrg) ;
+	JHashPos::fingerprint_reset(mrFprNew) ;
+
+	/* The external index replaces the global hashtable, which is then only used for hashing */
+	if (aiSrcScn > 0 && aiIdxRat > 0) {
+	    gpIdx = new JHashIdx(aiIdxRat, asIdxDir) ;
+	    gpHsh = new JHashPos(0) ;
+	    gpHsh->set_reliability(aiIdxRat * 4 > 48 ? aiIdxRat * 4 : 48) ;
+	} else {
+	    gpIdx = null ;
+	    gpHsh = new JHashPos(aiHshSze, false, mbFpr, apAra) ;
+	}
+
+	/* The local hashtable is only useful on top of a prescanned hashtable */
+	if (aiSrcScn > 0 && aiLclSze > 0) {
+	    gpHshLcl = new JHashPos(aiLclSze, true, false, apAra) ;
+	    miLclWin = gpHshLcl->get_hashprime() ;
+	} else {
+	    gpHshLcl = null ;
+	    miLclWin = 0 ;
+	}
+	gpMch = new JMatchTable(gpHsh, mpFilOrg, mpFilNew, aiCmpMod, aiMchSze, abOpt, apAra);
+}
+
+/*
+ * Constructor for a part of the files: settings, hashtable and index from the master
+ */
+JDiff::JDiff(
+    JDiff const &aoMst,
+    JFile * const apFilOrg, JFile * const apFilNew,
+    JOut  * const apOut
+) : mpFilOrg(apFilOrg), mpFilNew(apFilNew), mpOut(apOut),
+    gpHsh(aoMst.gpHsh), gpIdx(aoMst.gpIdx), mpPrg(aoMst.mpPrg),
+    miVerbse(aoMst.miVerbse), mbSrcBkt(aoMst.mbSrcBkt),
+    miMchMax(aoMst.miMchMax), miMchMin(aoMst.miMchMin),
+    miAhdMax(aoMst.miAhdMax), miAhdMin(aoMst.miAhdMin),
+    miCmpMod(aoMst.miCmpMod), mbFpr(aoMst.mbFpr),
+    miLclSze(aoMst.miLclSze), mbOpt(aoMst.mbOpt), mbShr(true), miBlkAln(aoMst.miBlkAln),
+    miHshSze(aoMst.miHshSze), miSrcCfg(aoMst.miSrcCfg), miSrcScn(aoMst.miSrcScn),
+    mzBegOrg(0), mzBegNew(0), mzEndNew(MAX_OFF_T), mzEndOrg(0),
+    mzAhdOrg(0), mzAhdNew(0), mlHshOrg(0), mlHshNew(0),
+    mzExtOrg(0), mzExtNew(0), mzExtLen(0),
+    mzLclOrg(-1), mlHshLcl(0), miValLcl(EOF), miEqlLcl(0),
+    mpBlkEql(aoMst.mpBlkEql), mzBlkCnt(aoMst.mzBlkCnt), mzBlkEql(aoMst.mzBlkEql),
+    miAhdCur(aoMst.miAhdMax), miAhdCnt(0),
+    miBatCnt(0), giHshHit(0), giLclHit(0), giIdxHit(0),
+    giHshErr(0), giSynHit(0), giAhdGrw(0), giAhdShr(0)
 {
-	gpHsh = new JHashPos(aiHshSze) ;
-	gpMch = new JMatchTable(gpHsh, mpFilOrg, mpFilNew, abCmpAll);
+	memset(miAhdHst, 0, sizeof(miAhdHst)) ;
+	JHashPos::fingerprint_reset(mrFprOrg) ;
+	JHashPos::fingerprint_reset(mrFprNew) ;
+
+	/* The local hashtable follows the read position, so it cannot be shared */
+	if (aoMst.gpHshLcl != null) {
+	    gpHshLcl = new JHashPos(miLclSze, true) ;
+	    miLclWin = gpHshLcl->get_hashprime() ;
+	} else {
+	    gpHshLcl = null ;
+	    miLclWin = 0 ;
+	}
+	gpMch = new JMatchTable(gpHsh, mpFilOrg, mpFilNew, miCmpMod, aoMst.gpMch->get_size(), mbOpt);
 }
 
 /*
  * Destructor
  */
 JDiff::~JDiff() {
-	delete gpHsh ;
+	if (! mbShr) {
+	    delete gpHsh ;
+	    delete gpIdx ;
+	    free(mpBlkEql) ;
+	}
+	delete gpHshLcl ;
 	delete gpMch ;
 }
 
+/*
+ * Prepare for another pair of files, keeping the tables
+ */
+int JDiff::reset(off_t azSzeOrg)
+{
+    if (! mbShr && gpIdx != null)
+        return - EXI_ERR ;
+
+    /* Own tables: emptied, sized for the new original file. Shared ones are kept. */
+    if (! mbShr) {
+        gpHsh->reset(JHashPos::get_size(miHshSze, azSzeOrg)) ;
+        free(mpBlkEql) ;
+        mpBlkEql = null ;
+        mzBlkCnt = 0 ;
+        mzBlkEql = 0 ;
+        miSrcScn = miSrcCfg ;
+    }
+    if (gpHshLcl != null) {
+        gpHshLcl->reset(miLclSze) ;
+        miLclWin = gpHshLcl->get_hashprime() ;
+    }
+    gpMch->reset() ;
+
+    /* Range and state */
+    mzBegOrg = 0 ; mzBegNew = 0 ; mzEndNew = MAX_OFF_T ; mzEndOrg = 0 ;
+    mzAhdOrg = 0 ; mzAhdNew = 0 ; mlHshOrg = 0 ; mlHshNew = 0 ;
+    miEqlOrg = 0 ; miEqlNew = 0 ;
+    mzExtOrg = 0 ; mzExtNew = 0 ; mzExtLen = 0 ;
+    JHashPos::fingerprint_reset(mrFprOrg) ;
+    JHashPos::fingerprint_reset(mrFprNew) ;
+    mzLclOrg = -1 ; mlHshLcl = 0 ; miValLcl = EOF ; miEqlLcl = 0 ;
+    miAhdCur = miAhdMax ; miAhdCnt = 0 ;
+    memset(miAhdHst, 0, sizeof(miAhdHst)) ;
+    miBatCnt = 0 ;
+
+    /* Statistics */
+    giHshHit = 0 ; giLclHit = 0 ; giIdxHit = 0 ;
+    giHshErr = 0 ; giSynHit = 0 ; giAhdGrw = 0 ; giAhdShr = 0 ;
+    return 0 ;
+} /* reset */
+
+/*
+ * Prescan the original file (if not yet done)
+ */
+int JDiff::prescan()
+{
+    if (miBlkAln > 0 && mpBlkEql == null) {
+        int liRet = ufBlkScn() ;
+        if (liRet < 0) return liRet ;
+    }
+    if (miSrcScn == 1) {
+        int liRet = ufFndAhdScn() ;
+        if (liRet < 0) return liRet ;
+        miSrcScn = 2 ;
+    }
+    return 0 ;
+} /* prescan */
+
 /*******************************************************************************
 * Difference function
 *
@@ -119,12 +277,19 @@ JDiff::~JDiff() {
 *   - then continue reading on both files until equal blocks are reached,
 *
 *******************************************************************************/
-int JDiff::jdiff()
+template <class TFile, class TOut>
+int JDiff::ufJDiff()
 {
+    TFile * const lpFilOrg = static_cast<TFile *>(mpFilOrg) ;
+    TFile * const lpFilNew = static_cast<TFile *>(mpFilNew) ;
+    TOut  * const lpOut    = static_cast<TOut *>(mpOut) ;
+
+
     int lcOrg;              /* byte from original file */
     int lcNew;              /* byte from new file */
-    off_t lzPosOrg = 0 ;
-    off_t lzPosNew = 0 ;
+    off_t lzPosOrg = mzBegOrg ;
+    off_t lzPosNew = mzBegNew ;
+    off_t const lzEndNew = mzEndNew ;
 
     bool  lbEql = false;    /* accumulate equal bytes? */
     off_t lzEql = 0;        /* accumulated equal bytes */
@@ -133,15 +298,37 @@ int JDiff::jdiff()
     off_t lzAhd=0;
     off_t lzSkpOrg=0;
     off_t lzSkpNew=0;
+    off_t lzExt;            /* bytes to skip within an equal region */
+    off_t lzExtOrg;         /* start of a bulk compare */
+    off_t lzExtNew;
+
+    int   liRet = 0 ;       /* return code */
+    int   liFnd ;           /* result of ufFndAhd */
+    off_t lzPrgNxt = (mpPrg == null) ? MAX_OFF_T : lzPosNew + PRG_STP ;  /* next progress report */
 
 #if debug
     int liErr=0 ;		/* check for malfunction: 0=not checking, 1=checking, 2=error */
 #endif
 
+    /* Compare aligned blocks first */
+    if (miBlkAln > 0 && mpBlkEql == null) {
+        liRet = ufBlkScn() ;
+        if (liRet < 0) return liRet ;
+    }
+
     /* Take one byte from each file ... */
-    lcOrg = mpFilOrg->get(lzPosOrg, 0);
-    lcNew = mpFilNew->get(lzPosNew, 0);
-    while (lcNew >= 0) {
+    lcOrg = lpFilOrg->get(lzPosOrg, 0);
+    lcNew = lpFilNew->get(lzPosNew, 0);
+    while (lcNew >= 0 && lzPosNew < lzEndNew) {
+        /* Report progress and check for cancellation */
+        if (lzPosNew >= lzPrgNxt) {
+            lzPrgNxt = lzPosNew + PRG_STP ;
+            if (mbShr ? mpPrg->cancelled() : ! mpPrg->update(PRG_DIF, lzPosOrg, lzPosNew)) {
+                liRet = - EXI_CNL ;
+                break ;
+            }
+        }
+
         #if debug
         if (JDebug::gbDbg[DBGPRG])
             fprintf(JDebug::stddbg, "Input "P8zd"->%2x "P8zd"->%2x.\n",
@@ -153,12 +340,49 @@ int JDiff::jdiff()
             if (lbEql){
                 lzEql ++ ;
             } else {
-                lbEql = mpOut->put(EQL, 1, lcOrg, lcNew, lzPosOrg, lzPosNew);
+                lbEql = lpOut->put(EQL, 1, lcOrg, lcNew, lzPosOrg, lzPosNew);
+            }
+
+            /* Count the rest of a known equal region at once */
+            if (lbEql && mzExtLen > 0 && lzPosNew >= mzExtNew && lzPosNew < mzExtNew + mzExtLen
+                    && lzPosOrg - lzPosNew == mzExtOrg - mzExtNew) {
+                lzExt = mzExtNew + mzExtLen - lzPosNew - 1 ;
+                if (lzExt > lzEndNew - lzPosNew - 1)
+                    lzExt = lzEndNew - lzPosNew - 1 ;
+                lzEql += lzExt ;
+                lzPosOrg += lzExt ;
+                lzPosNew += lzExt ;
+                lzAhd -= lzExt ;
+                mzExtLen = 0 ;
+            }
+
+            /* Skip a run of equal aligned blocks without comparing */
+            if (lbEql && mpBlkEql != null && lzPosOrg == lzPosNew) {
+                lzExt = ufBlkRun(lzPosNew + 1) ;
+                if (lzExt > lzEndNew - lzPosNew - 1)
+                    lzExt = lzEndNew - lzPosNew - 1 ;
+                lzEql += lzExt ;
+                lzPosOrg += lzExt ;
+                lzPosNew += lzExt ;
+                lzAhd -= lzExt ;
+            }
+
+            /* Count following equal bytes in bulk, as long as both files are buffered */
+            if (lbEql) {
+                lzExtOrg = lzPosOrg + 1 ;
+                lzExtNew = lzPosNew + 1 ;
+                lzExt = gpMch->extend(lzExtOrg, lzExtNew, lzExtOrg, lzExtNew) ;
+                if (lzExt > lzEndNew - lzExtNew)
+                    lzExt = lzEndNew - lzExtNew ;
+                lzEql += lzExt ;
+                lzPosOrg += lzExt ;
+                lzPosNew += lzExt ;
+                lzAhd -= lzExt ;
             }
 
             /* Take next byte from each file ... */
-            lcOrg = mpFilOrg->get(++ lzPosOrg, 0) ;
-            lcNew = mpFilNew->get(++ lzPosNew, 0) ;
+            lcOrg = lpFilOrg->get(++ lzPosOrg, 0) ;
+            lcNew = lpFilNew->get(++ lzPosNew, 0) ;
 
             /* decrease ahead counter */
             lzAhd -- ;
@@ -168,16 +392,16 @@ int JDiff::jdiff()
 
             /* Output difference */
             if (lcOrg < 0) {
-                mpOut->put(INS, 1, lcOrg, lcNew, lzPosOrg, lzPosNew);
+                lpOut->put(INS, 1, lcOrg, lcNew, lzPosOrg, lzPosNew);
 
                 /* Take next byte from each file ... */
-                lcNew = mpFilNew->get(++ lzPosNew, 0) ;
+                lcNew = lpFilNew->get(++ lzPosNew, 0) ;
             } else {
-                mpOut->put(MOD, 1, lcOrg, lcNew, lzPosOrg, lzPosNew);
+                lpOut->put(MOD, 1, lcOrg, lcNew, lzPosOrg, lzPosNew);
 
                 /* Take next byte from each file ... */
-                lcOrg = mpFilOrg->get(++ lzPosOrg, 0) ;
-                lcNew = mpFilNew->get(++ lzPosNew, 0) ;
+                lcOrg = lpFilOrg->get(++ lzPosOrg, 0) ;
+                lcNew = lpFilNew->get(++ lzPosNew, 0) ;
             }
 
             /* decrease ahead counter */
@@ -194,14 +418,14 @@ int JDiff::jdiff()
         	/* Flush output buffer in debug */
         	if (JDebug::gbDbg[DBGAHD] || JDebug::gbDbg[DBGMCH]){
         		ufPutEql(lzPosOrg, lzPosNew, lzEql, lbEql);
-        		mpOut->put(ESC, 0, 0, 0, lzPosOrg, lzPosNew);
+        		lpOut->put(ESC, 0, 0, 0, lzPosOrg, lzPosNew);
         	}
 
             /* If lbChk is unset, then an expected equal block has not been reached.
              * In fast mode, when doing non-compared jumps, this may happen.
-             * In normal mode (mbCmpAll), this should never happen.
+             * In normal mode (CMP_ALL), this should never happen.
              */
-        	if (liErr==2 && (miVerbse>2 || mbCmpAll)){
+        	if (liErr==2 && (miVerbse>2 || miCmpMod == CMP_ALL)){
 				fprintf(JDebug::stddbg, "Hash miss!\n");
 				giHshErr++ ;
         	}
@@ -209,9 +433,12 @@ int JDiff::jdiff()
             #endif
 
             /* Find a new equals-reqion */
-            lbFnd = ufFndAhd(lzPosOrg, lzPosNew, lzSkpOrg, lzSkpNew, lzAhd) ;
-            if (lbFnd < 0)
-                return lbFnd ;
+            liFnd = ufFndAhd(lzPosOrg, lzPosNew, lzSkpOrg, lzSkpNew, lzAhd) ;
+            if (liFnd < 0) {
+                liRet = liFnd ;
+                break ;
+            }
+            lbFnd = (liFnd > 0) ;
 
             #if debug
             if (JDebug::gbDbg[DBGAHD])
@@ -226,19 +453,19 @@ int JDiff::jdiff()
 
             /* Execute offsets */
 			if (lzSkpOrg > 0) {
-				mpOut->put(DEL, lzSkpOrg, 0, 0, lzPosOrg, lzPosNew) ;
+				lpOut->put(DEL, lzSkpOrg, 0, 0, lzPosOrg, lzPosNew) ;
 				lzPosOrg += lzSkpOrg ;
-				lcOrg = mpFilOrg->get(lzPosOrg, 0);
+				lcOrg = lpFilOrg->get(lzPosOrg, 0);
 			} else if (lzSkpOrg < 0) {
-				mpOut->put(BKT, - lzSkpOrg, 0, 0, lzPosOrg, lzPosNew) ;
+				lpOut->put(BKT, - lzSkpOrg, 0, 0, lzPosOrg, lzPosNew) ;
 				lzPosOrg += lzSkpOrg ;
-				lcOrg = mpFilOrg->get(lzPosOrg, 0);
+				lcOrg = lpFilOrg->get(lzPosOrg, 0);
 			}
 			if (lzSkpNew > 0) {
-				while (lzSkpNew > 0 && lcNew > EOF) {
-					mpOut->put(INS, 1, 0, lcNew, lzPosOrg, lzPosNew);
+				while (lzSkpNew > 0 && lcNew > EOF && lzPosNew < lzEndNew) {
+					lpOut->put(INS, 1, 0, lcNew, lzPosOrg, lzPosNew);
 					lzSkpNew-- ;
-					lcNew = mpFilNew->get(++ lzPosNew, 0);
+					lcNew = lpFilNew->get(++ lzPosNew, 0);
 				}
 			}
         } /* if lcOrg == lcNew */
@@ -246,13 +473,21 @@ int JDiff::jdiff()
 
     /* Flush output buffer */
     ufPutEql(lzPosOrg, lzPosNew, lzEql, lbEql);
-    mpOut->put(ESC, 0, 0, 0, lzPosOrg, lzPosNew);
+    lpOut->put(ESC, 0, 0, 0, lzPosOrg, lzPosNew);
+    mzEndOrg = lzPosOrg ;
 
     /* Return code */
+    if (liRet < 0)
+        return liRet ;
     if (lcNew < EOB || lcOrg < EOB){
         return (lcNew < lcOrg)?lcNew:lcOrg;
     }
     return 0;
+} /* ufJDiff */
+
+int JDiff::jdiff()
+{
+    return ufJDiff<JFile, JOut>() ;
 } /* jdiff */
 
 /**
@@ -291,7 +526,8 @@ int JDiff::ufFndAhd (
 )
 { off_t lzFndOrg=0;   /* Found position within original file                 */
   off_t lzFndNew=0;   /* Found position within new file                      */
-  off_t lzBseOrg;     /* Base position on original file: gbSrcBkt?0:alRedOrg */
+  off_t lzBseOrg = (mbSrcBkt?0:azRedOrg) ; /* Base position on original file */
+  fkey  lkFndFpr=0;   /* Found fingerprint within original file              */
 
   int liIdx;          /* Index for initializing                         */
   int liFnd=0;        /* Number of matches found                        */
@@ -302,22 +538,44 @@ int JDiff::ufFndAhd (
 
   /* Prescan the original file? */
   if (miSrcScn == 1) {
-    int liRet = ufFndAhdScn() ;
+    int liRet = prescan() ;
+    if (liRet < 0) return liRet ;
+  }
+
+  /* Slide the local hashtable along with the read position on the original file */
+  if (gpHshLcl != null) {
+    int liRet = ufFndAhdLcl(azRedOrg) ;
     if (liRet < 0) return liRet ;
-    miSrcScn = 2 ;
   }
 
+  /* Small modifications: resynchronize without looking ahead */
+  mzExtLen = ufFndSyn(azRedOrg, azRedNew, lzBseOrg, lzFndOrg, lzFndNew) ;
+  if (mzExtLen > 0) {
+    mzExtOrg = lzFndOrg ;
+    mzExtNew = lzFndNew ;
+    ufFndAhdSkp(azRedOrg, azRedNew, lzFndOrg, lzFndNew, azSkpOrg, azSkpNew, azAhd) ;
+    giSynHit++ ;
+    return 1 ;
+  }
+
+  /* Aligned blocks: look ahead no further than the next equal block at the same offset */
+  off_t lzBlkNxt = -1 ;
+  if (mpBlkEql != null && azRedOrg == azRedNew)
+    lzBlkNxt = ufBlkNxt(azRedNew, azRedNew + miAhdMax) ;
+
   /*
    * How many bytes to look ahead ?
    */
   int liMax; /* Max number of bytes to read */
   if (miSrcScn == 2){
       if (mzAhdNew == 0 || mzAhdNew < azRedNew) {
-          liMax = miAhdMax  ;
+          liMax = miAhdCur  ;
       } else if (mzAhdNew > azRedNew + miAhdMax) {
-          liMax = miAhdMax  ;
+          liMax = miAhdCur  ;
+      } else if (mzAhdNew > azRedNew + miAhdCur) {
+          liMax = 0 ;   // already looked ahead beyond the current range
       } else {
-          liMax = miAhdMax - (mzAhdNew - azRedNew)  ;
+          liMax = miAhdCur - (mzAhdNew - azRedNew)  ;
       }
   } else {
       liMax = INT_MAX / 2 ;
@@ -327,10 +585,10 @@ int JDiff::ufFndAhd (
    * How many bytes to look back on reset ?
    */
   int liBck; /* Number of bytes to look back */
-  if (gpHsh->get_reliability() < miAhdMax)
+  if (gpHsh->get_reliability() < miAhdCur)
       liBck = gpHsh->get_reliability() / 2 ;
   else
-      liBck = miAhdMax / 2 ;
+      liBck = miAhdCur / 2 ;
 
   /*
    * Re-Initialize hash function (read 31 bytes) if
@@ -342,11 +600,13 @@ int JDiff::ufFndAhd (
     if (mzAhdOrg < 0) mzAhdOrg = 0 ;
     miEqlOrg = 0 ;
     mlHshOrg = 0 ;
+    if (mbFpr) JHashPos::fingerprint_reset(mrFprOrg) ;
 
     miEqlOrg = 0 ;
     miValOrg = mpFilOrg->get(mzAhdOrg, liSft) ;
     for (liIdx=0;(liIdx < SMPSZE - 1) && (miValOrg > EOF); liIdx++){
       gpHsh->hash(miValOrg, mlHshOrg) ;
+      if (mbFpr) gpHsh->fingerprint(miValOrg, mrFprOrg) ;
       ufFndAhdGet(mpFilOrg, ++ mzAhdOrg, miValOrg, miEqlOrg, liSft) ;
     }
   }
@@ -355,6 +615,7 @@ int JDiff::ufFndAhd (
     if (mzAhdNew < 0) mzAhdNew = 0 ;
     miEqlNew = 0 ;
     mlHshNew = 0 ;
+    if (mbFpr) JHashPos::fingerprint_reset(mrFprNew) ;
     liMax += liBck ;
 
     miEqlNew = 0 ;
@@ -362,10 +623,13 @@ int JDiff::ufFndAhd (
     liMax -- ;
     for (liIdx=0;(liIdx < SMPSZE - 1) && (miValNew > EOF); liIdx++){
       gpHsh->hash(miValNew, mlHshNew) ;
+      if (mbFpr) gpHsh->fingerprint(miValNew, mrFprNew) ;
       ufFndAhdGet(mpFilNew, ++ mzAhdNew, miValNew, miEqlNew, liSft) ;
       liMax -- ;
     }
   }
+  if (lzBlkNxt >= 0 && liMax > lzBlkNxt - mzAhdNew)
+    liMax = (lzBlkNxt > mzAhdNew) ? lzBlkNxt - mzAhdNew : 0 ;
 
   /*
    * Build the table of matches
@@ -383,7 +647,8 @@ int JDiff::ufFndAhd (
           if (miValOrg > EOF){
               /* hash the new value and add to hashtable */
               gpHsh->hash(miValOrg, mlHshOrg) ;
-              gpHsh->add(mlHshOrg, mzAhdOrg, miEqlOrg) ;
+              if (mbFpr) gpHsh->fingerprint(miValOrg, mrFprOrg) ;
+              gpHsh->add(mlHshOrg, mzAhdOrg, miEqlOrg, mrFprOrg.ikFpr) ;
 
               #if debug
               if (JDebug::gbDbg[DBGAHH])
@@ -397,36 +662,34 @@ int JDiff::ufFndAhd (
 
           /* check new file against original file */
           if (miValNew > EOF){
-              /* hash the new value and lookup in hashtable */
+              /* hash the new value and lookup in the local hashtable, then in the global one */
               gpHsh->hash(miValNew, mlHshNew) ;
-              if (gpHsh->get(mlHshNew, lzFndOrg)) {
-                  /* add found position into table of matches */
-                  if (lzFndOrg > lzBseOrg) {
-                      /* add solution to the table of matches */
-                      switch (gpMch->add(lzFndOrg, mzAhdNew, azRedNew, miEqlNew))
-                      { case 0: /* table is full */
-                          if (liBck > 0 && gpMch->cleanup(azRedNew)){
-                              // made more room
-                          } else {
-                              liMax = 0 ; // stop lookahead
-                              continue;
-                          }
-                      case 1: /* alternative added */
-                          if (mzAhdNew > azRedNew) {
-                              liFnd ++ ;
-
-                              if (liFnd == miMchMax) {
-                                  liMax = 0 ; // stop lookahead
-                                  continue;
-                              } else if ((liFnd == miMchMin) && (liMax > gpHsh->get_reliability())) {
-                                  liMax = gpHsh->get_reliability() ; // reduce lookahead
-                              }
-                          }
-                          break ;
-                      case 2:  ; /* alternative collided */
-                      case -1: ;/* compare failed      */
+              if (mbFpr) gpHsh->fingerprint(miValNew, mrFprNew) ;
+              if (gpHshLcl != null && gpHshLcl->get(mlHshNew, lzFndOrg)) {
+                  giLclHit ++ ;
+                  if (! ufFndAhdAdd(lzFndOrg, mzAhdNew, azRedNew, miEqlNew, lzBseOrg, liBck, liFnd, liMax)) {
+                      liMax = 0 ; // stop lookahead
+                      continue;
+                  }
+              } else if (gpIdx != null) {
+                  /* queue sampled keys for a batched lookup in the external index */
+                  if (gpIdx->sample(mlHshNew)) {
+                      mkBatHsh[miBatCnt] = mlHshNew ;
+                      mzBatNew[miBatCnt] = mzAhdNew ;
+                      miBatEql[miBatCnt] = miEqlNew ;
+                      miBatCnt ++ ;
+                      if (miBatCnt == IDX_BAT && ! ufFndAhdBat(azRedNew, lzBseOrg, liBck, liFnd, liMax)) {
+                          liMax = 0 ; // stop lookahead
+                          continue;
                       }
                   }
+              } else if (gpHsh->get(mlHshNew, lzFndOrg, &lkFndFpr)) {
+                  giHshHit ++ ;
+                  if (! ufFndAhdAdd(lzFndOrg, mzAhdNew, azRedNew, miEqlNew, lzBseOrg, liBck, liFnd, liMax,
+                                    mbFpr && lkFndFpr == mrFprNew.ikFpr)) {
+                      liMax = 0 ; // stop lookahead
+                      continue;
+                  }
               }
 
               /* get next value from file */
@@ -434,6 +697,10 @@ int JDiff::ufFndAhd (
               liMax -- ;
           } /* if siValNew > EOF */
       } /* while */
+
+      /* lookup remaining queued keys */
+      if (miBatCnt > 0)
+          ufFndAhdBat(azRedNew, lzBseOrg, liBck, liFnd, liMax) ;
   } /* if ufMchFre(..) */
 
   /*
@@ -446,13 +713,92 @@ int JDiff::ufFndAhd (
   /*
    * Get the best match and calculate the offsets
    */
-  if (! gpMch->get(azRedOrg, azRedNew, /* out */ lzFndOrg, lzFndNew))
-  { azSkpOrg = 0 ;
+  bool lbFnd = gpMch->get(azRedOrg, azRedNew, /* out */ lzFndOrg, lzFndNew) ;
+  if (lzBlkNxt >= 0 && (! lbFnd || lzFndNew > lzBlkNxt))
+  { /* the next equal block comes first */
+    mzExtLen = 0 ;
+    ufFndAhdSkp(azRedOrg, azRedNew, lzBlkNxt, lzBlkNxt, azSkpOrg, azSkpNew, azAhd) ;
+    return 1 ;
+  } else if (! lbFnd)
+  { /* Nothing within range: grow the range, the next lookahead continues from mzAhdNew */
+    if (miSrcScn == 2 && liMax <= 0 && miAhdCur < miAhdMax) {
+      miAhdCur = (miAhdCur > miAhdMax / 2) ? miAhdMax : miAhdCur * 2 ;
+      giAhdGrw ++ ;
+    }
+    mzExtLen = 0 ;
+    azSkpOrg = 0 ;
     azSkpNew = 0 ;
     azAhd    = (mzAhdNew - azRedNew) - gpHsh->get_reliability() ;
     if (azAhd < SMPSZE) azAhd = SMPSZE ;
     return 0 ;
   }  else  {
+    /* Exact start and length of the equal region */
+    mzExtLen = gpMch->extend(lzFndOrg, lzFndNew, lzBseOrg, azRedNew) ;
+    mzExtOrg = lzFndOrg ;
+    mzExtNew = lzFndNew ;
+    ufFndAhdSkp(azRedOrg, azRedNew, lzFndOrg, lzFndNew, azSkpOrg, azSkpNew, azAhd) ;
+    if (miSrcScn == 2 && miAhdMin < miAhdMax)
+      ufAhdAdd(lzFndNew - azRedNew) ;
+    return 1 ;
+  }
+}
+
+/**
+ * Adaptive lookahead range: keep a histogram of the distances (on the new file)
+ * at which ufFndAhd found its solutions, in classes of powers of two. Every
+ * AHD_UPD solutions, the range is set to AHD_MRG times the distance below which
+ * AHD_PCT percent of them were found, within miAhdMin..miAhdMax. The histogram is
+ * halved every AHD_AGE solutions, so that it follows the changing nature of the
+ * differences along the files.
+ *
+ * A lookahead that finds nothing doubles the range (see ufFndAhd). As the ahead
+ * position is kept from one lookahead to the next, long insertions are still
+ * found, only after a few more steps.
+ */
+void JDiff::ufAhdAdd (off_t const &azDst)
+{
+    int liCls ;     // distance class
+    int liSum ;     // number of distances up to the class
+    int liTot ;     // total number of distances
+    off_t lzAhd ;   // new range
+
+    for (liCls = 0; liCls < AHD_HST - 1 && ((off_t) 1 << liCls) <= azDst; liCls++) ;
+    miAhdHst[liCls] ++ ;
+    miAhdCnt ++ ;
+
+    if (miAhdCnt % AHD_UPD == 0) {
+        for (liTot = 0, liCls = 0; liCls < AHD_HST; liCls++)
+            liTot += miAhdHst[liCls] ;
+        for (liSum = 0, liCls = 0; liCls < AHD_HST - 1; liCls++) {
+            liSum += miAhdHst[liCls] ;
+            if (liSum * 100 >= liTot * AHD_PCT)
+                break ;
+        }
+        lzAhd = ((off_t) 1 << liCls) * AHD_MRG ;
+        if (lzAhd < miAhdMin) lzAhd = miAhdMin ;
+        if (lzAhd > miAhdMax) lzAhd = miAhdMax ;
+        if (lzAhd < miAhdCur) giAhdShr ++ ;
+        else if (lzAhd > miAhdCur) giAhdGrw ++ ;
+        miAhdCur = (int) lzAhd ;
+    }
+    if (miAhdCnt % AHD_AGE == 0) {
+        for (liCls = 0; liCls < AHD_HST; liCls++)
+            miAhdHst[liCls] /= 2 ;
+    }
+} /* ufAhdAdd */
+
+/**
+ * Calculate the offsets to reach a found position:
+ *   - azSkpOrg: bytes to delete (>0) or to backtrack (<0) on the original file,
+ *   - azSkpNew: bytes to insert from the new file,
+ *   - azAhd:    bytes to go ahead on both files.
+ */
+void JDiff::ufFndAhdSkp (
+  off_t const &azRedOrg, off_t const &azRedNew,
+  off_t const &lzFndOrg, off_t const &lzFndNew,
+  off_t &azSkpOrg, off_t &azSkpNew, off_t &azAhd
+)
+{
     if (lzFndOrg >= azRedOrg)
     { if (lzFndOrg - azRedOrg >= lzFndNew - azRedNew)
       { /* go forward on original file */
@@ -482,10 +828,164 @@ int JDiff::ufFndAhd (
       /* reset ahead position when backtracking */
       mzAhdOrg = 0 ; // TODO reset matching table too?
     }
+} /* ufFndAhdSkp */
 
-    return 1 ;
+/**
+ * Resynchronization probe: most differences are small modifications (timestamps,
+ * counters, ...) after which both files continue at the same delta, or at a small
+ * insert/delete shift. Before looking ahead (which rehashes and scans up to
+ * miAhdMax bytes), test these positions directly:
+ *   new position azRedNew + d (d = 1 to SYN_DST), original position shifted by
+ *   k = 0, +-1, ..., +-SYN_SFT, requiring SYN_EXT equal bytes.
+ * The nearest position with the smallest shift is returned. The bytes around both read positions are read once, in sequence, and all
+ * positions are compared in memory. Without out-of-buffer compares (CMP_NVR) the
+ * reads are soft: data that is not buffered (EOB) gives no resync.
+ *
+ * Equal bytes alone do not make a good resync: within a run of zeros or padding,
+ * any shift compares equal. Like the hashtable, the probe therefore skips
+ * low-quality samples (more than SMPSZE - 4 repeated bytes within SMPSZE bytes).
+ * Shorter equal regions are left to the full lookahead, which may find better.
+ *
+ * @param azRedOrg  read position in original file
+ * @param azRedNew  read position in new file
+ * @param azBseOrg  do not extend before this position on the original file
+ * @param azFndOrg  out: start of the equal region in original file
+ * @param azFndNew  out: start of the equal region in new file
+ * @return length of the equal region (see JMatchTable::extend), 0 if none found
+ */
+off_t JDiff::ufFndSyn (
+  off_t const &azRedOrg, off_t const &azRedNew, off_t const &azBseOrg,
+  off_t &azFndOrg, off_t &azFndNew
+)
+{ uchar lcNew[SYN_DST + SYN_EXT] ;                // new file from azRedNew + 1
+  uchar lcOrg[SYN_DST + 2 * SYN_SFT + SYN_EXT] ;  // original file from lzBegOrg
+  off_t lzBegOrg = azRedOrg + 1 - SYN_SFT ;        // first position read on original file
+  int liLenNew ;        // bytes read in lcNew
+  int liLenOrg ;        // bytes read in lcOrg
+  int liDst ;           // distance ahead on new file
+  int liSft ;           // shift on original file
+  int liOff ;           // offset of the shifted position in lcOrg
+  int liIdx ;           // byte index
+  int liEql ;           // quality of the sample on the new file
+  int liRed = (miCmpMod == CMP_NVR) ? 2 : 1 ;  // hard or soft reads
+  int lcVal ;
+
+  /* do not backtrace before the read position */
+  if (! mbSrcBkt && lzBegOrg < azRedOrg)
+      lzBegOrg = azRedOrg ;
+  if (lzBegOrg < 0)
+      lzBegOrg = 0 ;
+
+  /* read both files once (stop at EOF or EOB) */
+  for (liLenNew = 0; liLenNew < (int) sizeof(lcNew); liLenNew++) {
+      lcVal = mpFilNew->get(azRedNew + 1 + liLenNew, liRed) ;
+      if (lcVal < 0) break ;
+      lcNew[liLenNew] = (uchar) lcVal ;
+  }
+  for (liLenOrg = 0; liLenOrg < (int) sizeof(lcOrg); liLenOrg++) {
+      lcVal = mpFilOrg->get(lzBegOrg + liLenOrg, liRed) ;
+      if (lcVal < 0) break ;
+      lcOrg[liLenOrg] = (uchar) lcVal ;
   }
-}
+
+  for (liDst = 1; liDst <= SYN_DST && liDst - 1 + SYN_EXT <= liLenNew; liDst++) {
+      /* Low-quality sample: no shift can be told apart, leave it to the lookahead */
+      liEql = 0 ;
+      for (liIdx = liDst; liIdx < liDst - 1 + SMPSZE; liIdx++) {
+          if (lcNew[liIdx] != lcNew[liIdx - 1]) {
+              if (liEql > 0) liEql -= 2 ;
+          } else {
+              if (liEql < SMPSZE) liEql += 1 ;
+          }
+      }
+      if (liEql > SMPSZE - 4)
+          continue ;
+
+      /* shifts 0, +1, -1, +2, -2, ... */
+      for (liSft = 0; liSft <= 2 * SYN_SFT; liSft++) {
+          azFndOrg = azRedOrg + liDst + ((liSft & 1) ? (liSft + 1) / 2 : - liSft / 2) ;
+          liOff = (int) (azFndOrg - lzBegOrg) ;
+          if (liOff < 0 || liOff + SYN_EXT > liLenOrg)
+              continue ;
+          if (lcOrg[liOff] == lcNew[liDst - 1]
+                  && memcmp(&lcOrg[liOff], &lcNew[liDst - 1], SYN_EXT) == 0) {
+              /* Confirmed: exact start and length of the equal region */
+              azFndNew = azRedNew + liDst ;
+              return gpMch->extend(azFndOrg, azFndNew, azBseOrg, azRedNew) ;
+          }
+      }
+  }
+  return 0 ;
+} /* ufFndSyn */
+
+/**
+ * Add a found position to the table of matches.
+ *
+ * @param azFndOrg  position found in the original file
+ * @param azFndNew  corresponding position in the new file
+ * @param azRedNew  read position in new file
+ * @param aiEqlNew  quality of the sample
+ * @param azBseOrg  do not backtrace before this position
+ * @param aiBck     number of bytes looked back on reset
+ * @param aiFnd     in/out: number of matches found
+ * @param aiMax     in/out: number of bytes to look ahead
+ * @param abVfy     match verified by fingerprint ?
+ * @return false when the lookahead should stop
+ */
+bool JDiff::ufFndAhdAdd (
+  off_t const &azFndOrg, off_t const &azFndNew, off_t const &azRedNew,
+  int aiEqlNew, off_t const &azBseOrg, int aiBck, int &aiFnd, int &aiMax, bool abVfy)
+{
+  /* add found position into table of matches */
+  if (azFndOrg > azBseOrg) {
+      /* add solution to the table of matches */
+      switch (gpMch->add(azFndOrg, azFndNew, azRedNew, aiEqlNew, abVfy))
+      { case 0: /* table is full */
+          if (aiBck > 0 && gpMch->cleanup(azRedNew)){
+              // made more room
+          } else {
+              return false ;
+          }
+      case 1: /* alternative added */
+          if (azFndNew > azRedNew) {
+              aiFnd ++ ;
+
+              if (aiFnd == miMchMax) {
+                  return false ;
+              } else if ((aiFnd == miMchMin) && (aiMax > gpHsh->get_reliability())) {
+                  aiMax = gpHsh->get_reliability() ; // reduce lookahead
+              }
+          }
+          break ;
+      case 2:  ; /* alternative collided */
+      case -1: ;/* compare failed      */
+      }
+  }
+  return true ;
+} /* ufFndAhdAdd */
+
+/**
+ * Lookup the queued keys in the external index and add the found positions
+ * to the table of matches. Empties the queue.
+ *
+ * @return false when the lookahead should stop
+ */
+bool JDiff::ufFndAhdBat (
+  off_t const &azRedNew, off_t const &azBseOrg, int aiBck, int &aiFnd, int &aiMax)
+{
+  int liBat ;
+  int liCnt = miBatCnt ;
+
+  miBatCnt = 0 ;
+  giIdxHit += gpIdx->get(mkBatHsh, mzBatOrg, liCnt) ;
+  for (liBat = 0; liBat < liCnt; liBat++) {
+      if (mzBatOrg[liBat] >= 0 &&
+              ! ufFndAhdAdd(mzBatOrg[liBat], mzBatNew[liBat], azRedNew, miBatEql[liBat],
+                            azBseOrg, aiBck, aiFnd, aiMax))
+          return false ;
+  }
+  return true ;
+} /* ufFndAhdBat */
 
 /* -----------------------------------------------------------------------------
  * Auxiliary function:
@@ -512,6 +1012,177 @@ void JDiff::ufFndAhdGet(JFile *apFil, const off_t &azPos, int &acVal, int &aiEql
   }
 }
 
+/**
+ * Slide the local hashtable window along with the read position on the original file.
+ *
+ * The local hashtable is a small sliding-window hashtable that densely samples the
+ * original file from azRedOrg - miLclWin/2 up to azRedOrg + miLclWin/2. Only the part
+ * of the window that has not been hashed yet gets read, so the table is updated
+ * incrementally as jdiff advances. Soft reads are used to avoid additional seeks:
+ * the window starts at the read position when its beginning is no longer buffered.
+ *
+ * @param azRedOrg  read position in original file
+ * @return 0 = ok, < 0 = error
+ */
+int JDiff::ufFndAhdLcl (off_t const &azRedOrg)
+{
+  off_t lzEnd = azRedOrg + miLclWin / 2 ;   // end of the local window
+  int liIdx ;
+
+  /* Reset the window on start and after a jump on the original file */
+  if (mzLclOrg < 0 || mzLclOrg + miLclWin / 2 < azRedOrg || mzLclOrg > lzEnd + miLclWin / 2) {
+    mzLclOrg = azRedOrg - miLclWin / 2 ;
+    if (mzLclOrg < 0) mzLclOrg = 0 ;
+    mlHshLcl = 0 ;
+    miEqlLcl = 0 ;
+
+    miValLcl = mpFilOrg->get(mzLclOrg, 2) ;
+    if (miValLcl == EOB) {
+      mzLclOrg = azRedOrg ;
+      miValLcl = mpFilOrg->get(mzLclOrg, 2) ;
+    }
+    for (liIdx=0; (liIdx < SMPSZE - 1) && (miValLcl > EOF); liIdx++){
+      gpHsh->hash(miValLcl, mlHshLcl) ;
+      ufFndAhdGet(mpFilOrg, ++ mzLclOrg, miValLcl, miEqlLcl, 2) ;
+    }
+  } else if (miValLcl == EOB) {
+    /* retry after end-of-buffer */
+    miValLcl = mpFilOrg->get(mzLclOrg, 2) ;
+  }
+
+  /* Hash the original file up to the end of the window */
+  while (mzLclOrg < lzEnd && miValLcl > EOF) {
+    gpHsh->hash(miValLcl, mlHshLcl) ;
+    gpHshLcl->add(mlHshLcl, mzLclOrg, miEqlLcl) ;
+    ufFndAhdGet(mpFilOrg, ++ mzLclOrg, miValLcl, miEqlLcl, 2) ;
+  }
+
+  if (miValLcl < EOB)
+      return miValLcl ;
+  else
+      return 0 ;
+} /* ufFndAhdLcl */
+
+/**
+ * Compare both files in aligned blocks of miBlkAln bytes, at the same offsets,
+ * and mark the equal blocks in the block map.
+ * @return 0 = ok, < 0 = error
+ */
+int JDiff::ufBlkScn ()
+{
+  const uchar *lpOrg ;  // buffered block on original file
+  const uchar *lpNew ;  // buffered block on new file
+  int   liLenOrg ;
+  int   liLenNew ;
+  int   liOrg = 0 ;
+  int   liNew = 0 ;
+  int   liIdx ;
+  bool  lbEql ;
+  off_t lzPos ;
+  off_t lzMax = 0 ;     // number of blocks allocated in the map
+  off_t lzPrgNxt = (mpPrg == null) ? MAX_OFF_T : 0 ;   // next progress report
+
+  mzBlkCnt = 0 ;
+  mzBlkEql = 0 ;
+  for (lzPos = 0 ; ; lzPos += miBlkAln) {
+    if (lzPos >= lzPrgNxt) {
+      lzPrgNxt = lzPos + PRG_STP ;
+      if (! mpPrg->update(PRG_SCN, lzPos, lzPos))
+        return - EXI_CNL ;
+    }
+
+    /* Read the whole block on both files: a partial block at the end is not compared */
+    liOrg = mpFilOrg->get(lzPos + miBlkAln - 1, 1) ;
+    liNew = mpFilNew->get(lzPos + miBlkAln - 1, 1) ;
+    if (liOrg < 0 || liNew < 0)
+      break ;
+
+    /* Compare within the buffers, or byte by byte when the block is split */
+    lpOrg = mpFilOrg->getbuf(lzPos, liLenOrg) ;
+    lpNew = mpFilNew->getbuf(lzPos, liLenNew) ;
+    if (lpOrg != null && lpNew != null && liLenOrg >= miBlkAln && liLenNew >= miBlkAln) {
+      lbEql = (memcmp(lpOrg, lpNew, miBlkAln) == 0) ;
+    } else {
+      lbEql = true ;
+      for (liIdx = 0; liIdx < miBlkAln && lbEql; liIdx++) {
+        liOrg = mpFilOrg->get(lzPos + liIdx, 1) ;
+        liNew = mpFilNew->get(lzPos + liIdx, 1) ;
+        lbEql = (liOrg == liNew && liOrg >= 0) ;
+      }
+      if (liOrg < 0 || liNew < 0)
+        break ;
+    }
+
+    /* Mark in the block map */
+    if (mzBlkCnt == lzMax) {
+      lzMax = (lzMax == 0) ? 8192 : lzMax * 2 ;
+      mpBlkEql = (uchar *) realloc(mpBlkEql, lzMax / 8) ;
+#ifndef __MINGW32__
+      if (mpBlkEql == null) {
+        throw bad_alloc() ;
+      }
+#endif
+      memset(mpBlkEql + mzBlkCnt / 8, 0, (lzMax - mzBlkCnt) / 8) ;
+    }
+    if (lbEql) {
+      mpBlkEql[mzBlkCnt >> 3] |= (uchar) (1 << (mzBlkCnt & 7)) ;
+      mzBlkEql ++ ;
+    }
+    mzBlkCnt ++ ;
+  }
+
+  if (liOrg < EOB || liNew < EOB)
+    return (liOrg < liNew) ? liOrg : liNew ;
+
+  /* An empty map still means: done */
+  if (mpBlkEql == null) {
+    mpBlkEql = (uchar *) calloc(1, 1) ;
+#ifndef __MINGW32__
+    if (mpBlkEql == null) {
+      throw bad_alloc() ;
+    }
+#endif
+  }
+  return 0 ;
+} /* ufBlkScn */
+
+/**
+ * Number of bytes from azPos up to the end of the run of equal blocks that
+ * contains azPos (0 if the block of azPos is not equal).
+ */
+off_t JDiff::ufBlkRun (off_t const &azPos)
+{
+  off_t lzBlk = azPos / miBlkAln ;
+  off_t lzEnd ;
+
+  if (lzBlk >= mzBlkCnt || ! (mpBlkEql[lzBlk >> 3] & (1 << (lzBlk & 7))))
+    return 0 ;
+
+  for (lzEnd = lzBlk + 1; lzEnd < mzBlkCnt; lzEnd++) {
+    if ((lzEnd & 7) == 0 && mpBlkEql[lzEnd >> 3] == 0xff && lzEnd + 8 <= mzBlkCnt)
+      lzEnd += 7 ;  // eight equal blocks at once
+    else if (! (mpBlkEql[lzEnd >> 3] & (1 << (lzEnd & 7))))
+      break ;
+  }
+  return lzEnd * miBlkAln - azPos ;
+} /* ufBlkRun */
+
+/**
+ * Start of the first equal block at or after azPos, up to azMax (-1 if none).
+ */
+off_t JDiff::ufBlkNxt (off_t const &azPos, off_t const &azMax)
+{
+  off_t lzBlk = (azPos + miBlkAln - 1) / miBlkAln ;
+
+  for (; lzBlk < mzBlkCnt && lzBlk * miBlkAln <= azMax; lzBlk++) {
+    if ((lzBlk & 7) == 0 && mpBlkEql[lzBlk >> 3] == 0)
+      lzBlk += 7 ;  // eight changed blocks at once
+    else if (mpBlkEql[lzBlk >> 3] & (1 << (lzBlk & 7)))
+      return lzBlk * miBlkAln ;
+  }
+  return -1 ;
+} /* ufBlkNxt */
+
 /**
  * Prescan the original file: calculates a hash-key for every 32-byte sample
  * in the left file and stores them with their position in a hash-table.
@@ -524,6 +1195,10 @@ int JDiff::ufFndAhdScn ()
   off_t lzPosOrg=0;     // Position within original file
 
   int   liIdx ;
+  int   liRet = 0 ;     // Return code from the external index
+  rFpr  lrFprOrg ;      // Fingerprint for original file
+
+  JHashPos::fingerprint_reset(lrFprOrg) ;
 
   if (miVerbse > 0) {
     fprintf(JDebug::stddbg, "Prescanning:\n");
@@ -533,6 +1208,7 @@ int JDiff::ufFndAhdScn ()
   lcValOrg = mpFilOrg->get(lzPosOrg, 1) ;
   for (liIdx=0;(liIdx < SMPSZE - 1) && (lcValOrg > EOF); liIdx++) {
     gpHsh->hash(lcValOrg, lkHshOrg) ;
+    if (mbFpr) gpHsh->fingerprint(lcValOrg, lrFprOrg) ;
     ufFndAhdGet(mpFilOrg, ++ lzPosOrg, lcValOrg, liEqlOrg, 1) ;
   }
 
@@ -540,9 +1216,49 @@ int JDiff::ufFndAhdScn ()
   liIdx = 0;
 #pragma omp parallel default(shared) private(lcValOrg, lkHshOrg, lzPosOrg, liEqlOrg, liIdx)
 {
+  off_t lzBlkBnd = (mpBlkEql == null) ? -1 : miBlkAln ;  // next aligned block boundary
+  off_t lzBlkRun ;
+  int   liSmp ;
+  off_t lzPrgNxt = (mpPrg == null) ? MAX_OFF_T : 0 ;      // next progress report
+
   while (lcValOrg > EOF) {
+    /* Report progress and check for cancellation */
+    if (lzPosOrg >= lzPrgNxt) {
+      lzPrgNxt = lzPosOrg + PRG_STP ;
+      if (! mpPrg->update(PRG_SCN, lzPosOrg, 0)) {
+        liRet = - EXI_CNL ;
+        break ;
+      }
+    }
+
+    /* Skip runs of equal aligned blocks: they are output without looking ahead */
+    if (lzPosOrg == lzBlkBnd) {
+      lzBlkRun = ufBlkRun(lzPosOrg) ;
+      lzBlkBnd += (lzBlkRun > 0) ? lzBlkRun : miBlkAln ;
+      if (lzBlkRun > SMPSZE) {
+        /* restart hashing, one sample before the end of the run */
+        lzPosOrg = lzBlkBnd - (SMPSZE - 1) ;
+        lkHshOrg = 0 ;
+        liEqlOrg = 0 ;
+        if (mbFpr) JHashPos::fingerprint_reset(lrFprOrg) ;
+        lcValOrg = mpFilOrg->get(lzPosOrg, 1) ;
+        for (liSmp=0;(liSmp < SMPSZE - 1) && (lcValOrg > EOF); liSmp++) {
+          gpHsh->hash(lcValOrg, lkHshOrg) ;
+          if (mbFpr) gpHsh->fingerprint(lcValOrg, lrFprOrg) ;
+          ufFndAhdGet(mpFilOrg, ++ lzPosOrg, lcValOrg, liEqlOrg, 1) ;
+        }
+        continue ;
+      }
+    }
+
     gpHsh->hash(lcValOrg, lkHshOrg) ;
-    gpHsh->add(lkHshOrg, lzPosOrg, liEqlOrg) ;
+    if (mbFpr) gpHsh->fingerprint(lcValOrg, lrFprOrg) ;
+    if (gpIdx != null) {
+        liRet = gpIdx->add(lkHshOrg, lzPosOrg, liEqlOrg) ;
+        if (liRet < 0) break ;
+    } else {
+        gpHsh->add(lkHshOrg, lzPosOrg, liEqlOrg, lrFprOrg.ikFpr) ;
+    }
     #if debug
         if (JDebug::gbDbg[DBGAHH])
             fprintf(JDebug::stddbg, "ufHshAdd(%2x -> %8"PRIhkey", "P8zd", %8d)\n",
@@ -571,6 +1287,12 @@ int JDiff::ufFndAhdScn ()
 
   if (miVerbse > 0) fprintf(JDebug::stddbg, ".\n");
 
+  /* Sort and merge the external index */
+  if (gpIdx != null && liRet == 0)
+    liRet = gpIdx->close() ;
+  if (liRet < 0)
+    return liRet ;
+
 #if debug
   if (JDebug::gbDbg[DBGDST])
 	  gpHsh->dist(lzPosOrg, 128);
@@ -581,4 +1303,20 @@ int JDiff::ufFndAhdScn ()
   else
       return 0 ;
 } /* ufFndAhdScn */
+
+/*
+ * Specialized difference functions (JDiffT) for the file and output classes of JojoDiff.
+ */
+#ifdef __MINGW32__
+template int JDiff::ufJDiff<JFileAhead, JOutBin> () ;
+template int JDiff::ufJDiff<JFileAhead, JOutAsc> () ;
+template int JDiff::ufJDiff<JFileAhead, JOutRgn> () ;
+#else
+template int JDiff::ufJDiff<JFileIStreamAhead, JOutBin> () ;
+template int JDiff::ufJDiff<JFileIStreamAhead, JOutAsc> () ;
+template int JDiff::ufJDiff<JFileIStreamAhead, JOutRgn> () ;
+template int JDiff::ufJDiff<JFileIStream, JOutBin> () ;
+template int JDiff::ufJDiff<JFileIStream, JOutAsc> () ;
+template int JDiff::ufJDiff<JFileIStream, JOutRgn> () ;
+#endif
 } /* namespace */
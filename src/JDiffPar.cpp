@@ -0,0 +1,295 @@
+/*
+ * JDiffPar.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JDiffPar.h"
+#include "JOutBin.h"
+#ifdef __MINGW32__
+#include "JFileAhead.h"
+#else
+#include <fstream>
+#include "JFileIStreamAhead.h"
+#endif
+
+namespace JojoDiff {
+
+/* File class for the chunks */
+#ifdef __MINGW32__
+typedef JFileAhead JFilePar ;
+#else
+typedef JFileIStreamAhead JFilePar ;
+#endif
+
+/**
+ * Create a parallel JDiff: divide the new file into chunks.
+ */
+JDiffPar::JDiffPar(JDiff *apMst, const char *asFilOrg, const char *asFilNew,
+                   off_t azSzeOrg, off_t azSzeNew, FILE *apFilOut, JOut *apOut,
+                   int aiThrCnt, off_t azChkSze, long alBufSze, int aiBlkSze)
+: mpMst(apMst), msFilOrg(asFilOrg), msFilNew(asFilNew), mpFilOut(apFilOut), mpOut(apOut),
+  miThrCnt(aiThrCnt < 1 ? 1 : aiThrCnt), mlBufSze(alBufSze), miBlkSze(aiBlkSze),
+  miChkNxt(0), mzPrgNew(0), mlSekCnt(0)
+{
+    int liChk ;
+
+    if (azChkSze < SMPSZE) azChkSze = SMPSZE ;
+    miChkCnt = (azSzeNew + azChkSze - 1) / azChkSze ;
+    if (miChkCnt < 1) miChkCnt = 1 ;
+
+    mpChk = new rChk[miChkCnt] ;
+    for (liChk = 0; liChk < miChkCnt; liChk++){
+        off_t lzBegNew = (off_t) liChk * azChkSze ;
+        ufSetChk(liChk, (lzBegNew < azSzeOrg) ? lzBegNew : azSzeOrg, lzBegNew,
+                 (liChk == miChkCnt - 1) ? azSzeNew : lzBegNew + azChkSze) ;
+    }
+
+    pthread_mutex_init(&mtMtx, NULL) ;
+}
+
+/**
+ * Create a parallel JDiff on the given chunks (see JTar::pair).
+ */
+JDiffPar::JDiffPar(JDiff *apMst, const char *asFilOrg, const char *asFilNew,
+                   off_t azSzeNew, FILE *apFilOut, JOut *apOut,
+                   int aiThrCnt, int aiChkCnt, const off_t *apBegOrg, const off_t *apBegNew,
+                   long alBufSze, int aiBlkSze)
+: mpMst(apMst), msFilOrg(asFilOrg), msFilNew(asFilNew), mpFilOut(apFilOut), mpOut(apOut),
+  miThrCnt(aiThrCnt < 1 ? 1 : aiThrCnt), mlBufSze(alBufSze), miBlkSze(aiBlkSze),
+  miChkCnt(aiChkCnt), miChkNxt(0), mzPrgNew(0), mlSekCnt(0)
+{
+    int liChk ;
+
+    mpChk = new rChk[miChkCnt] ;
+    for (liChk = 0; liChk < miChkCnt; liChk++){
+        ufSetChk(liChk, apBegOrg[liChk], apBegNew[liChk],
+                 (liChk == miChkCnt - 1) ? azSzeNew : apBegNew[liChk + 1]) ;
+    }
+
+    pthread_mutex_init(&mtMtx, NULL) ;
+}
+
+/*
+ * Initialize a chunk
+ */
+void JDiffPar::ufSetChk (int aiChk, off_t azBegOrg, off_t azBegNew, off_t azEndNew)
+{
+    rChk &lrChk = mpChk[aiChk] ;
+
+    lrChk.izBegOrg = azBegOrg ;
+    lrChk.izBegNew = azBegNew ;
+    lrChk.izEndNew = azEndNew ;
+    lrChk.izEndOrg = azBegOrg ;
+    lrChk.ipFil = null ;
+    lrChk.ipOut = null ;
+    lrChk.iiRet = - EXI_CNL ;    // not compared (yet)
+    lrChk.iiHshHit = 0 ;
+    lrChk.iiLclHit = 0 ;
+    lrChk.iiIdxHit = 0 ;
+    lrChk.iiHshErr = 0 ;
+    lrChk.iiSynHit = 0 ;
+    lrChk.iiAhdGrw = 0 ;
+    lrChk.iiAhdShr = 0 ;
+    lrChk.iiHshRpr = 0 ;
+    lrChk.iiFprHit = 0 ;
+    lrChk.iiChkMem = 0 ;
+    lrChk.iiCmpSft = 0 ;
+    lrChk.iiOptSel = 0 ;
+}
+
+/*
+ * Destructor
+ */
+JDiffPar::~JDiffPar() {
+    for (int liChk = 0; liChk < miChkCnt; liChk++){
+        if (mpChk[liChk].ipFil != null) fclose(mpChk[liChk].ipFil) ;
+        delete mpChk[liChk].ipOut ;
+    }
+    delete [] mpChk ;
+    pthread_mutex_destroy(&mtMtx) ;
+}
+
+/**
+ * Compare all chunks on miThrCnt threads (including this one), then stitch.
+ */
+int JDiffPar::jdiff ()
+{
+    pthread_t *lpThr = new pthread_t[miThrCnt] ;
+    int liThr ;
+    int liRun ;
+
+    for (liRun = 0; liRun < miThrCnt - 1; liRun++){
+        if (pthread_create(&lpThr[liRun], NULL, ufThr, this) != 0)
+            break ;     // the running threads will take over the remaining chunks
+    }
+    ufThr(this) ;
+    for (liThr = 0; liThr < liRun; liThr++){
+        pthread_join(lpThr[liThr], NULL) ;
+    }
+    delete [] lpThr ;
+
+    return ufStc() ;
+} /* jdiff */
+
+/**
+ * Thread: take the next chunk and compare it, until none are left.
+ */
+void *JDiffPar::ufThr (void *apPar)
+{
+    JDiffPar *lpPar = (JDiffPar *) apPar ;
+    int liChk ;
+
+    for (;;) {
+        pthread_mutex_lock(&lpPar->mtMtx) ;
+        liChk = lpPar->miChkNxt++ ;
+        pthread_mutex_unlock(&lpPar->mtMtx) ;
+
+        if (liChk >= lpPar->miChkCnt)
+            return NULL ;
+        if (lpPar->mpMst->getProgress() != null && lpPar->mpMst->getProgress()->cancelled())
+            return NULL ;
+        lpPar->ufChk(liChk) ;
+    }
+} /* ufThr */
+
+/**
+ * Compare one chunk into a temporary file, with its own files and a JDiff
+ * sharing the master's hashtable.
+ */
+void JDiffPar::ufChk (int aiChk)
+{
+    rChk &lrChk = mpChk[aiChk] ;
+    bool lbOpn ;
+
+    lrChk.ipFil = tmpfile() ;
+    if (lrChk.ipFil == null) {
+        lrChk.iiRet = - EXI_WRI ;
+        return ;
+    }
+    lrChk.ipOut = new JOutBin(lrChk.ipFil) ;
+
+    /* Open the files: file handles cannot be shared between threads */
+#ifdef __MINGW32__
+    FILE *lpHdlOrg = jfopen(msFilOrg, "rb") ;
+    FILE *lpHdlNew = jfopen(msFilNew, "rb") ;
+    lbOpn = (lpHdlOrg != null && lpHdlNew != null) ;
+#else
+    ifstream loHdlOrg(msFilOrg, ios_base::in | ios_base::binary) ;
+    ifstream loHdlNew(msFilNew, ios_base::in | ios_base::binary) ;
+    ifstream *lpHdlOrg = &loHdlOrg ;
+    ifstream *lpHdlNew = &loHdlNew ;
+    lbOpn = (loHdlOrg.is_open() && loHdlNew.is_open()) ;
+#endif
+
+    if (! lbOpn) {
+        lrChk.iiRet = - EXI_RED ;
+    } else {
+        JFilePar loFilOrg(lpHdlOrg, "Org", mlBufSze, miBlkSze) ;
+        JFilePar loFilNew(lpHdlNew, "New", mlBufSze, miBlkSze) ;
+        JDiffT<JFilePar, JOutBin> loDiff(*mpMst, &loFilOrg, &loFilNew, lrChk.ipOut) ;
+
+        loDiff.setRange(lrChk.izBegOrg, lrChk.izBegNew, lrChk.izEndNew) ;
+        lrChk.iiRet = loDiff.jdiff() ;
+        lrChk.izEndOrg = loDiff.getEndOrg() ;
+        lrChk.iiHshHit = loDiff.giHshHit ;
+        lrChk.iiLclHit = loDiff.giLclHit ;
+        lrChk.iiIdxHit = loDiff.giIdxHit ;
+        lrChk.iiHshErr = loDiff.giHshErr ;
+        lrChk.iiSynHit = loDiff.giSynHit ;
+        lrChk.iiAhdGrw = loDiff.giAhdGrw ;
+        lrChk.iiAhdShr = loDiff.giAhdShr ;
+        lrChk.iiHshRpr = loDiff.getMch()->miHshRpr ;
+        lrChk.iiFprHit = loDiff.getMch()->miFprHit ;
+        lrChk.iiChkMem = loDiff.getMch()->miChkMem ;
+        lrChk.iiCmpSft = loDiff.getMch()->miCmpSft ;
+        lrChk.iiOptSel = loDiff.getMch()->miOptSel ;
+
+        pthread_mutex_lock(&mtMtx) ;
+        mlSekCnt += loFilOrg.seekcount() + loFilNew.seekcount() ;
+        mzPrgNew += lrChk.izEndNew - lrChk.izBegNew ;
+        if (mpMst->getProgress() != null && lrChk.iiRet >= 0)
+            mpMst->getProgress()->update(PRG_DIF, lrChk.izEndOrg, mzPrgNew) ;
+        pthread_mutex_unlock(&mtMtx) ;
+    }
+
+#ifdef __MINGW32__
+    if (lpHdlOrg != null) jfclose(lpHdlOrg) ;
+    if (lpHdlNew != null) jfclose(lpHdlNew) ;
+#endif
+} /* ufChk */
+
+/**
+ * Stitch the chunks' outputs together, in order, repositioning on the original
+ * file between two chunks.
+ * @return 0 = ok, < 0 = error
+ */
+int JDiffPar::ufStc ()
+{
+    char  lcBuf[64 * 1024] ;
+    size_t llRed ;
+    off_t lzPosOrg = 0 ;    // position on the original file after the previous chunk
+    int   liChk ;
+
+    for (liChk = 0; liChk < miChkCnt; liChk++){
+        rChk &lrChk = mpChk[liChk] ;
+        if (lrChk.iiRet < 0)
+            return lrChk.iiRet ;
+
+        /* Go to the chunk's start position on the original file */
+        if (lrChk.izBegOrg > lzPosOrg) {
+            mpOut->put(DEL, lrChk.izBegOrg - lzPosOrg, 0, 0, lzPosOrg, lrChk.izBegNew) ;
+        } else if (lrChk.izBegOrg < lzPosOrg) {
+            mpOut->put(BKT, lzPosOrg - lrChk.izBegOrg, 0, 0, lzPosOrg, lrChk.izBegNew) ;
+        }
+        lzPosOrg = lrChk.izEndOrg ;
+
+        /* Copy the chunk's output: each one starts with an opcode and ends flushed */
+        rewind(lrChk.ipFil) ;
+        while ((llRed = fread(lcBuf, 1, sizeof(lcBuf), lrChk.ipFil)) > 0) {
+            if (fwrite(lcBuf, 1, llRed, mpFilOut) != llRed)
+                return - EXI_WRI ;
+        }
+        if (ferror(lrChk.ipFil))
+            return - EXI_RED ;
+        fclose(lrChk.ipFil) ;
+        lrChk.ipFil = null ;
+
+        /* Statistics */
+        mpOut->gzOutBytDta += lrChk.ipOut->gzOutBytDta ;
+        mpOut->gzOutBytCtl += lrChk.ipOut->gzOutBytCtl ;
+        mpOut->gzOutBytDel += lrChk.ipOut->gzOutBytDel ;
+        mpOut->gzOutBytBkt += lrChk.ipOut->gzOutBytBkt ;
+        mpOut->gzOutBytEsc += lrChk.ipOut->gzOutBytEsc ;
+        mpOut->gzOutBytEql += lrChk.ipOut->gzOutBytEql ;
+        mpMst->giHshHit += lrChk.iiHshHit ;
+        mpMst->giLclHit += lrChk.iiLclHit ;
+        mpMst->giIdxHit += lrChk.iiIdxHit ;
+        mpMst->giHshErr += lrChk.iiHshErr ;
+        mpMst->giSynHit += lrChk.iiSynHit ;
+        mpMst->giAhdGrw += lrChk.iiAhdGrw ;
+        mpMst->giAhdShr += lrChk.iiAhdShr ;
+        mpMst->getMch()->miHshRpr += lrChk.iiHshRpr ;
+        mpMst->getMch()->miFprHit += lrChk.iiFprHit ;
+        mpMst->getMch()->miChkMem += lrChk.iiChkMem ;
+        mpMst->getMch()->miCmpSft += lrChk.iiCmpSft ;
+        mpMst->getMch()->miOptSel += lrChk.iiOptSel ;
+    }
+    return 0 ;
+} /* ufStc */
+}
@@ -0,0 +1,501 @@
+/*
+ * JDirDiff.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <new>
+
+#include "JDirDiff.h"
+
+using namespace std ;
+
+namespace JojoDiff {
+
+/**
+ * Create a tree difference.
+ */
+JDirDiff::JDirDiff(const char *asDirOrg, const char *asDirNew)
+: mpCat(null), mpEnt(null), miEntCnt(0), miEntMax(0),
+  miUncMta(0), miUncCnt(0), miRen(0), miRenMod(0), miMod(0), miAdd(0), miDel(0), miSkp(0),
+  mzOut(0)
+{
+    mrOrg.isDir = asDirOrg ; mrOrg.ipFil = null ; mrOrg.iiCnt = 0 ; mrOrg.iiMax = 0 ;
+    mrNew.isDir = asDirNew ; mrNew.ipFil = null ; mrNew.iiCnt = 0 ; mrNew.iiMax = 0 ;
+}
+
+/*
+ * Destructor
+ */
+JDirDiff::~JDirDiff() {
+    for (int liFil = 0; liFil < mrOrg.iiCnt; liFil++) free(mrOrg.ipFil[liFil].isPth) ;
+    for (int liFil = 0; liFil < mrNew.iiCnt; liFil++) free(mrNew.ipFil[liFil].isPth) ;
+    free(mrOrg.ipFil) ;
+    free(mrNew.ipFil) ;
+    free(mpEnt) ;
+}
+
+/**
+ * Walk both trees, pair the files and add the pairs to diff to the batch.
+ */
+int JDirDiff::scan (JBatch &aoBat, JFileConcat *apCat)
+{
+    char lcOrg[JDC_LIN] ;
+    char lcNew[JDC_LIN] ;
+    int liOrg ;
+    int liNew ;
+    int liCmp ;
+    bool lbEql ;
+
+    if (ufWlk(mrOrg, "") != 0)
+        return - EXI_FRT ;
+    if (ufWlk(mrNew, "") != 0)
+        return - EXI_SCD ;
+    qsort(mrOrg.ipFil, mrOrg.iiCnt, sizeof(rFil), ufCmpPth) ;
+    qsort(mrNew.ipFil, mrNew.iiCnt, sizeof(rFil), ufCmpPth) ;
+
+    /* Cross-file matching: all original files form one virtual original */
+    mpCat = apCat ;
+    if (mpCat != null) {
+        for (liOrg = 0; liOrg < mrOrg.iiCnt; liOrg++) {
+            if (! mrOrg.ipFil[liOrg].ibDir)
+                mpCat->add(ufPth(mrOrg, liOrg, lcOrg), mrOrg.ipFil[liOrg].izSze) ;
+        }
+    }
+
+    /* Pair on path (both trees are sorted) */
+    for (liOrg = 0, liNew = 0; liOrg < mrOrg.iiCnt && liNew < mrNew.iiCnt; ) {
+        liCmp = strcmp(mrOrg.ipFil[liOrg].isPth, mrNew.ipFil[liNew].isPth) ;
+        if (liCmp < 0) {
+            liOrg++ ;
+        } else if (liCmp > 0) {
+            liNew++ ;
+        } else {
+            if (mrOrg.ipFil[liOrg].ibDir == mrNew.ipFil[liNew].ibDir) {
+                mrOrg.ipFil[liOrg].ibUsd = true ;
+                mrNew.ipFil[liNew].ibUsd = true ;
+            }
+            liOrg++ ;
+            liNew++ ;
+        }
+    }
+
+    /* Entries, in the order of the new tree */
+    for (liNew = 0, liOrg = 0; liNew < mrNew.iiCnt; liNew++) {
+        rFil &lrNew = mrNew.ipFil[liNew] ;
+        if (lrNew.ibDir) {
+            ufAddEnt('M', -1, liNew, -1) ;
+            continue ;
+        }
+        if (lrNew.ibUsd) {
+            /* Same path: find the original (both trees are sorted) */
+            while (strcmp(mrOrg.ipFil[liOrg].isPth, lrNew.isPth) != 0) liOrg++ ;
+            rFil &lrOrg = mrOrg.ipFil[liOrg] ;
+            if (lrOrg.izSze == lrNew.izSze && lrOrg.ilTim == lrNew.ilTim) {
+                ufAddEnt('C', liOrg, liNew, -1) ;
+                miUncMta++ ;
+            } else if (lrOrg.izSze == lrNew.izSze &&
+                       ufEql(ufPth(mrOrg, liOrg, lcOrg), ufPth(mrNew, liNew, lcNew))) {
+                ufAddEnt('C', liOrg, liNew, -1) ;
+                miUncCnt++ ;
+            } else {
+                ufAddEnt(mpCat == null ? 'P' : 'X', liOrg, liNew,
+                         aoBat.add(ufPth(mrOrg, liOrg, lcOrg), ufPth(mrNew, liNew, lcNew), null)) ;
+                miMod++ ;
+            }
+        } else {
+            /* Renamed, moved or new */
+            int liRen = ufRen(liNew, lbEql) ;
+            if (liRen < 0 && mpCat != null) {
+                ufAddEnt('X', -1, liNew, aoBat.add(null, ufPth(mrNew, liNew, lcNew), null)) ;
+                miAdd++ ;
+            } else if (liRen < 0) {
+                ufAddEnt('N', -1, liNew, -1) ;
+                miAdd++ ;
+            } else if (lbEql) {
+                ufAddEnt('C', liRen, liNew, -1) ;
+                miRen++ ;
+            } else {
+                ufAddEnt(mpCat == null ? 'P' : 'X', liRen, liNew,
+                         aoBat.add(ufPth(mrOrg, liRen, lcOrg), ufPth(mrNew, liNew, lcNew), null)) ;
+                miRenMod++ ;
+            }
+        }
+    }
+
+    /* Deleted files */
+    for (liOrg = 0; liOrg < mrOrg.iiCnt; liOrg++) {
+        if (! mrOrg.ipFil[liOrg].ibDir && ! mrOrg.ipFil[liOrg].ibUsd && ! mrOrg.ipFil[liOrg].ibRen) {
+            ufAddEnt('D', liOrg, -1, -1) ;
+            miDel++ ;
+        }
+    }
+    return 0 ;
+} /* scan */
+
+/**
+ * Find the original of a new file without an original of the same path: an
+ * original that is not paired on path, with the same size and sampled hash
+ * or, failing that, with the same name.
+ */
+int JDirDiff::ufRen (int aiNew, bool &abEql)
+{
+    char lcOrg[JDC_LIN] ;
+    char lcNew[JDC_LIN] ;
+    rFil &lrNew = mrNew.ipFil[aiNew] ;
+    const char *lsNam ;
+    const char *lsOrg ;
+    int liOrg ;
+
+    abEql = false ;
+
+    /* Same size and sampled hash: the same contents, or nearly */
+    for (liOrg = 0; liOrg < mrOrg.iiCnt; liOrg++) {
+        rFil &lrOrg = mrOrg.ipFil[liOrg] ;
+        if (lrOrg.ibDir || lrOrg.ibUsd || lrOrg.izSze != lrNew.izSze)
+            continue ;
+        if (ufSmp(mrOrg, liOrg) == ufSmp(mrNew, aiNew)) {
+            abEql = ufEql(ufPth(mrOrg, liOrg, lcOrg), ufPth(mrNew, aiNew, lcNew)) ;
+            lrOrg.ibRen = true ;
+            return liOrg ;
+        }
+    }
+
+    /* Same name, in another directory */
+    lsNam = strrchr(lrNew.isPth, '/') ;
+    lsNam = (lsNam == null) ? lrNew.isPth : lsNam + 1 ;
+    for (liOrg = 0; liOrg < mrOrg.iiCnt; liOrg++) {
+        rFil &lrOrg = mrOrg.ipFil[liOrg] ;
+        if (lrOrg.ibDir || lrOrg.ibUsd)
+            continue ;
+        lsOrg = strrchr(lrOrg.isPth, '/') ;
+        lsOrg = (lsOrg == null) ? lrOrg.isPth : lsOrg + 1 ;
+        if (strcmp(lsOrg, lsNam) == 0) {
+            lrOrg.ibRen = true ;
+            return liOrg ;
+        }
+    }
+    return -1 ;
+} /* ufRen */
+
+/**
+ * Write the container.
+ */
+int JDirDiff::write (JBatch &aoBat, FILE *apOut)
+{
+    char lcNew[JDC_LIN] ;
+    FILE *lpInp ;
+    int liEnt ;
+    int liRet = 0 ;
+
+    if (fputs(JDC_HDR, apOut) == EOF)
+        return - EXI_WRI ;
+    mzOut = strlen(JDC_HDR) ;
+
+    /* Members of the virtual original, in order */
+    if (mpCat != null) {
+        for (liEnt = 0; liEnt < mrOrg.iiCnt; liEnt++) {
+            if (mrOrg.ipFil[liEnt].ibDir)
+                continue ;
+            int liLen = fprintf(apOut, "V %" PRIzd " %s\n", mrOrg.ipFil[liEnt].izSze, mrOrg.ipFil[liEnt].isPth) ;
+            if (liLen < 0)
+                return - EXI_WRI ;
+            mzOut += liLen ;
+        }
+    }
+
+    for (liEnt = 0; liEnt < miEntCnt && liRet == 0; liEnt++) {
+        rEnt &lrEnt = mpEnt[liEnt] ;
+        const char *lsOrg = (lrEnt.iiOrg < 0) ? "" : mrOrg.ipFil[lrEnt.iiOrg].isPth ;
+        const char *lsNew = (lrEnt.iiNew < 0) ? "" : mrNew.ipFil[lrEnt.iiNew].isPth ;
+        int liLen ;
+
+        switch (lrEnt.icTyp) {
+        case 'P':
+        case 'X':
+            if (aoBat.getRet(lrEnt.iiJob) < 0)
+                return aoBat.getRet(lrEnt.iiJob) ;
+            if (lrEnt.icTyp == 'P')
+                liLen = fprintf(apOut, "P %" PRIzd " %s\t%s\n", aoBat.getSzeOut(lrEnt.iiJob), lsOrg, lsNew) ;
+            else
+                liLen = fprintf(apOut, "X %" PRIzd " %s\n", aoBat.getSzeOut(lrEnt.iiJob), lsNew) ;
+            if (liLen > 0) {
+                mzOut += liLen + aoBat.getSzeOut(lrEnt.iiJob) ;
+                liRet = ufCpy(aoBat.getTmp(lrEnt.iiJob), apOut, aoBat.getSzeOut(lrEnt.iiJob)) ;
+            }
+            break ;
+        case 'N':
+            lpInp = jfopen(ufPth(mrNew, lrEnt.iiNew, lcNew), "rb") ;
+            if (lpInp == null)
+                return - EXI_SCD ;
+            liLen = fprintf(apOut, "N %" PRIzd " %s\n", mrNew.ipFil[lrEnt.iiNew].izSze, lsNew) ;
+            if (liLen > 0) {
+                mzOut += liLen + mrNew.ipFil[lrEnt.iiNew].izSze ;
+                liRet = ufCpy(lpInp, apOut, mrNew.ipFil[lrEnt.iiNew].izSze) ;
+            }
+            jfclose(lpInp) ;
+            break ;
+        case 'C':
+            liLen = fprintf(apOut, "C %s\t%s\n", lsOrg, lsNew) ;
+            break ;
+        case 'M':
+            liLen = fprintf(apOut, "M %s\n", lsNew) ;
+            break ;
+        case 'D':
+        default:
+            liLen = fprintf(apOut, "D %s\n", lsOrg) ;
+            break ;
+        }
+        if (liLen < 0)
+            return - EXI_WRI ;
+        if (lrEnt.icTyp != 'P' && lrEnt.icTyp != 'X' && lrEnt.icTyp != 'N')
+            mzOut += liLen ;
+    }
+    if (liRet == 0 && fputs("E\n", apOut) == EOF)
+        liRet = - EXI_WRI ;
+    mzOut += 2 ;
+    if (liRet == 0 && fflush(apOut) != 0)
+        liRet = - EXI_WRI ;
+    return liRet ;
+} /* write */
+
+/**
+ * Write the number of files of each kind.
+ */
+void JDirDiff::report (FILE *apFil)
+{
+    fprintf(apFil, "Tree files unchanged    = %d (%d on size and time, %d on contents)\n",
+            miUncMta + miUncCnt, miUncMta, miUncCnt) ;
+    fprintf(apFil, "Tree files modified     = %d\n", miMod) ;
+    fprintf(apFil, "Tree files renamed      = %d (%d modified)\n", miRen + miRenMod, miRenMod) ;
+    fprintf(apFil, "Tree files added        = %d\n", miAdd) ;
+    fprintf(apFil, "Tree files deleted      = %d\n", miDel) ;
+    if (miSkp > 0)
+        fprintf(apFil, "Tree entries skipped    = %d (links, special files or names)\n", miSkp) ;
+    fprintf(apFil, "Tree container bytes    = %" PRIzd "\n", mzOut) ;
+} /* report */
+
+/**
+ * Walk a (sub)directory of a tree: add its files and directories.
+ * @return 0 = ok, -1 = directory cannot be read
+ */
+int JDirDiff::ufWlk (rTre &arTre, const char *asRel)
+{
+    char lcDir[JDC_LIN] ;
+    char lcPth[JDC_LIN] ;
+    char lcRel[JDC_LIN] ;
+    struct stat ltStt ;
+    struct dirent *lpEnt ;
+    DIR *lpDir ;
+    long long llTim ;
+    int liRet = 0 ;
+
+    snprintf(lcDir, sizeof(lcDir), "%s%s%s", arTre.isDir, *asRel ? "/" : "", asRel) ;
+    lpDir = opendir(lcDir) ;
+    if (lpDir == null)
+        return -1 ;
+
+    while (liRet == 0 && (lpEnt = readdir(lpDir)) != null) {
+        if (strcmp(lpEnt->d_name, ".") == 0 || strcmp(lpEnt->d_name, "..") == 0)
+            continue ;
+        if (strpbrk(lpEnt->d_name, "\t\n") != null
+          || snprintf(lcRel, sizeof(lcRel), "%s%s%s", asRel, *asRel ? "/" : "", lpEnt->d_name) >= (int) sizeof(lcRel) - 64) {
+            miSkp++ ;
+            continue ;
+        }
+        snprintf(lcPth, sizeof(lcPth), "%s/%s", lcDir, lpEnt->d_name) ;
+#ifdef __MINGW32__
+        if (stat(lcPth, &ltStt) != 0) {
+#else
+        if (lstat(lcPth, &ltStt) != 0) {
+#endif
+            miSkp++ ;
+            continue ;
+        }
+#ifdef __linux__
+        llTim = (long long) ltStt.st_mtim.tv_sec * 1000000000 + ltStt.st_mtim.tv_nsec ;
+#else
+        llTim = (long long) ltStt.st_mtime * 1000000000 ;
+#endif
+        if (S_ISDIR(ltStt.st_mode)) {
+            ufAddFil(arTre, lcRel, 0, llTim, true) ;
+            liRet = ufWlk(arTre, lcRel) ;
+        } else if (S_ISREG(ltStt.st_mode)) {
+            ufAddFil(arTre, lcRel, ltStt.st_size, llTim, false) ;
+        } else {
+            miSkp++ ;
+        }
+    }
+    closedir(lpDir) ;
+    return liRet ;
+} /* ufWlk */
+
+/**
+ * Add a file or directory to a tree
+ */
+void JDirDiff::ufAddFil (rTre &arTre, const char *asPth, off_t azSze, long long alTim, bool abDir)
+{
+    if (arTre.iiCnt == arTre.iiMax) {
+        arTre.iiMax = (arTre.iiMax == 0) ? 256 : arTre.iiMax * 2 ;
+        arTre.ipFil = (rFil *) realloc(arTre.ipFil, arTre.iiMax * sizeof(rFil)) ;
+#ifndef __MINGW32__
+        if (arTre.ipFil == null)
+            throw bad_alloc() ;
+#endif
+    }
+    rFil &lrFil = arTre.ipFil[arTre.iiCnt++] ;
+    lrFil.isPth = strdup(asPth) ;
+    lrFil.izSze = azSze ;
+    lrFil.ilTim = alTim ;
+    lrFil.ibDir = abDir ;
+    lrFil.ibUsd = false ;
+    lrFil.ibRen = false ;
+    lrFil.ibSmp = false ;
+    lrFil.ikSmp = 0 ;
+}
+
+/**
+ * Add a container entry
+ */
+void JDirDiff::ufAddEnt (char acTyp, int aiOrg, int aiNew, int aiJob)
+{
+    if (miEntCnt == miEntMax) {
+        miEntMax = (miEntMax == 0) ? 256 : miEntMax * 2 ;
+        mpEnt = (rEnt *) realloc(mpEnt, miEntMax * sizeof(rEnt)) ;
+#ifndef __MINGW32__
+        if (mpEnt == null)
+            throw bad_alloc() ;
+#endif
+    }
+    rEnt &lrEnt = mpEnt[miEntCnt++] ;
+    lrEnt.icTyp = acTyp ;
+    lrEnt.iiOrg = aiOrg ;
+    lrEnt.iiNew = aiNew ;
+    lrEnt.iiJob = aiJob ;
+}
+
+/*
+ * Full name of a file of a tree
+ */
+const char *JDirDiff::ufPth (rTre const &arTre, int aiFil, char *acBuf)
+{
+    snprintf(acBuf, JDC_LIN, "%s/%s", arTre.isDir, arTre.ipFil[aiFil].isPth) ;
+    return acBuf ;
+}
+
+/**
+ * Sampled hash of a file: FNV-1a over the blocks at the start, the middle and
+ * the end (the whole file when it is small). Computed once.
+ */
+fkey JDirDiff::ufSmp (rTre &arTre, int aiFil)
+{
+    rFil &lrFil = arTre.ipFil[aiFil] ;
+    char lcPth[JDC_LIN] ;
+    uchar lcBuf[DIR_SMP] ;
+    off_t lzPos[3] ;
+    size_t llRed ;
+    fkey lkHsh = 0xcbf29ce484222325ULL ;
+    FILE *lpFil ;
+    int liBlk ;
+
+    if (lrFil.ibSmp)
+        return lrFil.ikSmp ;
+
+    lzPos[0] = 0 ;
+    lzPos[1] = (lrFil.izSze / 2) / DIR_SMP * DIR_SMP ;
+    lzPos[2] = (lrFil.izSze > DIR_SMP) ? lrFil.izSze - DIR_SMP : 0 ;
+    lpFil = jfopen(ufPth(arTre, aiFil, lcPth), "rb") ;
+    if (lpFil != null) {
+        for (liBlk = 0; liBlk < 3; liBlk++) {
+            if (liBlk > 0 && lzPos[liBlk] <= lzPos[liBlk - 1])
+                continue ;
+            if (jfseek(lpFil, lzPos[liBlk], SEEK_SET) != 0)
+                break ;
+            llRed = fread(lcBuf, 1, DIR_SMP, lpFil) ;
+            for (size_t llIdx = 0; llIdx < llRed; llIdx++) {
+                lkHsh ^= lcBuf[llIdx] ;
+                lkHsh *= 0x100000001b3ULL ;
+            }
+        }
+        jfclose(lpFil) ;
+    } else {
+        lkHsh = aiFil ;     // unreadable: matches nothing in the other tree (nearly)
+    }
+    lrFil.ikSmp = lkHsh ;
+    lrFil.ibSmp = true ;
+    return lkHsh ;
+} /* ufSmp */
+
+/**
+ * Compare the contents of two files
+ */
+bool JDirDiff::ufEql (const char *asOne, const char *asTwo)
+{
+    uchar lcOne[64 * 1024] ;
+    uchar lcTwo[64 * 1024] ;
+    size_t llOne, llTwo ;
+    bool lbEql = true ;
+    FILE *lpOne = jfopen(asOne, "rb") ;
+    FILE *lpTwo = jfopen(asTwo, "rb") ;
+
+    if (lpOne == null || lpTwo == null) {
+        lbEql = false ;
+    } else {
+        do {
+            llOne = fread(lcOne, 1, sizeof(lcOne), lpOne) ;
+            llTwo = fread(lcTwo, 1, sizeof(lcTwo), lpTwo) ;
+            lbEql = (llOne == llTwo && memcmp(lcOne, lcTwo, llOne) == 0) ;
+        } while (lbEql && llOne > 0) ;
+    }
+    if (lpOne != null) jfclose(lpOne) ;
+    if (lpTwo != null) jfclose(lpTwo) ;
+    return lbEql ;
+} /* ufEql */
+
+/**
+ * Copy azLen bytes from one file to another.
+ * @return 0 = ok, - EXI_RED / - EXI_WRI
+ */
+int JDirDiff::ufCpy (FILE *apInp, FILE *apOut, off_t azLen)
+{
+    char lcBuf[64 * 1024] ;
+    size_t llRed ;
+
+    while (azLen > 0) {
+        llRed = fread(lcBuf, 1, azLen < (off_t) sizeof(lcBuf) ? (size_t) azLen : sizeof(lcBuf), apInp) ;
+        if (llRed == 0)
+            return - EXI_RED ;
+        if (fwrite(lcBuf, 1, llRed, apOut) != llRed)
+            return - EXI_WRI ;
+        azLen -= llRed ;
+    }
+    return 0 ;
+} /* ufCpy */
+
+/*
+ * Compare two files on path (qsort)
+ */
+int JDirDiff::ufCmpPth (const void *apOne, const void *apTwo)
+{
+    return strcmp(((const rFil *) apOne)->isPth, ((const rFil *) apTwo)->isPth) ;
+}
+}
@@ -0,0 +1,208 @@
+/*
+ * JEngine.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+
+#include "JEngine.h"
+#include "JHashPos.h"
+#include "JMatchTable.h"
+
+namespace JojoDiff {
+
+/**
+ * Create an engine: one arena for both buffers, the hashtables and the matching table.
+ */
+JEngine::JEngine(const int aiHshSze, const long alBufSze, const int aiBlkSze,
+                 const int aiVerbse, const int abSrcBkt, const int aiSrcScn,
+                 const int aiMchMax, const int aiMchMin,
+                 const int aiAhdMax, const int aiCmpMod,
+                 const int aiLclSze, const bool abFpr, const int aiMchSze,
+                 const bool abOpt, const int aiBlkAln, const int aiAhdMin)
+{
+    size_t llAra ;
+
+    llAra = JArena::size(JHashPos::memsize(aiHshSze, abFpr))
+          + JArena::size(JMatchTable::memsize(aiMchSze))
+          + JArena::size(alBufSze) * 2 ;
+    if (aiSrcScn > 0 && aiLclSze > 0)
+        llAra += JArena::size(JHashPos::memsize(aiLclSze)) ;
+    mpAra = new JArena(llAra) ;
+
+#ifdef __MINGW32__
+    mpHdlOrg = null ;
+    mpHdlNew = null ;
+    mpFilOrg = new JFileEng(null, "Org", alBufSze, aiBlkSze, mpAra) ;
+    mpFilNew = new JFileEng(null, "New", alBufSze, aiBlkSze, mpAra) ;
+#else
+    mpFilOrg = new JFileEng(&moHdlOrg, "Org", alBufSze, aiBlkSze, mpAra) ;
+    mpFilNew = new JFileEng(&moHdlNew, "New", alBufSze, aiBlkSze, mpAra) ;
+#endif
+    mpOut = new JOutBin(null) ;
+    mpDiff = new JDiffT<JFileEng, JOutBin>(mpFilOrg, mpFilNew, mpOut,
+            aiHshSze, aiVerbse, abSrcBkt, aiSrcScn, aiMchMax, aiMchMin, aiAhdMax, aiCmpMod,
+            aiLclSze, 0, null, abFpr, aiMchSze, abOpt, aiBlkAln, aiAhdMin, mpAra) ;
+    mpMst = null ;
+    mpCat = null ;
+}
+
+/**
+ * Create an engine on a shared original: one arena for the cache and the new file's buffer.
+ */
+JEngine::JEngine(JDiff *apMst, JFileConcat const &aoCat, const long alBufSze, const int aiBlkSze)
+{
+    mpAra = new JArena(JArena::size(alBufSze) * 2) ;
+    mpMst = apMst ;
+    mpCat = new JFileConcat(aoCat, alBufSze, aiBlkSze, mpAra) ;
+    mpFilOrg = null ;
+#ifdef __MINGW32__
+    mpHdlOrg = null ;
+    mpHdlNew = null ;
+    mpFilNew = new JFileEng(null, "New", alBufSze, aiBlkSze, mpAra) ;
+#else
+    mpFilNew = new JFileEng(&moHdlNew, "New", alBufSze, aiBlkSze, mpAra) ;
+#endif
+    mpOut = new JOutBin(null) ;
+    mpDiff = new JDiff(*mpMst, mpCat, mpFilNew, mpOut) ;
+}
+
+/*
+ * Destructor: the users of the arena first
+ */
+JEngine::~JEngine() {
+    delete mpDiff ;
+    delete mpOut ;
+    delete mpFilOrg ;
+    delete mpFilNew ;
+    delete mpCat ;
+    delete mpAra ;
+}
+
+/**
+ * Compare one pair of files, reusing the tables and buffers of the previous pair.
+ */
+int JEngine::diff (const char *asFilOrg, const char *asFilNew, FILE *apFilOut)
+{
+    struct stat ltSttOrg ;
+    int liRet ;
+
+    if (mpMst != null)
+        return ufDiffCat(asFilOrg, asFilNew, apFilOut) ;
+
+    if (stat(asFilOrg, &ltSttOrg) != 0)
+        return - EXI_FRT ;
+
+#ifdef __MINGW32__
+    mpHdlOrg = jfopen(asFilOrg, "rb") ;
+    if (mpHdlOrg == null)
+        return - EXI_FRT ;
+    mpHdlNew = jfopen(asFilNew, "rb") ;
+    if (mpHdlNew == null) {
+        jfclose(mpHdlOrg) ;
+        return - EXI_SCD ;
+    }
+    mpFilOrg->reset(mpHdlOrg) ;
+    mpFilNew->reset(mpHdlNew) ;
+#else
+    moHdlOrg.open(asFilOrg, ios_base::in | ios_base::binary) ;
+    if (! moHdlOrg.is_open()) {
+        moHdlOrg.clear() ;
+        return - EXI_FRT ;
+    }
+    moHdlNew.open(asFilNew, ios_base::in | ios_base::binary) ;
+    if (! moHdlNew.is_open()) {
+        moHdlOrg.close() ;
+        moHdlOrg.clear() ;
+        moHdlNew.clear() ;
+        return - EXI_SCD ;
+    }
+    mpFilOrg->reset(&moHdlOrg) ;
+    mpFilNew->reset(&moHdlNew) ;
+#endif
+    mpOut->reset(apFilOut) ;
+
+    liRet = mpDiff->reset(ltSttOrg.st_size) ;
+    if (liRet == 0)
+        liRet = mpDiff->jdiff() ;
+
+#ifdef __MINGW32__
+    jfclose(mpHdlOrg) ;
+    jfclose(mpHdlNew) ;
+    mpHdlOrg = null ;
+    mpHdlNew = null ;
+#else
+    moHdlOrg.close() ;
+    moHdlNew.close() ;
+    moHdlOrg.clear() ;
+    moHdlNew.clear() ;
+#endif
+    return liRet ;
+} /* diff */
+
+/**
+ * Compare a new file against the shared original, starting on the given member:
+ * the engine's JDiff on the master's hashtable is reset and positioned by a
+ * leading DEL, so a pair allocates nothing.
+ */
+int JEngine::ufDiffCat (const char *asFilOrg, const char *asFilNew, FILE *apFilOut)
+{
+    off_t lzBegOrg = 0 ;
+    int liRet ;
+
+    if (asFilOrg != null) {
+        int liMbr = mpCat->find(asFilOrg) ;
+        if (liMbr < 0)
+            return - EXI_FRT ;
+        lzBegOrg = mpCat->offset(liMbr) ;
+    }
+
+#ifdef __MINGW32__
+    mpHdlNew = jfopen(asFilNew, "rb") ;
+    if (mpHdlNew == null)
+        return - EXI_SCD ;
+    mpFilNew->reset(mpHdlNew) ;
+#else
+    moHdlNew.open(asFilNew, ios_base::in | ios_base::binary) ;
+    if (! moHdlNew.is_open()) {
+        moHdlNew.clear() ;
+        return - EXI_SCD ;
+    }
+    mpFilNew->reset(&moHdlNew) ;
+#endif
+    mpOut->reset(apFilOut) ;
+
+    liRet = mpDiff->reset(0) ;
+    if (liRet == 0 && lzBegOrg > 0) {
+        mpOut->put(DEL, lzBegOrg, 0, 0, 0, 0) ;
+        mpDiff->setRange(lzBegOrg, 0, MAX_OFF_T) ;
+    }
+    if (liRet == 0)
+        liRet = mpDiff->jdiff() ;
+
+#ifdef __MINGW32__
+    jfclose(mpHdlNew) ;
+    mpHdlNew = null ;
+#else
+    moHdlNew.close() ;
+    moHdlNew.clear() ;
+#endif
+    return liRet ;
+} /* ufDiffCat */
+}
@@ -25,16 +25,21 @@
 
 #include "JFileAhead.h"
 #include "JDebug.h"
+#include "JHugeMem.h"
 
 namespace JojoDiff {
 
 /**
  * Construct a buffered JFile on an istream.
  */
-JFileAhead::JFileAhead(FILE * apFil, const char *asFid, const long alBufSze, const int aiBlkSze ) :
-        mpFile(apFil), mlBufSze(alBufSze), miBlkSze(aiBlkSze), mlFabSek(0)
+JFileAhead::JFileAhead(FILE * apFil, const char *asFid, const long alBufSze, const int aiBlkSze,
+        JArena *apAra ) :
+        mpFile(apFil), mlBufSze(alBufSze), mpAra(apAra), miBlkSze(aiBlkSze), mlFabSek(0), mlFabTim(0)
 {
-    mpBuf = (uchar *) malloc(mlBufSze) ;
+    if (mpAra != null)
+        mpBuf = (uchar *) mpAra->alloc(mlBufSze) ;
+    else
+        mpBuf = (uchar *) JHugeMem::alloc(mlBufSze) ;
 
     mpMax = mpBuf + mlBufSze ;
     mpInp = mpBuf;
@@ -55,7 +60,23 @@ JFileAhead::JFileAhead(FILE * apFil, const char *asFid, const long alBufSze, con
     }
 
 JFileAhead::~JFileAhead() {
-	if (mpBuf != null) free(mpBuf) ;
+	if (mpBuf != null && mpAra == null) JHugeMem::free(mpBuf, mlBufSze) ;
+}
+
+/**
+ * Restart on another file: the buffer is kept, its contents are dropped.
+ */
+void JFileAhead::reset(FILE * apFil){
+    mpFile = apFil ;
+    mpInp = mpBuf;
+    mpRed = mpInp;
+    miBufUsd = 0;
+    mzPosInp = 0;
+    mzPosEof = MAX_OFF_T ;
+    mzPosRed = 0 ;
+    miRedSze = 0 ;
+    mlFabSek = 0 ;
+    mlFabTim = 0 ;
 }
 
 /**
@@ -64,25 +85,34 @@ JFileAhead::~JFileAhead() {
 long JFileAhead::seekcount(){return mlFabSek; }
 
 /**
- * Gets one byte from the lookahead file.
+ * Return average seek latency in microseconds (0 = unknown).
  */
-int JFileAhead::get (
-    const off_t &azPos, /* position to read from                */
-    const int aiTyp     /* 0=read, 1=hard ahead, 2=soft ahead   */
+long JFileAhead::seektime(){return (mlFabSek == 0) ? 0 : (long) (mlFabTim / mlFabSek); }
+
+/**
+ * Get the address of buffered data at given position, without reading from the file.
+ * The data is contiguous up to the end of the buffer or up to the input position.
+ */
+const uchar *JFileAhead::getbuf (
+    const off_t &azPos, /* position to look for                 */
+    int &aiLen          /* out: number of contiguous bytes      */
 ) {
-    if ((miRedSze > 0) && (azPos == mzPosRed)) {
-        mzPosRed++ ;
-        miRedSze--;
-        #if debug
-        if (JDebug::gbDbg[DBGRED])
-          fprintf(JDebug::stddbg, "ufFabGet(%s,"P8zd",%d)->%2x (mem %p).\n",
-             msFid, azPos, aiTyp, *mpRed, mpRed);
-        #endif
-        return *mpRed++;
-    } else {
-        return get_frombuffer(azPos, aiTyp);
+    uchar *lpDta ;
+
+    if (azPos >= mzPosInp || azPos < mzPosInp - miBufUsd) {
+        aiLen = 0 ;
+        return null ;
     }
-} /* int get(...) */
+
+    lpDta = mpInp - (mzPosInp - azPos) ;
+    if ( lpDta < mpBuf )
+        lpDta += mlBufSze ;
+    if (lpDta < mpInp)
+        aiLen = mpInp - lpDta ;
+    else
+        aiLen = mpMax - lpDta ;
+    return lpDta ;
+}
 
 /**
  * Retrieves requested position into the buffer, trying to keep the buffer as
@@ -183,6 +213,7 @@ int JFileAhead::get_outofbuffer (
 ){
     int liTdo ;         /* number of bytes to read */
     int liDne ;         /* number of bytes read */
+    long long llTim=0 ; /* start time of a seeking read */
     uchar *lpInp ;      /* place in buffer to read to */
     off_t lzPos ;       /* position to seek */
 
@@ -272,6 +303,7 @@ int JFileAhead::get_outofbuffer (
         if (JDebug::gbDbg[DBGBUF]) fprintf(JDebug::stddbg, "ufFabGet: Seek %"PRIzd".\n", azPos);
         #endif
 
+        llTim = ustime() ;
         mlFabSek++ ;
         if (jfseek(mpFile, lzPos, SEEK_SET) != 0) {
             return - EXI_SEK ;
@@ -280,6 +312,8 @@ int JFileAhead::get_outofbuffer (
 
     /* Read a chunk of data (in 16 kbyte blocks) */
     liDne = fread(lpInp, 1, liTdo, mpFile );
+    if (aiSek != 0)
+        mlFabTim += ustime() - llTim ;
     if (liDne < liTdo) {
       #if debug
       if (JDebug::gbDbg[DBGRED])
@@ -0,0 +1,311 @@
+/*
+ * JFileConcat.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "JFileConcat.h"
+#include "JHugeMem.h"
+#include "JDebug.h"
+
+using namespace std ;
+
+namespace JojoDiff {
+
+/**
+ * Create an empty concatenation, owning its member list.
+ */
+JFileConcat::JFileConcat(const char *asFid, const long alBufSze, const int aiBlkSze, JArena *apAra)
+: msFid(asFid), mbOwn(true), mpAra(apAra), mlBufSze(alBufSze), miBlkSze(aiBlkSze)
+{
+    mpLst = new rLst ;
+    mpLst->ipMbr = null ;
+    mpLst->ipSrt = null ;
+    mpLst->iiCnt = 0 ;
+    mpLst->iiMax = 0 ;
+    mpLst->izSze = 0 ;
+    ufAlc() ;
+}
+
+/**
+ * Create a concatenation on the member list of another one.
+ */
+JFileConcat::JFileConcat(JFileConcat const &aoCat, const long alBufSze, const int aiBlkSze, JArena *apAra)
+: msFid(aoCat.msFid), mpLst(aoCat.mpLst), mbOwn(false), mpAra(apAra), mlBufSze(alBufSze), miBlkSze(aiBlkSze)
+{
+    ufAlc() ;
+}
+
+/*
+ * Destructor
+ */
+JFileConcat::~JFileConcat() {
+    if (mpHdl != null)
+        jfclose(mpHdl) ;
+    if (mpAra == null)
+        JHugeMem::free(mpBuf, (size_t) miBlkCnt * miBlkSze) ;
+    free(mpTag) ;
+    if (mbOwn) {
+        for (int liMbr = 0; liMbr < mpLst->iiCnt; liMbr++) free(mpLst->ipMbr[liMbr].isFil) ;
+        free(mpLst->ipMbr) ;
+        free(mpLst->ipSrt) ;
+        delete mpLst ;
+    }
+}
+
+/*
+ * Allocate the cache: at least two blocks
+ */
+void JFileConcat::ufAlc ()
+{
+    if (miBlkSze < 256) miBlkSze = 256 ;
+    miBlkCnt = mlBufSze / miBlkSze ;
+    if (miBlkCnt < 2) miBlkCnt = 2 ;
+
+    if (mpAra != null)
+        mpBuf = (uchar *) mpAra->alloc((size_t) miBlkCnt * miBlkSze) ;
+    else
+        mpBuf = (uchar *) JHugeMem::alloc((size_t) miBlkCnt * miBlkSze) ;
+    mpTag = (off_t *) malloc(miBlkCnt * sizeof(off_t)) ;
+#ifndef __MINGW32__
+    if (mpBuf == null || mpTag == null)
+        throw bad_alloc() ;
+#endif
+    for (int liSlt = 0; liSlt < miBlkCnt; liSlt++) mpTag[liSlt] = -1 ;
+
+    mzCurBeg = 0 ;
+    mzCurEnd = 0 ;
+    mpCur = mpBuf ;
+    mpHdl = null ;
+    miHdlMbr = -1 ;
+    mzHdlPos = 0 ;
+    mlSekCnt = 0 ;
+    mlSekTim = 0 ;
+}
+
+/**
+ * Append a member: the member list is kept sorted on name as well, for find.
+ */
+int JFileConcat::add (const char *asFil, off_t azSze)
+{
+    rLst &lrLst = *mpLst ;
+    int liLow ;
+    int liHig ;
+
+    if (lrLst.iiCnt == lrLst.iiMax) {
+        lrLst.iiMax = (lrLst.iiMax == 0) ? 256 : lrLst.iiMax * 2 ;
+        lrLst.ipMbr = (rMbr *) realloc(lrLst.ipMbr, lrLst.iiMax * sizeof(rMbr)) ;
+        lrLst.ipSrt = (int *) realloc(lrLst.ipSrt, lrLst.iiMax * sizeof(int)) ;
+#ifndef __MINGW32__
+        if (lrLst.ipMbr == null || lrLst.ipSrt == null)
+            throw bad_alloc() ;
+#endif
+    }
+    rMbr &lrMbr = lrLst.ipMbr[lrLst.iiCnt] ;
+    lrMbr.isFil = strdup(asFil) ;
+    lrMbr.izBeg = lrLst.izSze ;
+    lrMbr.izSze = azSze ;
+    lrLst.izSze += azSze ;
+
+    /* Insert into the sorted list (members are mostly added in order) */
+    for (liLow = 0, liHig = lrLst.iiCnt; liLow < liHig; ) {
+        int liMid = (liLow + liHig) / 2 ;
+        if (strcmp(lrLst.ipMbr[lrLst.ipSrt[liMid]].isFil, asFil) <= 0)
+            liLow = liMid + 1 ;
+        else
+            liHig = liMid ;
+    }
+    memmove(&lrLst.ipSrt[liLow + 1], &lrLst.ipSrt[liLow], (lrLst.iiCnt - liLow) * sizeof(int)) ;
+    lrLst.ipSrt[liLow] = lrLst.iiCnt ;
+
+    return lrLst.iiCnt++ ;
+} /* add */
+
+/**
+ * Number of a member on name (-1 = none)
+ */
+int JFileConcat::find (const char *asFil) const
+{
+    int liLow = 0 ;
+    int liHig = mpLst->iiCnt ;
+
+    while (liLow < liHig) {
+        int liMid = (liLow + liHig) / 2 ;
+        int liCmp = strcmp(mpLst->ipMbr[mpLst->ipSrt[liMid]].isFil, asFil) ;
+        if (liCmp == 0)
+            return mpLst->ipSrt[liMid] ;
+        if (liCmp < 0)
+            liLow = liMid + 1 ;
+        else
+            liHig = liMid ;
+    }
+    return -1 ;
+} /* find */
+
+/**
+ * Get a byte through the cache, reading its block when needed.
+ */
+int JFileConcat::get_fromcache (const off_t &azPos, const int aiTyp)
+{
+    off_t lzBlk ;
+    int liSlt ;
+
+    if (azPos < 0 || azPos >= mpLst->izSze)
+        return EOF ;
+
+    lzBlk = azPos / miBlkSze ;
+    liSlt = (int) (lzBlk % miBlkCnt) ;
+    if (mpTag[liSlt] != lzBlk) {
+        if (aiTyp == 2)
+            return EOB ;
+        if (ufRed(lzBlk, liSlt) < 0)
+            return EOF ;
+    }
+
+    mzCurBeg = lzBlk * miBlkSze ;
+    mzCurEnd = mzCurBeg + miBlkSze ;
+    if (mzCurEnd > mpLst->izSze)
+        mzCurEnd = mpLst->izSze ;
+    mpCur = mpBuf + (size_t) liSlt * miBlkSze ;
+
+#if debug
+    if (JDebug::gbDbg[DBGRED])
+      fprintf(JDebug::stddbg, "JFileConcat::get(%s," P8zd ",%d)->%2x (slot %d).\n",
+         msFid, azPos, aiTyp, mpCur[azPos - mzCurBeg], liSlt);
+#endif
+    return mpCur[azPos - mzCurBeg] ;
+} /* get_fromcache */
+
+/**
+ * Get the address of cached data: up to the end of its block.
+ */
+const uchar *JFileConcat::getbuf (const off_t &azPos, int &aiLen)
+{
+    off_t lzBlk ;
+    off_t lzEnd ;
+    int liSlt ;
+
+    aiLen = 0 ;
+    if (azPos < 0 || azPos >= mpLst->izSze)
+        return null ;
+
+    lzBlk = azPos / miBlkSze ;
+    liSlt = (int) (lzBlk % miBlkCnt) ;
+    if (mpTag[liSlt] != lzBlk)
+        return null ;
+
+    lzEnd = (lzBlk + 1) * miBlkSze ;
+    if (lzEnd > mpLst->izSze)
+        lzEnd = mpLst->izSze ;
+    aiLen = (int) (lzEnd - azPos) ;
+    return mpBuf + (size_t) liSlt * miBlkSze + (azPos - lzBlk * miBlkSze) ;
+} /* getbuf */
+
+/**
+ * Read a block of the virtual file into a cache block, member by member.
+ * @return 0 = ok, - EXI_FRT = member cannot be opened, - EXI_RED = member is too short
+ */
+int JFileConcat::ufRed (off_t azBlk, int aiSlt)
+{
+    uchar *lpInp = mpBuf + (size_t) aiSlt * miBlkSze ;
+    off_t lzPos = azBlk * miBlkSze ;
+    off_t lzEnd = lzPos + miBlkSze ;
+    int liMbr ;
+
+    if (lzEnd > mpLst->izSze)
+        lzEnd = mpLst->izSze ;
+
+    /* The current block may be the one we overwrite */
+    if (mpCur == lpInp) {
+        mzCurBeg = 0 ;
+        mzCurEnd = 0 ;
+    }
+    mpTag[aiSlt] = -1 ;
+
+    for (liMbr = ufMbr(lzPos); lzPos < lzEnd; liMbr++) {
+        rMbr &lrMbr = mpLst->ipMbr[liMbr] ;
+        off_t lzOff = lzPos - lrMbr.izBeg ;
+        size_t llTdo ;
+        long long llTim = 0 ;
+
+        if (lzOff >= lrMbr.izSze)
+            continue ;      // empty member
+        llTdo = (size_t) ((lrMbr.izBeg + lrMbr.izSze < lzEnd ? lrMbr.izBeg + lrMbr.izSze : lzEnd) - lzPos) ;
+
+        /* Open the member, or position within it */
+        if (miHdlMbr != liMbr) {
+            if (mpHdl != null)
+                jfclose(mpHdl) ;
+            mpHdl = jfopen(lrMbr.isFil, "rb") ;
+            if (mpHdl == null) {
+                miHdlMbr = -1 ;
+                return - EXI_FRT ;
+            }
+            miHdlMbr = liMbr ;
+            mzHdlPos = 0 ;
+        }
+        if (mzHdlPos != lzOff) {
+            llTim = ustime() ;
+            if (jfseek(mpHdl, lzOff, SEEK_SET) != 0)
+                return - EXI_SEK ;
+            mlSekCnt++ ;
+        }
+        if (fread(lpInp, 1, llTdo, mpHdl) != llTdo) {
+            jfclose(mpHdl) ;
+            mpHdl = null ;
+            miHdlMbr = -1 ;
+            return - EXI_RED ;
+        }
+        if (llTim > 0)
+            mlSekTim += ustime() - llTim ;
+
+#if debug
+        if (JDebug::gbDbg[DBGRED])
+          fprintf(JDebug::stddbg, "JFileConcat::ufRed(%s) member %d " P8zd " " P8zd " into slot %d.\n",
+             msFid, liMbr, lzOff, (off_t) llTdo, aiSlt);
+#endif
+        mzHdlPos = lzOff + llTdo ;
+        lzPos += llTdo ;
+        lpInp += llTdo ;
+    }
+    mpTag[aiSlt] = azBlk ;
+    return 0 ;
+} /* ufRed */
+
+/*
+ * Member holding the given position: the last one starting at or before it
+ */
+int JFileConcat::ufMbr (off_t azPos) const
+{
+    int liLow = 0 ;
+    int liHig = mpLst->iiCnt ;
+
+    while (liLow < liHig) {
+        int liMid = (liLow + liHig) / 2 ;
+        if (mpLst->ipMbr[liMid].izBeg <= azPos)
+            liLow = liMid + 1 ;
+        else
+            liHig = liMid ;
+    }
+    return liLow - 1 ;
+} /* ufMbr */
+}
@@ -25,16 +25,21 @@
 
 #include "JFileIStreamAhead.h"
 #include "JDebug.h"
+#include "JHugeMem.h"
 
 namespace JojoDiff {
 
 /**
  * Construct a buffered JFile on an istream.
  */
-JFileIStreamAhead::JFileIStreamAhead(istream * apFil, const char *asFid, const long alBufSze, const int aiBlkSze ) :
-        mpStream(apFil), mlBufSze(alBufSze), miBlkSze(aiBlkSze), mlFabSek(0)
+JFileIStreamAhead::JFileIStreamAhead(istream * apFil, const char *asFid, const long alBufSze, const int aiBlkSze,
+        JArena *apAra ) :
+        mpStream(apFil), mlBufSze(alBufSze), mpAra(apAra), miBlkSze(aiBlkSze), mlFabSek(0), mlFabTim(0)
 {
-    mpBuf = (uchar *) malloc(mlBufSze) ;
+    if (mpAra != null)
+        mpBuf = (uchar *) mpAra->alloc(mlBufSze) ;
+    else
+        mpBuf = (uchar *) JHugeMem::alloc(mlBufSze) ;
 #ifndef __MINGW32__
     if (mpBuf == null){
         throw bad_alloc() ;
@@ -60,7 +65,23 @@ JFileIStreamAhead::JFileIStreamAhead(istream * apFil, const char *asFid, const l
     }
 
 JFileIStreamAhead::~JFileIStreamAhead() {
-	if (mpBuf != null) free(mpBuf) ;
+	if (mpBuf != null && mpAra == null) JHugeMem::free(mpBuf, mlBufSze) ;
+}
+
+/**
+ * Restart on another file: the buffer is kept, its contents are dropped.
+ */
+void JFileIStreamAhead::reset(istream * apFil){
+    mpStream = apFil ;
+    mpInp = mpBuf;
+    mpRed = mpInp;
+    miBufUsd = 0;
+    mzPosInp = 0;
+    mzPosEof = MAX_OFF_T ;
+    mzPosRed = 0 ;
+    miRedSze = 0 ;
+    mlFabSek = 0 ;
+    mlFabTim = 0 ;
 }
 
 /**
@@ -69,25 +90,34 @@ JFileIStreamAhead::~JFileIStreamAhead() {
 long JFileIStreamAhead::seekcount(){return mlFabSek; }
 
 /**
- * Gets one byte from the lookahead file.
+ * Return average seek latency in microseconds (0 = unknown).
  */
-int JFileIStreamAhead::get (
-    const off_t &azPos, /* position to read from                */
-    const int aiTyp     /* 0=read, 1=hard ahead, 2=soft ahead   */
+long JFileIStreamAhead::seektime(){return (mlFabSek == 0) ? 0 : (long) (mlFabTim / mlFabSek); }
+
+/**
+ * Get the address of buffered data at given position, without reading from the file.
+ * The data is contiguous up to the end of the buffer or up to the input position.
+ */
+const uchar *JFileIStreamAhead::getbuf (
+    const off_t &azPos, /* position to look for                 */
+    int &aiLen          /* out: number of contiguous bytes      */
 ) {
-    if ((miRedSze > 0) && (azPos == mzPosRed)) {
-        mzPosRed++ ;
-        miRedSze--;
-        #if debug
-        if (JDebug::gbDbg[DBGRED])
-          fprintf(JDebug::stddbg, "ufFabGet(%s,"P8zd",%d)->%2x (mem %p).\n",
-             msFid, azPos, aiTyp, *mpRed, mpRed);
-        #endif
-        return *mpRed++;
-    } else {
-        return get_frombuffer(azPos, aiTyp);
+    uchar *lpDta ;
+
+    if (azPos >= mzPosInp || azPos < mzPosInp - miBufUsd) {
+        aiLen = 0 ;
+        return null ;
     }
-} /* int get(...) */
+
+    lpDta = mpInp - (mzPosInp - azPos) ;
+    if ( lpDta < mpBuf )
+        lpDta += mlBufSze ;
+    if (lpDta < mpInp)
+        aiLen = mpInp - lpDta ;
+    else
+        aiLen = mpMax - lpDta ;
+    return lpDta ;
+}
 
 /**
  * Retrieves requested position into the buffer, trying to keep the buffer as
@@ -188,6 +218,7 @@ int JFileIStreamAhead::get_outofbuffer (
 ){
     int liTdo ;         /* number of bytes to read */
     int liDne ;         /* number of bytes read */
+    long long llTim=0 ; /* start time of a seeking read */
     uchar *lpInp ;      /* place in buffer to read to */
     off_t lzPos ;       /* position to seek */
 
@@ -271,6 +302,7 @@ int JFileIStreamAhead::get_outofbuffer (
         if (JDebug::gbDbg[DBGBUF]) fprintf(JDebug::stddbg, "ufFabGet: Seek %"PRIzd".\n", azPos);
         #endif
 
+        llTim = ustime() ;
         mlFabSek++ ;
         mpStream->seekg(lzPos) ; // throws an exception in case of error
     } /* if liSek */
@@ -278,6 +310,8 @@ int JFileIStreamAhead::get_outofbuffer (
     /* Read a chunk of data (in 16 kbyte blocks) */
     mpStream->read((char *)lpInp, liTdo) ;
     liDne = mpStream->gcount();
+    if (aiSek != 0)
+        mlFabTim += ustime() - llTim ;
     if (liDne < liTdo) {
       #if debug
       if (JDebug::gbDbg[DBGRED])
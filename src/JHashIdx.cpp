@@ -0,0 +1,350 @@
+/*
+ * JHashIdx.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+using namespace std;
+
+#ifndef __MINGW32__
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "JHashIdx.h"
+
+namespace JojoDiff {
+
+/**
+ * Create a new external index.
+ *
+ * @param aiSmpRat  sample rate: keep one sample out of aiSmpRat (on average)
+ * @param asDir     directory for temporary files (null = system default)
+ * @param alRunSze  number of samples in a run (in-memory sort buffer)
+ */
+JHashIdx::JHashIdx(int aiSmpRat, const char *asDir, long alRunSze)
+: miSmpRat(aiSmpRat < 1 ? 1 : aiSmpRat), msDir(asDir),
+  mlRunSze(alRunSze), mlRunCnt(0),
+  mpRunFil(null), miRunCnt(0), miRunMax(0), miRunTot(0),
+  mpIdxFil(null), mpIdx(null), mzIdxCnt(0)
+{
+    mpRun = (rIdx *) malloc(mlRunSze * sizeof(rIdx)) ;
+#ifndef __MINGW32__
+    if (mpRun == null) {
+        throw bad_alloc() ;
+    }
+#endif
+}
+
+/*
+ * Destructor
+ */
+JHashIdx::~JHashIdx() {
+    if (mpIdx != null) {
+#ifndef __MINGW32__
+        munmap(mpIdx, mzIdxCnt * sizeof(rIdx)) ;
+#else
+        free(mpIdx) ;
+#endif
+    }
+    if (mpIdxFil != null) fclose(mpIdxFil) ;
+    for (int liRun = 0; liRun < miRunCnt; liRun++)
+        fclose(mpRunFil[liRun]) ;
+    free(mpRunFil) ;
+    free(mpRun) ;
+}
+
+/**
+ * Index insert
+ * @param akCurHsh      Hash key to add
+ * @param azPos         Position to add
+ * @param aiEqlCnt      Quality of the sample
+ * @return 0 = ok, < 0 = error
+ */
+int JHashIdx::add (hkey akCurHsh, off_t azPos, int aiEqlCnt ){
+    /* only keep good samples that belong to the sampled set */
+    if (aiEqlCnt > SMPSZE - 4 || ! sample(akCurHsh))
+        return 0 ;
+
+    mpRun[mlRunCnt].ikHsh = akCurHsh ;
+    mpRun[mlRunCnt].izPos = azPos ;
+    mlRunCnt ++ ;
+
+    /* write out the run when the buffer is full */
+    if (mlRunCnt == mlRunSze)
+        return ufRunWri() ;
+    return 0 ;
+}
+
+/**
+ * Terminates the prescan: writes out the last run, merges all runs
+ * into one index and maps this index into memory.
+ * @return 0 = ok, < 0 = error
+ */
+int JHashIdx::close (){
+    int liRet ;
+
+    /* write out last run */
+    if (mlRunCnt > 0 || miRunCnt == 0) {
+        liRet = ufRunWri() ;
+        if (liRet < 0) return liRet ;
+    }
+
+    /* merge runs, at most IDX_FAN at a time */
+    while (miRunCnt > 1) {
+        int liOut = 0 ;
+        for (int liBeg = 0; liBeg < miRunCnt; liBeg += IDX_FAN) {
+            int liCnt = (miRunCnt - liBeg < IDX_FAN) ? miRunCnt - liBeg : IDX_FAN ;
+            FILE *lpMrg = ufRunMrg(&mpRunFil[liBeg], liCnt) ;
+            if (lpMrg == null) return - EXI_WRI ;
+            mpRunFil[liOut++] = lpMrg ;
+        }
+        miRunCnt = liOut ;
+    }
+
+    /* the last remaining run is the index */
+    mpIdxFil = mpRunFil[0] ;
+    miRunCnt = 0 ;
+
+    /* the run buffer is no longer needed */
+    free(mpRun) ;
+    mpRun = null ;
+
+    return ufIdxMap() ;
+}
+
+/**
+ * Batched index lookup. Keys are sorted and resolved in one ascending sweep
+ * over the index.
+ *
+ * @param akCurHsh  in:  keys to lookup
+ * @param azPos     out: positions found, -1 if not found
+ * @param aiCnt     number of keys (at most IDX_BAT)
+ * @return          number of keys found
+ */
+int JHashIdx::get (hkey const *akCurHsh, off_t *azPos, int aiCnt){
+    rIdx lsKey[IDX_BAT] ;   // keys to lookup, izPos = index within the batch
+    int liIdx ;
+    off_t lzLow = 0 ;       // lowest index position still to search
+    off_t lzHgh ;
+    off_t lzMid ;
+    int liHit = 0 ;
+
+    for (liIdx = 0; liIdx < aiCnt; liIdx++){
+        lsKey[liIdx].ikHsh = akCurHsh[liIdx] ;
+        lsKey[liIdx].izPos = liIdx ;
+        azPos[liIdx] = -1 ;
+    }
+    qsort(lsKey, aiCnt, sizeof(rIdx), ufCmp) ;
+
+    for (liIdx = 0; liIdx < aiCnt && lzLow < mzIdxCnt; liIdx++){
+        /* binary search for the first element >= key */
+        lzHgh = mzIdxCnt ;
+        while (lzLow < lzHgh) {
+            lzMid = lzLow + (lzHgh - lzLow) / 2 ;
+            if (mpIdx[lzMid].ikHsh < lsKey[liIdx].ikHsh)
+                lzLow = lzMid + 1 ;
+            else
+                lzHgh = lzMid ;
+        }
+        if (lzLow < mzIdxCnt && mpIdx[lzLow].ikHsh == lsKey[liIdx].ikHsh) {
+            azPos[lsKey[liIdx].izPos] = mpIdx[lzLow].izPos ;
+            liHit ++ ;
+        }
+    }
+    return liHit ;
+}
+
+/**
+ * Create a temporary file, in msDir if specified. The file is removed when closed.
+ */
+FILE *JHashIdx::ufTmpFil (){
+#ifndef __MINGW32__
+    if (msDir != null) {
+        char lsNam[1024] ;
+        snprintf(lsNam, sizeof(lsNam), "%s/jdiffidxXXXXXX", msDir) ;
+        int liFd = mkstemp(lsNam) ;
+        if (liFd < 0) return null ;
+        unlink(lsNam) ;
+        return fdopen(liFd, "w+b") ;
+    }
+#endif
+    return tmpfile() ;
+}
+
+/**
+ * Sort the run buffer and write it to a new run file (dropping duplicate keys).
+ * @return 0 = ok, < 0 = error
+ */
+int JHashIdx::ufRunWri (){
+    FILE *lpRun ;
+    long llIdx ;
+
+    qsort(mpRun, mlRunCnt, sizeof(rIdx), ufCmp) ;
+
+    lpRun = ufTmpFil() ;
+    if (lpRun == null)
+        return - EXI_WRI ;
+    for (llIdx = 0; llIdx < mlRunCnt; llIdx++){
+        if (llIdx == 0 || mpRun[llIdx].ikHsh != mpRun[llIdx - 1].ikHsh) {
+            if (fwrite(&mpRun[llIdx], sizeof(rIdx), 1, lpRun) != 1) {
+                fclose(lpRun) ;
+                return - EXI_WRI ;
+            }
+        }
+    }
+
+    if (miRunCnt == miRunMax) {
+        miRunMax = (miRunMax == 0) ? 16 : miRunMax * 2 ;
+        mpRunFil = (FILE **) realloc(mpRunFil, miRunMax * sizeof(FILE *)) ;
+#ifndef __MINGW32__
+        if (mpRunFil == null) {
+            throw bad_alloc() ;
+        }
+#endif
+    }
+    mpRunFil[miRunCnt++] = lpRun ;
+    miRunTot ++ ;
+    mlRunCnt = 0 ;
+
+    #if debug
+    if (JDebug::gbDbg[DBGHSH])
+        fprintf(JDebug::stddbg, "Index run %d written.\n", miRunTot) ;
+    #endif
+
+    return 0 ;
+}
+
+/**
+ * Merge the given runs into one new run (dropping duplicate keys).
+ * The given runs are closed.
+ * @return merged run, null on error
+ */
+FILE *JHashIdx::ufRunMrg (FILE **apRun, int aiCnt){
+    rIdx lsHed[IDX_FAN] ;   // head element of each run
+    int  liHep[IDX_FAN] ;   // heap of runs, ordered on head element
+    int  liHepCnt = 0 ;
+    int  liIdx, liPar, liChd, liRun ;
+    bool lbFst = true ;
+    hkey lkLst = 0 ;
+    FILE *lpOut ;
+
+    lpOut = ufTmpFil() ;
+    if (lpOut == null)
+        return null ;
+
+    /* read first element of each run into the heap */
+    for (liRun = 0; liRun < aiCnt; liRun++){
+        rewind(apRun[liRun]) ;
+        if (fread(&lsHed[liRun], sizeof(rIdx), 1, apRun[liRun]) == 1) {
+            /* sift up */
+            for (liIdx = liHepCnt++; liIdx > 0; liIdx = liPar) {
+                liPar = (liIdx - 1) / 2 ;
+                if (ufCmp(&lsHed[liHep[liPar]], &lsHed[liRun]) <= 0) break ;
+                liHep[liIdx] = liHep[liPar] ;
+            }
+            liHep[liIdx] = liRun ;
+        }
+    }
+
+    /* repeatedly output the smallest head element */
+    while (liHepCnt > 0) {
+        liRun = liHep[0] ;
+        if (lbFst || lsHed[liRun].ikHsh != lkLst) {
+            if (fwrite(&lsHed[liRun], sizeof(rIdx), 1, lpOut) != 1) {
+                fclose(lpOut) ;
+                return null ;
+            }
+            lkLst = lsHed[liRun].ikHsh ;
+            lbFst = false ;
+        }
+
+        /* replace by next element of the same run, or remove the run */
+        if (fread(&lsHed[liRun], sizeof(rIdx), 1, apRun[liRun]) != 1) {
+            liRun = liHep[--liHepCnt] ;
+        }
+
+        /* sift down */
+        for (liIdx = 0; (liChd = liIdx * 2 + 1) < liHepCnt; liIdx = liChd) {
+            if (liChd + 1 < liHepCnt && ufCmp(&lsHed[liHep[liChd + 1]], &lsHed[liHep[liChd]]) < 0)
+                liChd ++ ;
+            if (ufCmp(&lsHed[liRun], &lsHed[liHep[liChd]]) <= 0) break ;
+            liHep[liIdx] = liHep[liChd] ;
+        }
+        if (liHepCnt > 0)
+            liHep[liIdx] = liRun ;
+    }
+
+    for (liRun = 0; liRun < aiCnt; liRun++)
+        fclose(apRun[liRun]) ;
+
+    return lpOut ;
+}
+
+/**
+ * Map the final index into memory.
+ * @return 0 = ok, < 0 = error
+ */
+int JHashIdx::ufIdxMap (){
+    if (fflush(mpIdxFil) != 0)
+        return - EXI_WRI ;
+    if (jfseek(mpIdxFil, 0, SEEK_END) != 0)
+        return - EXI_SEK ;
+    mzIdxCnt = jftell(mpIdxFil) / sizeof(rIdx) ;
+    if (mzIdxCnt == 0)
+        return 0 ;
+
+#ifndef __MINGW32__
+    void *lpMap = mmap(null, mzIdxCnt * sizeof(rIdx), PROT_READ, MAP_SHARED, fileno(mpIdxFil), 0) ;
+    if (lpMap == MAP_FAILED) {
+        mzIdxCnt = 0 ;
+        return - EXI_MEM ;
+    }
+    mpIdx = (rIdx *) lpMap ;
+#else
+    /* no mmap: read the index into memory */
+    mpIdx = (rIdx *) malloc(mzIdxCnt * sizeof(rIdx)) ;
+    if (mpIdx == null) {
+        mzIdxCnt = 0 ;
+        return - EXI_MEM ;
+    }
+    rewind(mpIdxFil) ;
+    if (fread(mpIdx, sizeof(rIdx), mzIdxCnt, mpIdxFil) != (size_t) mzIdxCnt) {
+        return - EXI_RED ;
+    }
+#endif
+    return 0 ;
+}
+
+/**
+ * Compare two index elements on key, then on descending position: duplicate keys
+ * keep their last position within the original file, like the hashtable does.
+ */
+int JHashIdx::ufCmp (const void *apOne, const void *apTwo){
+    const rIdx *lpOne = (const rIdx *) apOne ;
+    const rIdx *lpTwo = (const rIdx *) apTwo ;
+    if (lpOne->ikHsh < lpTwo->ikHsh) return -1 ;
+    if (lpOne->ikHsh > lpTwo->ikHsh) return 1 ;
+    if (lpOne->izPos > lpTwo->izPos) return -1 ;
+    if (lpOne->izPos < lpTwo->izPos) return 1 ;
+    return 0 ;
+}
+} /* namespace */
@@ -26,6 +26,7 @@
 using namespace std;
 
 #include "JHashPos.h"
+#include "JHugeMem.h"
 
 
 namespace JojoDiff {
@@ -33,6 +34,8 @@ namespace JojoDiff {
 const int COLLISION_THRESHOLD = 4 ; /* override when collision counter exceeds threshold  */
 const int COLLISION_HIGH = 4 ;      /* rate at which high quality samples should override */
 const int COLLISION_LOW = 1 ;       /* rate at which low quality samples should override  */
+const int SAMPLE_RATIO = 4 ;        /* elements per byte of the original file (small files) */
+const int SAMPLE_MIN = 4096 ;       /* minimum number of elements                           */
 
 /* List of primes we select from when size is specified on commandline */
 const int giPme[20] = { /* 2147483647, 1073741789, 536870909,  268435399, */
@@ -50,18 +53,29 @@ const int giPme[20] = { /* 2147483647, 1073741789, 536870909,  268435399, */
   * of 8191 elements.
   *
   * @param aiSze   size, in number of elements.
+  * @param abSld   sliding window: every new sample overrides.
+  * @param abFpr   also store strong fingerprints.
   */
-JHashPos::JHashPos(int aiSze)
-:  miHshColMax(COLLISION_THRESHOLD), miHshColCnt(COLLISION_THRESHOLD),
-   miHshRlb(48), miLodCnt(0), miHshHit(0)
+JHashPos::JHashPos(int aiSze, bool abSld, bool abFpr, JArena *apAra)
+:  mbSld(abSld), mpAra(apAra), miHshColMax(COLLISION_THRESHOLD), miHshColCnt(COLLISION_THRESHOLD),
+   miHshRlb(48), miLodCnt(0)
 {
     int liSzeIdx=0;
     for (; liSzeIdx < 19 && giPme[liSzeIdx] > aiSze; liSzeIdx++) ;
 
 	miHshPme = giPme[liSzeIdx];
-	miHshSze = miHshPme * (sizeof(off_t) + sizeof(hkey));
-	mzHshTblPos = (off_t *) malloc(miHshSze) ;
+	miHshCap = miHshPme ;
+	miHshSze = memsize(aiSze, abFpr) ;
+	if (mpAra != null)
+	    mzHshTblPos = (off_t *) mpAra->alloc(miHshSze) ;  // zeroed
+	else
+	    mzHshTblPos = (off_t *) JHugeMem::alloc(miHshSze) ;   // zeroed, on huge pages if possible
 	mkHshTblHsh = (hkey *) &mzHshTblPos[miHshPme] ;
+	mkHshTblFpr = abFpr ? (fkey *) &mkHshTblHsh[miHshPme] : null ;
+
+	mkFprOut = 1 ;
+	for (int liIdx = 0; liIdx < SMPSZE; liIdx++)
+	    mkFprOut = ufFprMul(mkFprOut, FPR_MUL) ;
 
 #if debug
 	if (JDebug::gbDbg[DBGHSH])
@@ -75,16 +89,80 @@ JHashPos::JHashPos(int aiSze)
 	    throw bad_alloc() ;
 	}
 #endif
-	memset(mzHshTblPos, 0, miHshSze);
+}
+
+/**
+ * Return the size to use for a hashtable on an original file of the given length.
+ *
+ * An original file cannot yield more samples than it has bytes, so the hashtable
+ * only needs to grow proportionally to the original file (with some headroom to keep
+ * collisions low) up to the given maximum. Small files thereby get a small table.
+ * A length of 0 is taken as unknown (block devices and pipes report 0): the
+ * maximum is used.
+ *
+ * @param aiMax     maximum size, in number of elements
+ * @param azOrgSze  length of the original file (0 = unknown)
+ * @return size, in number of elements
+ */
+int JHashPos::get_size(int aiMax, off_t azOrgSze){
+    if (azOrgSze <= 0 || azOrgSze >= aiMax / SAMPLE_RATIO)
+        return aiMax ;
+    else if (azOrgSze * SAMPLE_RATIO < SAMPLE_MIN)
+        return (aiMax < SAMPLE_MIN) ? aiMax : SAMPLE_MIN ;
+    else
+        return (int) azOrgSze * SAMPLE_RATIO ;
+}
+
+/**
+ * Return the memory (bytes) taken by a hashtable of (at most) the given size.
+ */
+size_t JHashPos::memsize(int aiSze, bool abFpr){
+    int liSzeIdx=0;
+    for (; liSzeIdx < 19 && giPme[liSzeIdx] > aiSze; liSzeIdx++) ;
+    return (size_t) giPme[liSzeIdx] * (sizeof(off_t) + sizeof(hkey) + (abFpr ? sizeof(fkey) : 0));
+}
+
+/**
+ * Empty the table for reuse on another file, without releasing it.
+ *
+ * The new size is chosen as at construction, but never above the capacity.
+ * The arrays are laid out again for the new prime within the same block and
+ * only the part in use is cleared, so small files get a small (and cheap) table.
+ *
+ * @param aiSze   size, in number of elements.
+ */
+void JHashPos::reset(int aiSze){
+    bool lbFpr = (mkHshTblFpr != null) ;
+    int liSzeIdx=0;
+    for (; liSzeIdx < 19 && giPme[liSzeIdx] > aiSze; liSzeIdx++) ;
+
+    miHshPme = (giPme[liSzeIdx] < miHshCap) ? giPme[liSzeIdx] : miHshCap ;
+    mkHshTblHsh = (hkey *) &mzHshTblPos[miHshPme] ;
+    mkHshTblFpr = lbFpr ? (fkey *) &mkHshTblHsh[miHshPme] : null ;
+    memset(mzHshTblPos, 0, (size_t) miHshPme * (sizeof(off_t) + sizeof(hkey) + (lbFpr ? sizeof(fkey) : 0))) ;
+
+    miHshColMax = COLLISION_THRESHOLD ;
+    miHshColCnt = COLLISION_THRESHOLD ;
+    miHshRlb = 48 ;
+    miLodCnt = 0 ;
 }
 
 /*
  * Destructor
  */
 JHashPos::~JHashPos() {
-	free(mzHshTblPos);
+	if (mpAra == null)
+	    JHugeMem::free(mzHshTblPos, miHshSze);
 	mzHshTblPos = null ;
 	mkHshTblHsh = null ;
+	mkHshTblFpr = null ;
+}
+
+/**
+ * Reset a fingerprint state.
+ */
+void JHashPos::fingerprint_reset ( rFpr &arFpr ){
+    memset(&arFpr, 0, sizeof(rFpr)) ;
 }
 
 /**
@@ -92,8 +170,20 @@ JHashPos::~JHashPos() {
  * @param alCurHsh      Hash key to add
  * @param azPos         Position to add
  * @param aiEqlCnt      Quality of the sample
+ * @param akFpr         Fingerprint of the sample (if fingerprints are stored)
  */
-void JHashPos::add (hkey akCurHsh, off_t azPos, int aiEqlCnt ){
+void JHashPos::add (hkey akCurHsh, off_t azPos, int aiEqlCnt, fkey akFpr ){
+    /* Sliding window: newest sample always wins (low-quality samples excepted) */
+    if (mbSld) {
+        if (aiEqlCnt <= SMPSZE - 4) {
+            int liIdx = (akCurHsh % miHshPme) ;
+            mkHshTblHsh[liIdx] = akCurHsh ;
+            mzHshTblPos[liIdx] = azPos ;
+            if (mkHshTblFpr != null) mkHshTblFpr[liIdx] = akFpr ;
+        }
+        return ;
+    }
+
     /* Every time the load factor increases by 1
      * - increase miHshColMax: the ratio at which we store values to achieve a uniform distribution of samples
      * - increase miHshRlb: the number of bytes to verify (reliability range) to be sure there is no match
@@ -132,6 +222,7 @@ void JHashPos::add (hkey akCurHsh, off_t azPos, int aiEqlCnt ){
         /* store */
         mkHshTblHsh[liIdx] = akCurHsh ;
         mzHshTblPos[liIdx] = azPos ;
+        if (mkHshTblFpr != null) mkHshTblFpr[liIdx] = akFpr ;
         miHshColCnt = 0 ; // reset subsequent lost collisions counter
     }
 } /* ufHshAdd */
@@ -140,9 +231,10 @@ void JHashPos::add (hkey akCurHsh, off_t azPos, int aiEqlCnt ){
  * Hasttable lookup
  * @param alCurHsh  in:  hash key to lookup
  * @param lzPos     out: position found
+ * @param apFpr     out: fingerprint found (if not null and fingerprints are stored)
  * @return true=found, false=notfound
  */
-bool JHashPos::get (const hkey akCurHsh, off_t &azPos)
+bool JHashPos::get (const hkey akCurHsh, off_t &azPos, fkey *apFpr)
 { int   liIdx ;
 
   /* calculate key and the corresponding entries' address */
@@ -150,8 +242,8 @@ bool JHashPos::get (const hkey akCurHsh, off_t &azPos)
 
   /* lookup value into hashtable for new file */
   if (mkHshTblHsh[liIdx] == akCurHsh)  {
-    miHshHit++;
     azPos = mzHshTblPos[liIdx];
+    if (apFpr != null && mkHshTblFpr != null) *apFpr = mkHshTblFpr[liIdx] ;
     return true ;
   }
   return false ;
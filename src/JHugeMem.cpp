@@ -0,0 +1,125 @@
+/*
+ * JHugeMem.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#endif
+
+#include "JHugeMem.h"
+#include "JDebug.h"
+
+namespace JojoDiff {
+
+std::atomic<long> JHugeMem::glHugReq(0) ;
+std::atomic<int>  JHugeMem::giHugAdv(0) ;
+std::atomic<int>  JHugeMem::giHugErr(0) ;
+
+/**
+ * Allocate a zeroed block of memory, on huge pages when possible.
+ *
+ * @param alSze     size in bytes
+ * @return pointer to the block, null on failure
+ */
+void *JHugeMem::alloc(size_t alSze){
+#if !defined(__MINGW32__) && defined(MAP_ANONYMOUS)
+    if (alSze >= HUG_SZE) {
+        size_t llSze = size(alSze) ;
+        char *lpMap ;
+        char *lpMem ;
+
+        /* map one huge page more than needed, then trim to a HUG_SZE boundary */
+        lpMap = (char *) mmap(null, llSze + HUG_SZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) ;
+        if (lpMap == MAP_FAILED)
+            return null ;
+        lpMem = (char *) (((size_t) lpMap + HUG_SZE - 1) & ~((size_t) HUG_SZE - 1)) ;
+        if (lpMem > lpMap)
+            munmap(lpMap, lpMem - lpMap) ;
+        if (lpMap + HUG_SZE > lpMem)
+            munmap(lpMem + llSze, (lpMap + HUG_SZE) - lpMem) ;
+
+        /* ask for transparent huge pages: falls back to normal pages when unavailable */
+#ifdef MADV_HUGEPAGE
+        if (madvise(lpMem, llSze, MADV_HUGEPAGE) == 0) {
+            giHugAdv ++ ;
+            glHugReq += llSze ;
+        } else {
+            giHugErr ++ ;
+        }
+#else
+        giHugErr ++ ;
+#endif
+
+        #if debug
+        if (JDebug::gbDbg[DBGHSH])
+            fprintf(JDebug::stddbg, "Huge alloc %lu bytes at %p.\n", (unsigned long) llSze, lpMem) ;
+        #endif
+        return lpMem ;
+    }
+#endif
+    return calloc(alSze, 1) ;
+}
+
+/**
+ * Release a block allocated by alloc.
+ *
+ * @param apMem     block to release (may be null)
+ * @param alSze     size in bytes, as given to alloc
+ */
+void JHugeMem::free(void *apMem, size_t alSze){
+    if (apMem == null)
+        return ;
+#if !defined(__MINGW32__) && defined(MAP_ANONYMOUS)
+    if (alSze >= HUG_SZE) {
+        munmap(apMem, (alSze + HUG_SZE - 1) & ~((size_t) HUG_SZE - 1)) ;
+        return ;
+    }
+#endif
+    ::free(apMem) ;
+}
+
+/**
+ * Return the number of kB currently backed by huge pages in this process,
+ * as reported by the os, or -1 if unknown.
+ */
+long JHugeMem::hugepages(){
+    long llHug = -1 ;
+#ifndef __MINGW32__
+    char lsLin[256] ;
+    long llVal ;
+    FILE *lpFil = fopen("/proc/self/smaps_rollup", "r") ;
+    if (lpFil == null)
+        return -1 ;
+    while (fgets(lsLin, sizeof(lsLin), lpFil) != null) {
+        if (sscanf(lsLin, "AnonHugePages: %ld kB", &llVal) == 1) {
+            llHug = llVal ;
+            break ;
+        }
+    }
+    fclose(lpFil) ;
+#endif
+    return llHug ;
+}
+}
@@ -26,7 +26,12 @@
 #include <new>
 using namespace std;
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
 #include "JDebug.h"
+#include "JOutBin.h"
 
 namespace JojoDiff {
 
@@ -55,38 +60,88 @@ namespace JojoDiff {
 *
 *******************************************************************************/
 
-int JMatchTable::siHshRpr = 0;     /* Number of repaired hash hits (by comparing) */
-
 /* Construct a matching table for specified hashtable, original and new files. */
-JMatchTable::JMatchTable (JHashPos const * const cpHsh,  JFile  * const apFilOrg, JFile  * const apFilNew, const bool abCmpAll)
-: mpHsh(cpHsh), mpFilOrg(apFilOrg), mpFilNew(apFilNew), mbCmpAll(abCmpAll)
+JMatchTable::JMatchTable (JHashPos const * const cpHsh,  JFile  * const apFilOrg, JFile  * const apFilNew,
+        const int aiCmpMod, const int aiMchSze, const bool abOpt, JArena *apAra)
+: mpHsh(cpHsh), mpFilOrg(apFilOrg), mpFilNew(apFilNew), mpAra(apAra), miCmpMod(aiCmpMod), mbOpt(abOpt)
 {
-    // allocate table
-	// TODO only allocate max number of elements
-    msMch = (rMch *) malloc(sizeof(rMch) * MCH_MAX) ;
+    // table size and number of buckets: a power of two, around half the table size
+    miMchSze = (aiMchSze < MCH_MIN) ? MCH_MIN : (aiMchSze > MCH_LIM) ? MCH_LIM : aiMchSze ;
+    for (miMchMsk = 8; miMchMsk * 2 < miMchSze; miMchMsk *= 2) ;
+    miMchMsk -- ;
+
+    // allocate the pool: one block for all arrays, positions first for alignment
+    if (mpAra != null)
+        mzBeg = (off_t *) mpAra->alloc(memsize(miMchSze)) ;
+    else
+        mzBeg = (off_t *) malloc(memsize(miMchSze)) ;
 #ifndef __MINGW32__
-    if ( msMch == null ) {
+    if ( mzBeg == null ) {
         throw bad_alloc() ;
     }
 #endif
+    mzNew    = &mzBeg[miMchSze] ;
+    mzOrg    = &mzNew[miMchSze] ;
+    mzDlt    = &mzOrg[miMchSze] ;
+    mzVfyNew = &mzDlt[miMchSze] ;
+    mzVfyOrg = &mzVfyNew[miMchSze] ;
+    mzChkBeg = &mzVfyOrg[miMchSze] ;
+    mzChkEnd = &mzChkBeg[miMchSze] ;
+    mzChkDlt = &mzChkEnd[miMchSze] ;
+    mzChkRun = &mzChkDlt[miMchSze] ;
+    miCnt    = (int *) &mzChkRun[miMchSze] ;
+    miChkRes = &miCnt[miMchSze] ;
+    miTyp    = &miChkRes[miMchSze] ;
+    miHshNxt = &miTyp[miMchSze] ;
+    miLstNxt = &miHshNxt[miMchSze] ;
+    miLstPrv = &miLstNxt[miMchSze] ;
+    miMch    = &miLstPrv[miMchSze] ;
+
+    reset() ;
+}
+
+/* Size of the pool for a table of aiMchSze matches */
+size_t JMatchTable::memsize(int aiMchSze) {
+    int liMsk ;
+    if (aiMchSze < MCH_MIN) aiMchSze = MCH_MIN ;
+    if (aiMchSze > MCH_LIM) aiMchSze = MCH_LIM ;
+    for (liMsk = 8; liMsk * 2 < aiMchSze; liMsk *= 2) ;
+    return (sizeof(off_t) * 10 + sizeof(int) * 6) * aiMchSze + sizeof(int) * liMsk ;
+}
+
+/* Empty the table: all elements on the freelist, all buckets empty */
+void JMatchTable::reset() {
+    int liIdx ;
 
 	// initialize linked list of free nodes
-    for (int liIdx=0; liIdx < MCH_MAX - 1; liIdx++) {
-        msMch[liIdx].ipNxt = &msMch[liIdx + 1];
+    for (liIdx=0; liIdx < miMchSze - 1; liIdx++) {
+        miHshNxt[liIdx] = liIdx + 1;
     }
-    msMch[MCH_MAX - 1].ipNxt = null ;
-    mpMchFre = msMch ;
+    miHshNxt[miMchSze - 1] = -1 ;
+    miMchFre = 0 ;
 
-    memset(mpMch, 0, MCH_PME * sizeof(tMch *));
+    for (liIdx=0; liIdx <= miMchMsk; liIdx++) {
+        miMch[liIdx] = -1 ;
+    }
 
     // initialize other values
-    mpMchGld = null;
+    miLstFst = -1 ;
+    miLstLst = -1 ;
+    miMchGld = -1 ;
     mzGldDlt = 0 ;
+
+    // statistics
+    miHshRpr = 0 ;
+    miFprHit = 0 ;
+    miChkMem = 0 ;
+    miCmpSft = 0 ;
+    miOptSel = 0 ;
 }
 
 /* Destructor */
 JMatchTable::~JMatchTable() {
-	free(msMch);
+	if (mpAra == null)
+	    free(mzBeg);
 }
 
 /* -----------------------------------------------------------------------------
@@ -104,72 +159,98 @@ int JMatchTable::add (
   off_t const &azFndOrgAdd,      /* match to add               */
   off_t const &azFndNewAdd,
   off_t const &azBseNew,
-  int   const aiEqlNew
+  int   const aiEqlNew,
+  bool  const abVfy
 ){
     off_t lzDlt ;            /* delta key of match */
-    rMch *lpCur ;            /* current item */
-    int liIdx ;              /* lzDlt % MCH_MAX */
+    int liCur ;              /* current item */
+    int liPrv ;              /* previous item in ordered list */
+    int liIdx ;              /* bucket of lzDlt */
 
     lzDlt = azFndOrgAdd - azFndNewAdd ;
 
     // add to gliding match
-    if (mpMchGld != null){
+    if (miMchGld >= 0){
         if (lzDlt == mzGldDlt) {
-            mpMchGld->iiTyp = -1 ;
-            mpMchGld->iiCnt ++ ;
-            mpMchGld->izNew = azFndNewAdd ;
+            miTyp[miMchGld] = -1 ;
+            miCnt[miMchGld] ++ ;
+            mzNew[miMchGld] = azFndNewAdd ;
+            if (abVfy && mzVfyNew[miMchGld] < azBseNew) {
+                mzVfyNew[miMchGld] = azFndNewAdd ;
+                mzVfyOrg[miMchGld] = azFndOrgAdd ;
+            }
             mzGldDlt--;
             return 2 ;
         } else {
-            mpMchGld = null ;
+            miMchGld = -1 ;
         }
     }
 
     // add or override colliding match
-    liIdx = lzDlt % MCH_PME ;
-    if (liIdx < 0)
-        liIdx = - liIdx ;
-    for (lpCur = mpMch[liIdx] ; lpCur != null; lpCur = lpCur->ipNxt){
-        if (lpCur->izDlt == lzDlt){
+    liIdx = ufBck(lzDlt) ;
+    for (liCur = miMch[liIdx] ; liCur >= 0; liCur = miHshNxt[liCur]){
+        if (mzDlt[liCur] == lzDlt){
             // add to colliding match
-            lpCur->iiCnt ++ ;
-            lpCur->iiTyp = 1 ;
-            lpCur->izNew = azFndNewAdd ;
-            lpCur->izOrg = azFndOrgAdd ;
+            miCnt[liCur] ++ ;
+            miTyp[liCur] = 1 ;
+            mzNew[liCur] = azFndNewAdd ;
+            mzOrg[liCur] = azFndOrgAdd ;
+            if (abVfy && mzVfyNew[liCur] < azBseNew) {
+                mzVfyNew[liCur] = azFndNewAdd ;
+                mzVfyOrg[liCur] = azFndOrgAdd ;
+            }
 
             return 2 ;
         }
     } /* for */
 
     // create new match
-    if (mpMchFre != null){
+    if (miMchFre >= 0){
         // remove from free-list
-        lpCur = mpMchFre ;
-        mpMchFre = mpMchFre->ipNxt ;
+        liCur = miMchFre ;
+        miMchFre = miHshNxt[liCur] ;
 
         // fill out the form
-        lpCur->izOrg = azFndOrgAdd ;
-        lpCur->izNew = azFndNewAdd ;
-        lpCur->izBeg = azFndNewAdd ;
-        lpCur->izDlt = lzDlt ;
-        lpCur->iiCnt = 1 ;
-        lpCur->iiTyp = 0 ;
+        mzOrg[liCur] = azFndOrgAdd ;
+        mzNew[liCur] = azFndNewAdd ;
+        mzBeg[liCur] = azFndNewAdd ;
+        mzDlt[liCur] = lzDlt ;
+        miCnt[liCur] = 1 ;
+        miTyp[liCur] = 0 ;
+        mzVfyNew[liCur] = abVfy ? azFndNewAdd : -1 ;
+        mzVfyOrg[liCur] = azFndOrgAdd ;
+        miChkRes[liCur] = 1 ;
 
         // add to hashtable
-        lpCur->ipNxt = mpMch[liIdx];
-        mpMch[liIdx] = lpCur ;
+        miHshNxt[liCur] = miMch[liIdx];
+        miMch[liIdx] = liCur ;
+
+        // add to ordered list: usually at the end
+        for (liPrv = miLstLst; liPrv >= 0 && mzBeg[liPrv] > azFndNewAdd; liPrv = miLstPrv[liPrv]) ;
+        miLstPrv[liCur] = liPrv ;
+        if (liPrv < 0) {
+            miLstNxt[liCur] = miLstFst ;
+            miLstFst = liCur ;
+        } else {
+            miLstNxt[liCur] = miLstNxt[liPrv] ;
+            miLstNxt[liPrv] = liCur ;
+        }
+        if (miLstNxt[liCur] < 0)
+            miLstLst = liCur ;
+        else
+            miLstPrv[miLstNxt[liCur]] = liCur ;
 
         // potential gliding match
-        mpMchGld = lpCur ;
+        miMchGld = liCur ;
         mzGldDlt = lzDlt - 1 ;
 
         #if debug
         if (JDebug::gbDbg[DBGMCH])
           fprintf(JDebug::stddbg, "Mch Add ("P8zd","P8zd") New ("P8zd","P8zd") Bse (%"PRIzd")\n",
-                  azFndOrgAdd, azFndNewAdd, lpCur->izOrg, lpCur->izNew, azBseNew) ;
+                  azFndOrgAdd, azFndNewAdd, mzOrg[liCur], mzNew[liCur], azBseNew) ;
         #endif
 
-        return (mpMchFre != null) ; // still place ?
+        return (miMchFre >= 0) ; // still place ?
     } else {
         #if debug
         if (JDebug::gbDbg[DBGMCH]) fprintf(JDebug::stddbg, "Mch ("P8zd", "P8zd") Ful\n", azFndOrgAdd, azFndNewAdd) ;
@@ -179,8 +260,66 @@ int JMatchTable::add (
     }
 } /* add() */
 
+/* -----------------------------------------------------------------------------
+ * Compare policy for one candidate.
+ *
+ * A hard compare costs nothing when the data is buffered, or when it lies just
+ * ahead of the current read position (sequential read). Otherwise, it costs one
+ * seek on that file, at the latency measured by the file so far (0 = unknown,
+ * in which case we compare to get a measurement).
+ *
+ * The expected gain is the uncertainty on the match: an unverified candidate
+ * may be wrong or misplaced within aiDst bytes, costing up to aiDst bytes of
+ * patch. Each doubling of its aiCnt confirmations lowers that risk.
+ *
+ * Fast storage (SSD, cached files) will therefore nearly always compare, while
+ * slow storage only compares poorly confirmed candidates with a large range.
+ * ---------------------------------------------------------------------------*/
+int JMatchTable::ufCmpTyp (
+    off_t const &azTstOrg, off_t const &azTstNew,
+    off_t const &azRedOrg, off_t const &azRedNew,
+    int aiDst, int aiCnt
+) {
+    int liLen ;             // buffered length (unused)
+    long long llCst = 0 ;   // expected cost: seek time in microseconds
+    long long llGan ;       // expected gain: bytes
+
+    switch (miCmpMod) {
+    case CMP_NVR: return 2 ;
+    case CMP_ALL: return 1 ;
+    }
+
+    /* cost on the original file */
+    if (mpFilOrg->getbuf(azTstOrg, liLen) == null || mpFilOrg->getbuf(azTstOrg + aiDst - 1, liLen) == null) {
+        if (azTstOrg < azRedOrg || azTstOrg > azRedOrg + aiDst)
+            llCst += mpFilOrg->seektime() ;
+    }
+
+    /* cost on the new file */
+    if (mpFilNew->getbuf(azTstNew, liLen) == null || mpFilNew->getbuf(azTstNew + aiDst - 1, liLen) == null) {
+        if (azTstNew < azRedNew || azTstNew > azRedNew + aiDst)
+            llCst += mpFilNew->seektime() ;
+    }
+
+    /* gain */
+    for (llGan = 1; aiCnt > 0; aiCnt >>= 1)
+        llGan++ ;
+    llGan = aiDst / llGan ;
+    if (llGan * CMP_USB >= llCst)
+        return 1 ;
+
+    miCmpSft++ ;
+    return 2 ;
+} /* ufCmpTyp */
+
 /* -----------------------------------------------------------------------------
  * Get the best match from the array of matches
+ *
+ * Matches are visited in the order of izBeg, nearest first. Which matches get
+ * verified (and repaired) depends on the best solution found so far, so the
+ * order matters: visiting the nearest first verifies fewer of the farther
+ * matches than the former walk over the hash buckets did. The early stop below
+ * does not change the selection: no later match can be potentially better.
  * ---------------------------------------------------------------------------*/
 const int FZY=0 ;	// Fuzzy factor: for differences smaller than this number of bytes, take the longest looking sequence
 bool JMatchTable::get (
@@ -188,188 +327,397 @@ bool JMatchTable::get (
   off_t const &azRedNew,       // current read position on new file
   off_t &azBstOrg,             // best position found on original file
   off_t &azBstNew              // best position found on new file
-) const{
-    int liIdx ;             // index in mpMch
+) {
     int liDst ;             // distance: number of bytes to compare before failing
 
-    rMch *lpCur ;           /* current match under investigation            */
+    int liCur ;             /* current match under investigation            */
     int liCurCnt ;          /* current match count                          */
     int liCurCmp ;          /* current match compare state: 0=equal, 1=unsure(EOB), 2=unequal, 7=most probably unequal */
 
-    rMch *lpBst=null ;      /* best match.                                  */
+    int liBst=-1 ;          /* best match.                                  */
     int liBstCnt=0 ;        /* best match count                             */
-    int liBstCmp ;          /* best match compare state                     */
+    int liBstCmp=2 ;        /* best match compare state                     */
 
     off_t lzTstNew ;    // test/found position in new file
     off_t lzTstOrg ;    // test/found position in old file
 
+    off_t lzOptOrg[OPT_MAX] ;   // verified candidates for optimal selection
+    off_t lzOptNew[OPT_MAX] ;
+    int   liOptCnt = 0 ;
+
     int liRlb = mpHsh->get_reliability() ;  // current reliability range
     if (liRlb < 1024) liRlb = 1024 ;
 
-    /* loop on the table */
-    for (liIdx = 0; liIdx < MCH_PME; liIdx ++) {	// TODO loop on linked list instead of full table!
-        for (lpCur = mpMch[liIdx]; lpCur != null; lpCur=lpCur->ipNxt) {
-            liCurCnt = (lpCur->iiTyp < 0) ? 0 : lpCur->iiCnt ; // TODO do this later, only when necessary
+    /* loop on the list, ordered on izBeg */
+    for (liCur = miLstFst; liCur >= 0; liCur = miLstNxt[liCur]) {
+        liCurCnt = (miTyp[liCur] < 0) ? 0 : miCnt[liCur] ;
 
-            // if empty or old
-            if ((lpCur->iiCnt == 0)	/* empty */
-                    || (lpCur->izNew + mpHsh->get_reliability() < azRedNew)){ /* old */
-                // do nothing: skip empty or old entries
+        // if empty or old
+        if ((miCnt[liCur] == 0)	/* empty */
+                || (mzNew[liCur] + mpHsh->get_reliability() < azRedNew)){ /* old */
+            // do nothing: skip empty or old entries
+        }
+        // else if potentially better
+        else if ((liBst < 0)                                  // no solution found yet ?
+                ||  ((mzBeg[liCur] - liRlb < azBstNew + FZY)  // or probably nearer
+                        && ((azRedNew < azBstNew + FZY)       // and still possible to improve ?
+                                || (liCurCnt > liBstCnt))))   // or probably longer ?
+        {
+            /* calculate the test position */
+            lzTstNew = mzBeg[liCur] - liRlb ;
+            if (lzTstNew >= azRedNew){
+                liDst = liRlb ;
+            } else {
+                lzTstNew = azRedNew ;
+                liDst = mzBeg[liCur] - lzTstNew ; // TODO liDst may overflow ??
+                if (liDst < liRlb)
+                    liDst=liRlb;
             }
-            // else if potentially better
-            else if ((lpBst == null)                            // no solution found yet ?
-                    ||  ((lpCur->izBeg - liRlb < azBstNew + FZY)  // or probably nearer
-                            && ((azRedNew < azBstNew + FZY)       // and still possible to improve ?
-                                    || (liCurCnt > liBstCnt))))   // or probably longer ?
-            {
-                /* calculate the test position */
-            	lzTstNew = lpCur->izBeg - liRlb ;
-                if (lzTstNew >= azRedNew){
-                    liDst = liRlb ;
-                } else {
-                    lzTstNew = azRedNew ;
-                    liDst = lpCur->izBeg - lzTstNew ; // TODO liDst may overflow ??
-                    if (liDst < liRlb)
-                        liDst=liRlb;
-                }
 
-                /* calculate the test position on the original file by applying izDlt */
-                if ((lpCur->iiTyp < 0)){
-                    // we're on a gliding match
-                    if (lzTstNew >= lpCur->izBeg) {
-                        // within gliding match
-                        lzTstOrg = lpCur->izOrg ;
-                    } else {
-                        // before gliding match
-                        lzTstOrg = lzTstNew + lpCur->izDlt;
-                        if (lzTstOrg < 0) {
-                            lzTstNew -= lzTstOrg ;
-                            lzTstOrg = 0 ;
-                        }
-                    }
+            /* calculate the test position on the original file by applying izDlt */
+            if ((miTyp[liCur] < 0)){
+                // we're on a gliding match
+                if (lzTstNew >= mzBeg[liCur]) {
+                    // within gliding match
+                    lzTstOrg = mzOrg[liCur] ;
                 } else {
-                    // colliding match
-                    lzTstOrg =  lzTstNew + lpCur->izDlt ;
+                    // before gliding match
+                    lzTstOrg = lzTstNew + mzDlt[liCur];
                     if (lzTstOrg < 0) {
                         lzTstNew -= lzTstOrg ;
                         lzTstOrg = 0 ;
                     }
-                } /* if else gliding/colliding match */
-
-                /* compare */
-                liCurCmp = check(lzTstOrg, lzTstNew, liDst, mbCmpAll?1:2) ;
-
-                /* soft eof reached, then rely on hash function */
-                if (liCurCmp == 1){
-                    if (lpCur->iiCnt < 2){
-                        liCurCmp = 7 ; // most probably unequal
-                    } else {
-                        // estimate a realistic "find" position
-                        if (lpCur->izBeg >= azRedNew)
-                            lzTstNew = lpCur->izBeg ;
-                        else if (lpCur->izNew >= azRedNew)
-                            lzTstNew = azRedNew ;
-                        else
-                            liCurCmp = 7 ;
-                        lzTstOrg = lzTstNew + lpCur->izDlt ;
-                    }
-                } /* if liCmp == 1 */
+                }
+            } else {
+                // colliding match
+                lzTstOrg =  lzTstNew + mzDlt[liCur] ;
+                if (lzTstOrg < 0) {
+                    lzTstNew -= lzTstOrg ;
+                    lzTstOrg = 0 ;
+                }
+            } /* if else gliding/colliding match */
+
+            /* compare, or reuse the last compare if it covered the tested range */
+            if (miChkRes[liCur] == 0 && lzTstOrg - lzTstNew == mzChkDlt[liCur]
+                    && mzChkBeg[liCur] <= lzTstNew && lzTstNew <= mzChkRun[liCur]
+                    && mzChkRun[liCur] + SMPSZE - 8 <= mzChkEnd[liCur]
+                    && mzChkRun[liCur] + SMPSZE - 8 <= lzTstNew + liDst) {
+                /* same equal run will be found first */
+                lzTstOrg += mzChkRun[liCur] - lzTstNew ;
+                lzTstNew = mzChkRun[liCur] ;
+                liCurCmp = 0 ;
+                miChkMem++ ;
+            } else if (miChkRes[liCur] == 2 && lzTstOrg - lzTstNew == mzChkDlt[liCur]
+                    && mzChkBeg[liCur] <= lzTstNew && lzTstNew + liDst <= mzChkEnd[liCur]) {
+                /* no equal run within a larger range */
+                liCurCmp = 2 ;
+                miChkMem++ ;
+            } else {
+                mzChkBeg[liCur] = lzTstNew ;
+                mzChkEnd[liCur] = lzTstNew + liDst ;
+                mzChkDlt[liCur] = lzTstOrg - lzTstNew ;
+                liCurCmp = check(lzTstOrg, lzTstNew, liDst,
+                        ufCmpTyp(lzTstOrg, lzTstNew, azRedOrg, azRedNew, liDst, miCnt[liCur])) ;
+                miChkRes[liCur] = liCurCmp ;
+                mzChkRun[liCur] = lzTstNew ;
+            }
 
-                /* remove false matches */
-                if (liCurCmp >= 2){
-                    lpCur->iiCnt-- ;
-                    siHshRpr++ ;
+            /* soft eof reached, then rely on hash function */
+            if (liCurCmp == 1){
+                if (miCnt[liCur] < 2){
+                    liCurCmp = 7 ; // most probably unequal
+                } else {
+                    // estimate a realistic "find" position
+                    if (mzBeg[liCur] >= azRedNew)
+                        lzTstNew = mzBeg[liCur] ;
+                    else if (mzNew[liCur] >= azRedNew)
+                        lzTstNew = azRedNew ;
+                    else
+                        liCurCmp = 7 ;
+                    lzTstOrg = lzTstNew + mzDlt[liCur] ;
+                }
+            } /* if liCmp == 1 */
+
+            /* hash function unreliable, then rely on the fingerprint of a verified sample */
+            if (liCurCmp == 7 && mzVfyNew[liCur] >= azRedNew){
+                lzTstNew = mzVfyNew[liCur] - SMPSZE + 1 ;
+                lzTstOrg = mzVfyOrg[liCur] - SMPSZE + 1 ;
+                if (lzTstNew < azRedNew) {
+                    lzTstOrg += azRedNew - lzTstNew ;
+                    lzTstNew = azRedNew ;
                 }
+                liCurCmp = 0 ;
+                miFprHit++ ;
+            }
 
-                /* evaluate: keep the best solution */
-                if (liCurCmp <= 1){
-                    if ((lpBst == NULL)								// first found
-                       || (lzTstNew + FZY < azBstNew)				// substantially nearer
-                       || ((lzTstNew <= azBstNew + FZY)				// potentially longer
-                            && (liCurCnt > liBstCnt)
-                             && (liCurCmp <= liBstCmp))
-                    ) {
-                        // new solution seems to be better
-                        azBstNew = lzTstNew ;
-                        azBstOrg = lzTstOrg ;
-                        lpBst = lpCur ;
-                        liBstCnt = liCurCnt ;
-                        liBstCmp = liCurCmp ;
-                    }
+            /* keep verified candidates for optimal selection */
+            if (mbOpt && liCurCmp == 0 && liOptCnt < OPT_MAX) {
+                lzOptOrg[liOptCnt] = lzTstOrg ;
+                lzOptNew[liOptCnt] = lzTstNew ;
+                liOptCnt ++ ;
+            }
+
+            /* remove false matches */
+            if (liCurCmp >= 2){
+                miCnt[liCur]-- ;
+                miHshRpr++ ;
+            }
+
+            /* evaluate: keep the best solution */
+            if (liCurCmp <= 1){
+                if ((liBst < 0)								// first found
+                   || (lzTstNew + FZY < azBstNew)				// substantially nearer
+                   || ((lzTstNew <= azBstNew + FZY)				// potentially longer
+                        && (liCurCnt > liBstCnt)
+                         && (liCurCmp <= liBstCmp))
+                ) {
+                    // new solution seems to be better
+                    azBstNew = lzTstNew ;
+                    azBstOrg = lzTstOrg ;
+                    liBst = liCur ;
+                    liBstCnt = liCurCnt ;
+                    liBstCmp = liCurCmp ;
                 }
+            }
 
-                /* show table */
-                #if debug
-                if (JDebug::gbDbg[DBGMCH])
-                    fprintf(JDebug::stddbg, "Mch %1d%c[%c"P8zd","P8zd","P8zd",%4d]"P8zd":%"PRIzd":%d\n",
-                            liCurCmp,
-                            (lpBst == lpCur)?'*': (liCurCmp == 0)?'=': (liCurCmp==1)?'?':':',
-                                            (lpCur->iiTyp<0)?'G': (lpCur->iiTyp>0)?'C': ' ',
-                                                    lpCur->izOrg, lpCur->izNew, lpCur->izBeg, lpCur->iiCnt,
-                                                    lzTstNew, lpCur->izDlt, liDst) ;
-                #endif
-            } else {
-                /* show table */
-                #if debug
-                if (JDebug::gbDbg[DBGMCH])
-                    if ((lpCur->iiCnt > 0) && (lpCur->izBeg > 0))
-                        fprintf(JDebug::stddbg, "Mch  :[%c"P8zd","P8zd","P8zd",%4d] D=%"PRIzd"\n",
-                                (lpCur->iiTyp<0)?'G': (lpCur->iiTyp>0)?'C': ' ',
-                                        lpCur->izOrg, lpCur->izNew, lpCur->izBeg, lpCur->iiCnt,
-                                        lpCur->izDlt) ;
-                #endif
-            } /* if else lpCur old, empty, better */
-        } /* for lpCur */
-    } /* for liIdx */
+            /* show table */
+            #if debug
+            if (JDebug::gbDbg[DBGMCH])
+                fprintf(JDebug::stddbg, "Mch %1d%c[%c"P8zd","P8zd","P8zd",%4d]"P8zd":%"PRIzd":%d\n",
+                        liCurCmp,
+                        (liBst == liCur)?'*': (liCurCmp == 0)?'=': (liCurCmp==1)?'?':':',
+                                        (miTyp[liCur]<0)?'G': (miTyp[liCur]>0)?'C': ' ',
+                                                mzOrg[liCur], mzNew[liCur], mzBeg[liCur], miCnt[liCur],
+                                                lzTstNew, mzDlt[liCur], liDst) ;
+            #endif
+        } else {
+            /* show table */
+            #if debug
+            if (JDebug::gbDbg[DBGMCH])
+                if ((miCnt[liCur] > 0) && (mzBeg[liCur] > 0))
+                    fprintf(JDebug::stddbg, "Mch  :[%c"P8zd","P8zd","P8zd",%4d] D=%"PRIzd"\n",
+                            (miTyp[liCur]<0)?'G': (miTyp[liCur]>0)?'C': ' ',
+                                    mzOrg[liCur], mzNew[liCur], mzBeg[liCur], miCnt[liCur],
+                                    mzDlt[liCur]) ;
+            #endif
+
+            /* all remaining elements begin even further: none of them can be nearer */
+            if (mzBeg[liCur] - liRlb >= azBstNew + FZY)
+                break ;
+        } /* if else liCur old, empty, better */
+    } /* for liCur */
+
+    /* select on encoded size rather than on distance */
+    if (liOptCnt > 1 && liBstCmp == 0) {
+        int liOpt = ufOptSel(azRedOrg, azRedNew, lzOptOrg, lzOptNew, liOptCnt) ;
+        if (lzOptNew[liOpt] != azBstNew || lzOptOrg[liOpt] != azBstOrg) {
+            azBstOrg = lzOptOrg[liOpt] ;
+            azBstNew = lzOptNew[liOpt] ;
+            miOptSel++ ;
+        }
+    }
 
     #if debug
     if (JDebug::gbDbg[DBGMCH])
-        if (lpBst == null)
+        if (liBst < 0)
             fprintf(JDebug::stddbg, "Mch Err\n") ;
     #endif
 
-    return (lpBst != null);
+    return (liBst >= 0);
 } /* get() */
 
+/* -----------------------------------------------------------------------------
+ * Encoded size (JOutBin) of going from one position to another:
+ * - a DEL or BKT jump on the original file, an <esc> <opcode> and a length,
+ * - the data of the new file in between (MOD and/or INS), including escapes,
+ * - one <esc> <opcode> per data operation.
+ * Data that is not buffered is counted without escapes.
+ * ---------------------------------------------------------------------------*/
+int JMatchTable::ufOptJmp (
+    off_t const &azFroOrg, off_t const &azFroNew,
+    off_t const &azTooOrg, off_t const &azTooNew
+) const {
+    off_t lzJmp = (azTooOrg - azFroOrg) - (azTooNew - azFroNew) ;   // DEL (>0), BKT or INS (<0)
+    off_t lzPos ;           // position within the data
+    const uchar *lpDta ;    // buffered data
+    const uchar *lpEsc ;    // escape within the data
+    int liLen ;             // length of buffered data
+    int liSze = 0 ;         // encoded size
+
+    if (lzJmp > 0 || (lzJmp < 0 && azTooOrg < azFroOrg))
+        liSze += 2 + JOutBin::ufPutSze(lzJmp > 0 ? lzJmp : - lzJmp) ;
+    if (azTooNew > azFroNew) {
+        liSze += 2 + (int) (azTooNew - azFroNew) ;
+        if (lzJmp < 0 && azTooOrg > azFroOrg)
+            liSze += 2 ;    // INS and MOD
+        for (lzPos = azFroNew; lzPos < azTooNew; lzPos += liLen) {
+            lpDta = mpFilNew->getbuf(lzPos, liLen) ;
+            if (lpDta == null)
+                break ;
+            if (liLen > azTooNew - lzPos)
+                liLen = (int) (azTooNew - lzPos) ;
+            for (lpEsc = lpDta; (lpEsc = (const uchar *) memchr(lpEsc, ESC, lpDta + liLen - lpEsc)) != null; lpEsc++)
+                liSze++ ;
+        }
+    }
+    return liSze ;
+} /* ufOptJmp */
+
+/* -----------------------------------------------------------------------------
+ * Optimal selection among the verified candidates.
+ *
+ * The candidates are sorted on their position in the new file and extended to
+ * the length of their equal region, up to OPT_WIN bytes. Out of the buffers,
+ * each candidate is read as the compare policy allows (see ufCmpTyp); regions
+ * that cannot be read are assumed to span the whole window. Then, by dynamic
+ * programming, the cheapest way to reach each candidate is calculated, either
+ * directly from the read position, or after (part of) the equal region of a
+ * preceding candidate. The remaining new data up to the end of the window is
+ * output as data. The first candidate of the cheapest sequence is returned.
+ *
+ * This avoids choosing a near but short region that is followed by an extra
+ * jump, where a slightly further region covers everything in one.
+ * ---------------------------------------------------------------------------*/
+int JMatchTable::ufOptSel (
+    off_t const &azRedOrg, off_t const &azRedNew,
+    off_t *azOptOrg, off_t *azOptNew, int aiOptCnt
+) {
+    off_t lzLen[OPT_MAX] ;  // length of the equal region
+    int   liPre[OPT_MAX] ;  // cheapest cost to reach the candidate
+    int   liPrv[OPT_MAX] ;  // preceding candidate on the cheapest path (-1 = none)
+    off_t lzEnd = 0 ;       // end of the window
+    off_t lzEqlOrg ;        // end of (part of) a preceding equal region
+    off_t lzEqlNew ;
+    off_t lzTmp ;
+    int lcOrg, lcNew ;      // bytes read beyond the buffers
+    int liSft ;             // soft or hard reads beyond the buffers (see ufCmpTyp)
+    int liCur, liPrc, liCst, liBst, liBstCst ;
+
+    /* sort on new position (insertion sort, small table) */
+    for (liCur = 1; liCur < aiOptCnt; liCur++) {
+        off_t lzOrg = azOptOrg[liCur] ;
+        off_t lzNew = azOptNew[liCur] ;
+        for (liPrc = liCur; liPrc > 0 && azOptNew[liPrc - 1] > lzNew; liPrc--) {
+            azOptOrg[liPrc] = azOptOrg[liPrc - 1] ;
+            azOptNew[liPrc] = azOptNew[liPrc - 1] ;
+        }
+        azOptOrg[liPrc] = lzOrg ;
+        azOptNew[liPrc] = lzNew ;
+    }
+
+    /* cost to reach each candidate */
+    for (liCur = 0; liCur < aiOptCnt; liCur++) {
+        lzEqlOrg = azOptOrg[liCur] ;
+        lzEqlNew = azOptNew[liCur] ;
+        lzLen[liCur] = extend(lzEqlOrg, lzEqlNew, azOptOrg[liCur], azOptNew[liCur]) ;
+        lzEqlOrg += lzLen[liCur] ;
+        lzEqlNew += lzLen[liCur] ;
+        liSft = (lzLen[liCur] < OPT_WIN) ? ufCmpTyp(lzEqlOrg, lzEqlNew, azRedOrg, azRedNew, OPT_WIN, 0) : 2 ;
+        for ( ; lzLen[liCur] < OPT_WIN; lzLen[liCur]++) {
+            lcOrg = mpFilOrg->get(lzEqlOrg++, liSft) ;
+            lcNew = mpFilNew->get(lzEqlNew++, liSft) ;
+            if (lcOrg == EOB || lcNew == EOB)
+                lzLen[liCur] = OPT_WIN ;
+            else if (lcOrg != lcNew || lcOrg < 0)
+                break ;
+        }
+        if (lzLen[liCur] > OPT_WIN)
+            lzLen[liCur] = OPT_WIN ;
+        if (lzEnd < azOptNew[liCur] + lzLen[liCur])
+            lzEnd = azOptNew[liCur] + lzLen[liCur] ;
+
+        liPre[liCur] = ufOptJmp(azRedOrg, azRedNew, azOptOrg[liCur], azOptNew[liCur]) ;
+        liPrv[liCur] = -1 ;
+        for (liPrc = 0; liPrc < liCur; liPrc++) {
+            if (azOptNew[liPrc] >= azOptNew[liCur] || lzLen[liPrc] == 0)
+                continue ;
+            lzTmp = azOptNew[liCur] - azOptNew[liPrc] ;
+            if (lzTmp > lzLen[liPrc])
+                lzTmp = lzLen[liPrc] ;
+            lzEqlOrg = azOptOrg[liPrc] + lzTmp ;
+            lzEqlNew = azOptNew[liPrc] + lzTmp ;
+            liCst = liPre[liPrc] + 2 + JOutBin::ufPutSze(lzTmp)
+                  + ufOptJmp(lzEqlOrg, lzEqlNew, azOptOrg[liCur], azOptNew[liCur]) ;
+            if (liCst < liPre[liCur]) {
+                liPre[liCur] = liCst ;
+                liPrv[liCur] = liPrc ;
+            }
+        }
+    }
+
+    /* cheapest sequence over the whole window */
+    liBst = 0 ;
+    liBstCst = -1 ;
+    for (liCur = 0; liCur < aiOptCnt; liCur++) {
+        liCst = liPre[liCur] + 2 + JOutBin::ufPutSze(lzLen[liCur] > 0 ? lzLen[liCur] : 1)
+              + (int) (lzEnd - azOptNew[liCur] - lzLen[liCur]) ;
+        if (liBstCst < 0 || liCst < liBstCst) {
+            liBst = liCur ;
+            liBstCst = liCst ;
+        }
+    }
+
+    /* return the first candidate of the sequence */
+    while (liPrv[liBst] >= 0)
+        liBst = liPrv[liBst] ;
+    return liBst ;
+} /* ufOptSel */
+
 /* -----------------------------------------------------------------------------
  * ufMchFre: cleanup & check if there is free space in the table of matches
  * ---------------------------------------------------------------------------*/
 bool JMatchTable::cleanup ( off_t const &azBseNew ){
-    rMch *lpCur ;
-    rMch *lpPrv ;
-
-    for (int liIdx = 0; liIdx < MCH_PME; liIdx ++) {
-        lpPrv = null ;
-        lpCur=mpMch[liIdx];
-        while(lpCur != null)  {
-            // if bad or old
-            if (lpCur->iiCnt == 0 || lpCur->izNew < azBseNew){
-                // remove from list
-                if (lpPrv == null)
-                    mpMch[liIdx] = lpCur->ipNxt ;
-                else
-                    lpPrv->ipNxt = lpCur->ipNxt ;
-
-                // add to free-list
-                lpCur->ipNxt = mpMchFre ;
-                mpMchFre = lpCur ;
-
-                // next
-                if (lpPrv == null){
-                    lpCur = mpMch[liIdx] ;
-                } else {
-                    lpCur = lpPrv->ipNxt ;
-                }
-            } else {
-                lpPrv = lpCur ;
-                lpCur = lpCur->ipNxt ;
-            }
+    int liCur ;
+    int liNxt ;
+
+    for (liCur = miLstFst; liCur >= 0; liCur = liNxt) {
+        liNxt = miLstNxt[liCur] ;
+
+        // if bad or old
+        if (miCnt[liCur] == 0 || mzNew[liCur] < azBseNew){
+            ufFre(liCur) ;
         }
     }
 
-    return (mpMchFre != null) ;
+    return (miMchFre >= 0) ;
 } /* cleanup() */
 
+/* -----------------------------------------------------------------------------
+ * Remove an element from its collision list and from the ordered list,
+ * and add it to the freelist.
+ * ---------------------------------------------------------------------------*/
+void JMatchTable::ufFre ( int aiCur ){
+    int liIdx ;
+    int liPrv ;
+
+    // remove from collision list
+    liIdx = ufBck(mzDlt[aiCur]) ;
+    if (miMch[liIdx] == aiCur) {
+        miMch[liIdx] = miHshNxt[aiCur] ;
+    } else {
+        for (liPrv = miMch[liIdx]; miHshNxt[liPrv] != aiCur; liPrv = miHshNxt[liPrv]) ;
+        miHshNxt[liPrv] = miHshNxt[aiCur] ;
+    }
+
+    // remove from ordered list
+    if (miLstPrv[aiCur] < 0)
+        miLstFst = miLstNxt[aiCur] ;
+    else
+        miLstNxt[miLstPrv[aiCur]] = miLstNxt[aiCur] ;
+    if (miLstNxt[aiCur] < 0)
+        miLstLst = miLstPrv[aiCur] ;
+    else
+        miLstPrv[miLstNxt[aiCur]] = miLstPrv[aiCur] ;
+
+    // no more gliding on a freed element
+    if (miMchGld == aiCur)
+        miMchGld = -1 ;
+
+    // add to free-list
+    miHshNxt[aiCur] = miMchFre ;
+    miMchFre = aiCur ;
+} /* ufFre() */
+
 /* -----------------------------------------------------------------------------
  * check(): verify and optimize matches
  *
@@ -394,6 +742,10 @@ int JMatchTable::check (
   int lcNew=EOF ;
   int liEql=0 ;
   int liRet=0 ;
+  const uchar *lpOrg ;  // buffered data on original file
+  const uchar *lpNew ;  // buffered data on new file
+  int liSpnOrg ;        // contiguous bytes at lpOrg
+  int liSpnNew ;        // contiguous bytes at lpNew
 
   #if debug
   if (JDebug::gbDbg[DBGCMP])
@@ -401,8 +753,21 @@ int JMatchTable::check (
       azPosOrg, azPosNew, aiLen, aiSft) ;
   #endif
 
-  /* Compare bytes */
-  for (; aiLen > SMPSZE - 8 && liRet == 0 && liEql < SMPSZE - 8; aiLen--) {
+  /* Compare bytes: in bulk while both files are buffered, byte per byte otherwise.
+   * Within the last 24 bytes, any difference means failure. */
+  while (aiLen > 0 && liRet == 0 && liEql < SMPSZE - 8) {
+    lpOrg = mpFilOrg->getbuf(azPosOrg, liSpnOrg) ;
+    lpNew = (lpOrg == null) ? null : mpFilNew->getbuf(azPosNew, liSpnNew) ;
+    if (lpNew != null) {
+        if (liSpnOrg > liSpnNew) liSpnOrg = liSpnNew ;
+        if (liSpnOrg > aiLen) liSpnOrg = aiLen ;
+        liSpnNew = ufChkSpn(lpOrg, lpNew, liSpnOrg, aiLen, liEql, liRet) ;
+        azPosOrg += liSpnNew ;
+        azPosNew += liSpnNew ;
+        aiLen -= liSpnNew ;
+        continue ;
+    }
+
     lcOrg = mpFilOrg->get(azPosOrg ++, aiSft) ;
     lcNew = mpFilNew->get(azPosNew ++, aiSft) ;
 
@@ -410,21 +775,11 @@ int JMatchTable::check (
         liEql ++ ;
     else if (lcOrg < 0 || lcNew < 0)
         liRet = 1 ;
+    else if (aiLen <= SMPSZE - 8)
+        liRet = 2 ;
     else
         liEql = 0 ;
-  }
-
-  /* Compare last 24 bytes */
-  for (; aiLen > 0 && liRet == 0 && liEql < SMPSZE - 8; aiLen--) {
-      lcOrg = mpFilOrg->get(azPosOrg ++, aiSft) ;
-      lcNew = mpFilNew->get(azPosNew ++, aiSft) ;
-
-      if (lcOrg == lcNew)
-          liEql ++ ;
-      else if (lcOrg < 0 || lcNew < 0)
-          liRet = 1 ;
-      else
-          liRet = 2 ;
+    aiLen-- ;
   }
 
   #if debug
@@ -459,4 +814,181 @@ int JMatchTable::check (
   return liRet ;
 } /* check() */
 
+/* -----------------------------------------------------------------------------
+ * extend(): exact start and length of an equal region
+ *
+ * Looks back from the given positions, byte per byte, while both files are equal
+ * and not before the given minimum positions. Then looks forward over the buffered
+ * data, in bulk, up to the first difference. Only soft reads are done: the region
+ * ends at the end of the buffered data.
+ *
+ * Arguments:     &azPosOrg    in/out  position on first file  (out: start of region)
+ *                &azPosNew    in/out  position on second file (out: start of region)
+ *                &azMinOrg    in      do not look back before this position on first file
+ *                &azMinNew    in      do not look back before this position on second file
+ *
+ * Return value:  length of the equal region (0 = positions are not equal)
+ * ---------------------------------------------------------------------------*/
+off_t JMatchTable::extend (
+    off_t &azPosOrg, off_t &azPosNew,
+    off_t const &azMinOrg, off_t const &azMinNew
+    ) const
+{ off_t lzLen = 0 ;     // length of the region
+  const uchar *lpOrg ;  // buffered data on original file
+  const uchar *lpNew ;  // buffered data on new file
+  int liSpnOrg ;        // contiguous bytes at lpOrg
+  int liSpnNew ;        // contiguous bytes at lpNew
+  int liEql ;           // equal bytes within the span
+  int lcOrg ;
+  int lcNew ;
+
+  /* Look forward */
+  for (;;) {
+    lpOrg = mpFilOrg->getbuf(azPosOrg + lzLen, liSpnOrg) ;
+    lpNew = (lpOrg == null) ? null : mpFilNew->getbuf(azPosNew + lzLen, liSpnNew) ;
+    if (lpNew == null) {
+        /* not buffered yet: one soft read, then retry in bulk */
+        lcOrg = mpFilOrg->get(azPosOrg + lzLen, 2) ;
+        lcNew = mpFilNew->get(azPosNew + lzLen, 2) ;
+        if (lcOrg != lcNew || lcOrg < 0)
+            break ;
+        lzLen ++ ;
+        continue ;
+    }
+    if (liSpnOrg > liSpnNew) liSpnOrg = liSpnNew ;
+    liEql = ufExtSpn(lpOrg, lpNew, liSpnOrg) ;
+    lzLen += liEql ;
+    if (liEql < liSpnOrg)
+        break ;
+  }
+
+  /* Look back, only if the positions are equal */
+  if (lzLen > 0) {
+    while (azPosOrg > azMinOrg && azPosNew > azMinNew) {
+        lcOrg = mpFilOrg->get(azPosOrg - 1, 2) ;
+        lcNew = mpFilNew->get(azPosNew - 1, 2) ;
+        if (lcOrg != lcNew || lcOrg < 0)
+            break ;
+        azPosOrg -- ;
+        azPosNew -- ;
+        lzLen ++ ;
+    }
+  }
+
+  #if debug
+  if (JDebug::gbDbg[DBGCMP])
+    fprintf( JDebug::stddbg, "Ext (" P8zd "," P8zd ") Len %" PRIzd "\n", azPosOrg, azPosNew, lzLen) ;
+  #endif
+
+  return lzLen ;
+} /* extend() */
+
+/* -----------------------------------------------------------------------------
+ * ufExtSpn(): number of leading equal bytes in contiguous buffered data
+ * ---------------------------------------------------------------------------*/
+int JMatchTable::ufExtSpn ( const uchar *apOrg, const uchar *apNew, int aiSpn )
+{ int liIdx = 0 ;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  unsigned int liNeq ;  // bitmask of unequal bytes
+
+  for (; liIdx + 16 <= aiSpn; liIdx += 16) {
+    liNeq = ~ (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *) (apOrg + liIdx)),
+            _mm_loadu_si128((const __m128i *) (apNew + liIdx)))) & 0xffff ;
+    if (liNeq != 0)
+        return liIdx + __builtin_ctz(liNeq) ;
+  }
+#else
+  unsigned long long llOrg ;
+  unsigned long long llNew ;
+
+  for (; liIdx + 8 <= aiSpn; liIdx += 8) {
+    memcpy(&llOrg, apOrg + liIdx, 8) ;
+    memcpy(&llNew, apNew + liIdx, 8) ;
+    if (llOrg != llNew)
+        break ;
+  }
+#endif
+
+  for (; liIdx < aiSpn && apOrg[liIdx] == apNew[liIdx]; liIdx++) ;
+  return liIdx ;
+} /* ufExtSpn() */
+
+/* -----------------------------------------------------------------------------
+ * ufChkSpn(): check() on contiguous buffered data
+ *
+ * Compares 32 bytes at a time (SSE2) and walks the differences with bit tricks.
+ * Behaves exactly as comparing byte per byte in check().
+ *
+ * Arguments:     apOrg        in      data on first file
+ *                apNew        in      data on second file
+ *                aiSpn        in      number of bytes at apOrg and apNew (<= aiLen)
+ *                aiLen        in      number of bytes still to compare in check()
+ *                aiEql        in/out  number of subsequent equal bytes
+ *                aiRet        out     2 if no run of equal bytes can be found anymore
+ *
+ * Return value:  number of bytes compared
+ * ---------------------------------------------------------------------------*/
+int JMatchTable::ufChkSpn (
+    const uchar *apOrg, const uchar *apNew,
+    int aiSpn, int aiLen, int &aiEql, int &aiRet
+    )
+{ int liIdx = 0 ;
+  const int liRun = SMPSZE - 8 ;     // length of run to find
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  unsigned int liNeq ;  // bitmask of unequal bytes
+  int liBeg ;           // begin of current run of equal bytes within the block
+  int liPos ;           // position of next unequal byte within the block
+
+  for (; liIdx + 32 <= aiSpn; liIdx += 32) {
+    __m128i llOrg0 = _mm_loadu_si128((const __m128i *) (apOrg + liIdx)) ;
+    __m128i llNew0 = _mm_loadu_si128((const __m128i *) (apNew + liIdx)) ;
+    __m128i llOrg1 = _mm_loadu_si128((const __m128i *) (apOrg + liIdx + 16)) ;
+    __m128i llNew1 = _mm_loadu_si128((const __m128i *) (apNew + liIdx + 16)) ;
+    liNeq = ~ ((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(llOrg0, llNew0))
+             | ((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(llOrg1, llNew1)) << 16)) ;
+
+    for (liBeg = 0; liNeq != 0; liNeq &= liNeq - 1) {
+        liPos = __builtin_ctz(liNeq) ;
+        if (aiEql + liPos - liBeg >= liRun) {
+            /* run found before this difference */
+            liIdx += liBeg + liRun - aiEql ;
+            aiEql = liRun ;
+            return liIdx ;
+        }
+        if (aiLen - liIdx - liPos <= liRun) {
+            /* difference within the last bytes */
+            aiRet = 2 ;
+            return liIdx + liPos + 1 ;
+        }
+        aiEql = 0 ;
+        liBeg = liPos + 1 ;
+    }
+    if (aiEql + 32 - liBeg >= liRun) {
+        liIdx += liBeg + liRun - aiEql ;
+        aiEql = liRun ;
+        return liIdx ;
+    }
+    aiEql += 32 - liBeg ;
+  }
+#endif
+
+  /* remaining bytes */
+  for (; liIdx < aiSpn; liIdx++) {
+    if (apOrg[liIdx] == apNew[liIdx]) {
+        aiEql ++ ;
+        if (aiEql >= liRun)
+            return liIdx + 1 ;
+    } else if (aiLen - liIdx <= liRun) {
+        aiRet = 2 ;
+        return liIdx + 1 ;
+    } else {
+        aiEql = 0 ;
+    }
+  }
+  return liIdx ;
+} /* ufChkSpn() */
+
 } /* namespace JojoDiff */
@@ -29,6 +29,19 @@ JOutBin::JOutBin(FILE *apFilOut ) : mpFilOut(apFilOut), miOprCur(ESC), mzEqlCnt(
 JOutBin::~JOutBin() {
 }
 
+void JOutBin::reset(FILE *apFilOut) {
+    mpFilOut = apFilOut ;
+    miOprCur = ESC ;
+    mzEqlCnt = 0 ;
+    mbOutEsc = false ;
+    gzOutBytDta = 0 ;
+    gzOutBytCtl = 0 ;
+    gzOutBytDel = 0 ;
+    gzOutBytBkt = 0 ;
+    gzOutBytEsc = 0 ;
+    gzOutBytEql = 0 ;
+}
+
 /*******************************************************************************
 * Output functions
 *
@@ -102,6 +115,30 @@ void JOutBin::ufPutLen ( off_t azLen  )
 #endif
 } /* ufPutLen */
 
+/* ---------------------------------------------------------------
+ * ufPutSze returns the number of bytes ufPutLen outputs
+ * ---------------------------------------------------------------*/
+int JOutBin::ufPutSze ( off_t azLen )
+{ if (azLen <= 252) {
+    return 1 ;
+  } else if (azLen <= 508) {
+    return 2 ;
+  } else if (azLen <= 0xffff) {
+    return 3 ;
+#ifdef JDIFF_LARGEFILE
+  } else if (azLen <= 0xffffffff) {
+#else
+  } else {
+#endif
+    return 5 ;
+  }
+#ifdef JDIFF_LARGEFILE
+  else {
+    return 9 ;
+  }
+#endif
+} /* ufPutSze */
+
 /* ---------------------------------------------------------------
  * ufPutOpr outputs a new opcode and closes the previous
  * data stream.
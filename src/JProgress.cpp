@@ -0,0 +1,75 @@
+/*
+ * JProgress.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JProgress.h"
+#include "JFile.h"
+
+namespace JojoDiff {
+
+JProgress::JProgress(off_t azSzeOrg, off_t azSzeNew, long alItv)
+: mzSzeOrg(azSzeOrg), mzSzeNew(azSzeNew),
+  mbCnl(0), mlItv(alItv), miPhs(-1), mlPhsTim(0), mlRptTim(0)
+{
+}
+
+/**
+ * Progress update: report at most once per interval, and on every change of phase.
+ * Throughput and estimated time are calculated on the original file while
+ * prescanning, on the new file while comparing.
+ */
+bool JProgress::update(int aiPhs, off_t azPosOrg, off_t azPosNew)
+{
+    long long llTim = JFile::ustime() ;
+    off_t lzPos ;
+    off_t lzSze ;
+    double ldPct ;
+    double ldBps ;
+    long llEta ;
+
+    if (aiPhs != miPhs) {
+        miPhs = aiPhs ;
+        mlPhsTim = llTim ;
+    } else if (llTim - mlRptTim < mlItv) {
+        return ! cancelled() ;
+    }
+    mlRptTim = llTim ;
+
+    if (aiPhs == PRG_SCN) {
+        lzPos = azPosOrg ;
+        lzSze = mzSzeOrg ;
+    } else {
+        lzPos = azPosNew ;
+        lzSze = mzSzeNew ;
+    }
+    ldPct = (lzSze > 0) ? 100.0 * lzPos / lzSze : 100.0 ;
+    if (ldPct > 100.0) ldPct = 100.0 ;
+    ldBps = (llTim > mlPhsTim) ? lzPos * 1000000.0 / (llTim - mlPhsTim) : 0.0 ;
+    if (aiPhs == PRG_END)
+        llEta = 0 ;
+    else if (ldBps > 0.0)
+        llEta = (long) ((lzSze > lzPos ? lzSze - lzPos : 0) / ldBps) ;
+    else
+        llEta = -1 ;
+
+    report(aiPhs, azPosOrg, azPosNew, ldPct, ldBps, llEta) ;
+    return ! cancelled() ;
+} /* update */
+}
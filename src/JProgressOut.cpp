@@ -0,0 +1,46 @@
+/*
+ * JProgressOut.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+
+#include "JProgressOut.h"
+
+namespace JojoDiff {
+
+JProgressOut::JProgressOut(FILE *apFilOut, off_t azSzeOrg, off_t azSzeNew, long alItv)
+: JProgress(azSzeOrg, azSzeNew, alItv), mpFilOut(apFilOut)
+{
+}
+
+void JProgressOut::report(int aiPhs, off_t azPosOrg, off_t azPosNew,
+                          double adPct, double adBps, long alEta)
+{
+    static const char *scPhs[] = { "prescan", "diff", "done" } ;
+
+    if (mpFilOut == null)
+        return ;
+
+    fprintf(mpFilOut, "progress phase=%s org=%" PRIzd " new=%" PRIzd " orgsize=%" PRIzd " newsize=%" PRIzd
+            " percent=%.1f rate=%.0f eta=%ld\n",
+            scPhs[aiPhs], azPosOrg, azPosNew, mzSzeOrg, mzSzeNew, adPct, adBps, alEta) ;
+    fflush(mpFilOut) ;
+}
+}
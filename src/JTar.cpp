@@ -0,0 +1,369 @@
+/*
+ * JTar.cpp
+ *
+ * Copyright (C) 2002-2011 Joris Heirbaut
+ *
+ * This file is part of JojoDiff.
+ *
+ * JojoDiff is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "JTar.h"
+#include "JDebug.h"
+
+using namespace std ;
+
+#define TAR_EXT (1024 * 1024)           // Maximum size of an extended header that is read
+
+namespace JojoDiff {
+
+/**
+ * Create an empty list of members.
+ */
+JTar::JTar()
+: mpMbr(null), mpSrt(null), miMbrCnt(0), miMbrMax(0), mzEnd(0),
+  mpBegOrg(null), mpBegNew(null), miChkCnt(0), miChkMax(0), miParCnt(0)
+{
+}
+
+/*
+ * Destructor
+ */
+JTar::~JTar() {
+    for (int liMbr = 0; liMbr < miMbrCnt; liMbr++) free(mpMbr[liMbr].isNam) ;
+    free(mpMbr) ;
+    free(mpSrt) ;
+    free(mpBegOrg) ;
+    free(mpBegNew) ;
+}
+
+/**
+ * Read the member headers of an archive, skipping the data.
+ */
+int JTar::load (const char *asFil)
+{
+    uchar lcHdr[TAR_BLK] ;
+    char lcNam[TAR_BLK] ;
+    char *lsLng = null ;        // name from a pax or GNU long name header
+    char *lsDta ;
+    char *lsVal ;
+    off_t lzPaxSze = -1 ;       // size from a pax header
+    off_t lzPos = 0 ;           // position of the current header
+    off_t lzBeg = -1 ;          // first header of the current member
+    off_t lzSze ;
+    off_t lzEnd ;
+    int liIdx ;
+    int liSum ;
+    FILE *lpFil ;
+
+    lpFil = jfopen(asFil, "rb") ;
+    if (lpFil == null)
+        return - EXI_FRT ;
+
+    while (fread(lcHdr, 1, TAR_BLK, lpFil) == TAR_BLK) {
+        /* End of archive, or a valid header */
+        for (liIdx = 0; liIdx < TAR_BLK && lcHdr[liIdx] == 0; liIdx++) ;
+        if (liIdx == TAR_BLK)
+            break ;
+        for (liIdx = 0, liSum = 0; liIdx < TAR_BLK; liIdx++)
+            liSum += (liIdx >= 148 && liIdx < 156) ? ' ' : lcHdr[liIdx] ;
+        if (ufNum(&lcHdr[148], 8) != liSum)
+            break ;
+        lzSze = ufNum(&lcHdr[124], 12) ;
+        if (lzSze < 0)
+            break ;
+
+        if (lzBeg < 0)
+            lzBeg = lzPos ;
+        lzEnd = lzPos + TAR_BLK + (lzSze + TAR_BLK - 1) / TAR_BLK * TAR_BLK ;
+
+        switch (lcHdr[156]) {
+        case 'x':   // pax extended header: path and size of the next member
+        case 'L':   // GNU long name of the next member
+            if (lzSze > 0 && lzSze <= TAR_EXT) {
+                lsDta = (char *) malloc(lzSze + 1) ;
+#ifndef __MINGW32__
+                if (lsDta == null)
+                    throw bad_alloc() ;
+#endif
+                if (fread(lsDta, 1, lzSze, lpFil) != (size_t) lzSze) {
+                    free(lsDta) ;
+                    break ;
+                }
+                lsDta[lzSze] = '\0' ;
+                if (lcHdr[156] == 'L') {
+                    free(lsLng) ;
+                    lsLng = strdup(lsDta) ;
+                } else {
+                    if ((lsVal = ufPax(lsDta, lzSze, "size")) != null)
+                        lzPaxSze = strtoll(lsVal, null, 10) ;
+                    if ((lsVal = ufPax(lsDta, lzSze, "path")) != null) {
+                        free(lsLng) ;
+                        lsLng = strdup(lsVal) ;
+                    }
+                }
+                free(lsDta) ;
+            }
+            break ;
+
+        case 'g':   // pax global header, GNU long link name: kept with the next member
+        case 'K':
+            break ;
+
+        default:
+            /* The member: links, devices, directories and fifos have no data */
+            if (lzPaxSze >= 0)
+                lzSze = lzPaxSze ;
+            if (lcHdr[156] >= '1' && lcHdr[156] <= '6')
+                lzSze = 0 ;
+            lzEnd = lzPos + TAR_BLK + (lzSze + TAR_BLK - 1) / TAR_BLK * TAR_BLK ;
+
+            if (lsLng != null) {
+                ufAddMbr(lsLng, lzBeg, lzEnd) ;
+            } else if (memcmp(&lcHdr[257], "ustar\0", 6) == 0 && lcHdr[345] != '\0') {
+                snprintf(lcNam, sizeof(lcNam), "%.155s/%.100s", (char *) &lcHdr[345], (char *) &lcHdr[0]) ;
+                ufAddMbr(lcNam, lzBeg, lzEnd) ;
+            } else {
+                snprintf(lcNam, sizeof(lcNam), "%.100s", (char *) &lcHdr[0]) ;
+                ufAddMbr(lcNam, lzBeg, lzEnd) ;
+            }
+            free(lsLng) ;
+            lsLng = null ;
+            lzPaxSze = -1 ;
+            lzBeg = -1 ;
+            mzEnd = lzEnd ;
+            break ;
+        }
+
+        lzPos = lzEnd ;
+        if (jfseek(lpFil, lzPos, SEEK_SET) != 0)
+            break ;
+    }
+    free(lsLng) ;
+    jfclose(lpFil) ;
+
+#if debug
+    if (JDebug::gbDbg[DBGPRG])
+        fprintf(JDebug::stddbg, "JTar::load(%s): %d members up to " P8zd ".\n", asFil, miMbrCnt, mzEnd) ;
+#endif
+    return (miMbrCnt == 0) ? - EXI_RED : 0 ;
+} /* load */
+
+/**
+ * Pair the members on name and lay out the chunks of this archive: members,
+ * then the trailer (end-of-archive blocks and whatever could not be parsed).
+ */
+void JTar::pair (JTar const &aoOrg, off_t azSzeOrg, off_t azSzeNew, off_t azChkSze)
+{
+    off_t lzOrgNxt = 0 ;        // end of the previous member on the original
+    off_t lzChkBeg = 0 ;        // start of the current chunk
+    off_t lzChkDlt = 0 ;        // start on the original - start on this archive, of the current chunk
+    off_t lzBeg ;
+    off_t lzEnd ;
+    int liMbr ;
+    int liOrg ;
+
+    if (azChkSze < SMPSZE) azChkSze = SMPSZE ;
+    miChkCnt = 0 ;
+    miParCnt = 0 ;
+    ufAddChk(0, 0) ;
+
+    for (liMbr = 0; liMbr < miMbrCnt; liMbr++) {
+        lzBeg = mpMbr[liMbr].izBeg ;
+        lzEnd = (mpMbr[liMbr].izEnd < azSzeNew) ? mpMbr[liMbr].izEnd : azSzeNew ;
+        if (lzBeg >= lzEnd)
+            break ;
+
+        liOrg = aoOrg.find(mpMbr[liMbr].isNam) ;
+        if (liOrg >= 0) {
+            ufLay(lzBeg, lzEnd, aoOrg.mpMbr[liOrg].izBeg, azSzeOrg, azChkSze, lzChkBeg, lzChkDlt) ;
+            lzOrgNxt = aoOrg.mpMbr[liOrg].izEnd ;
+            miParCnt++ ;
+        } else {
+            ufLay(lzBeg, lzEnd, lzOrgNxt, azSzeOrg, azChkSze, lzChkBeg, lzChkDlt) ;
+            lzOrgNxt += lzEnd - lzBeg ;
+        }
+    }
+    if (mzEnd < azSzeNew)
+        ufLay(mzEnd, azSzeNew, aoOrg.mzEnd, azSzeOrg, azChkSze, lzChkBeg, lzChkDlt) ;
+} /* pair */
+
+/**
+ * Lay out the chunks of a member: start a chunk at the member when its start on
+ * the original does not follow from the current chunk (or the current chunk is
+ * large enough), and split the member into chunks of at most azChkSze.
+ */
+void JTar::ufLay (off_t azBegNew, off_t azEndNew, off_t azBegOrg, off_t azSzeOrg, off_t azChkSze,
+                  off_t &azChkBeg, off_t &azChkDlt)
+{
+    off_t lzMin = (azChkSze < TAR_MIN) ? azChkSze : TAR_MIN ;
+    off_t lzDlt = azBegOrg - azBegNew ;
+    off_t lzPos ;
+
+    if (azBegNew == azChkBeg) {
+        /* The current chunk starts here: start it on the member's counterpart */
+        mpBegOrg[miChkCnt - 1] = (azBegOrg < azSzeOrg) ? azBegOrg : azSzeOrg ;
+        azChkDlt = lzDlt ;
+    } else if (azBegNew - azChkBeg >= lzMin && (lzDlt != azChkDlt || azBegNew - azChkBeg >= azChkSze)) {
+        ufAddChk(azBegNew, azBegOrg < azSzeOrg ? azBegOrg : azSzeOrg) ;
+        azChkBeg = azBegNew ;
+        azChkDlt = lzDlt ;
+    }
+
+    for (lzPos = azChkBeg + azChkSze; lzPos < azEndNew; lzPos += azChkSze) {
+        ufAddChk(lzPos, lzPos + lzDlt < azSzeOrg ? lzPos + lzDlt : azSzeOrg) ;
+        azChkBeg = lzPos ;
+        azChkDlt = lzDlt ;
+    }
+} /* ufLay */
+
+/**
+ * Number of a member on name: the first one of that name (-1 = none)
+ */
+int JTar::find (const char *asNam) const
+{
+    int liLow = 0 ;
+    int liHig = miMbrCnt ;
+
+    while (liLow < liHig) {
+        int liMid = (liLow + liHig) / 2 ;
+        if (strcmp(mpMbr[mpSrt[liMid]].isNam, asNam) < 0)
+            liLow = liMid + 1 ;
+        else
+            liHig = liMid ;
+    }
+    if (liLow < miMbrCnt && strcmp(mpMbr[mpSrt[liLow]].isNam, asNam) == 0)
+        return mpSrt[liLow] ;
+    return -1 ;
+} /* find */
+
+/**
+ * Add a member: also sorted on name, after the members of the same name.
+ */
+void JTar::ufAddMbr (const char *asNam, off_t azBeg, off_t azEnd)
+{
+    int liLow ;
+    int liHig ;
+
+    if (miMbrCnt == miMbrMax) {
+        miMbrMax = (miMbrMax == 0) ? 256 : miMbrMax * 2 ;
+        mpMbr = (rMbr *) realloc(mpMbr, miMbrMax * sizeof(rMbr)) ;
+        mpSrt = (int *) realloc(mpSrt, miMbrMax * sizeof(int)) ;
+#ifndef __MINGW32__
+        if (mpMbr == null || mpSrt == null)
+            throw bad_alloc() ;
+#endif
+    }
+    rMbr &lrMbr = mpMbr[miMbrCnt] ;
+    lrMbr.isNam = strdup(asNam) ;
+    lrMbr.izBeg = azBeg ;
+    lrMbr.izEnd = azEnd ;
+
+    for (liLow = 0, liHig = miMbrCnt; liLow < liHig; ) {
+        int liMid = (liLow + liHig) / 2 ;
+        if (strcmp(mpMbr[mpSrt[liMid]].isNam, asNam) <= 0)
+            liLow = liMid + 1 ;
+        else
+            liHig = liMid ;
+    }
+    memmove(&mpSrt[liLow + 1], &mpSrt[liLow], (miMbrCnt - liLow) * sizeof(int)) ;
+    mpSrt[liLow] = miMbrCnt ;
+    miMbrCnt++ ;
+} /* ufAddMbr */
+
+/**
+ * Add a chunk
+ */
+void JTar::ufAddChk (off_t azBegNew, off_t azBegOrg)
+{
+    if (miChkCnt == miChkMax) {
+        miChkMax = (miChkMax == 0) ? 256 : miChkMax * 2 ;
+        mpBegOrg = (off_t *) realloc(mpBegOrg, miChkMax * sizeof(off_t)) ;
+        mpBegNew = (off_t *) realloc(mpBegNew, miChkMax * sizeof(off_t)) ;
+#ifndef __MINGW32__
+        if (mpBegOrg == null || mpBegNew == null)
+            throw bad_alloc() ;
+#endif
+    }
+    mpBegOrg[miChkCnt] = (azBegOrg < 0) ? 0 : azBegOrg ;
+    mpBegNew[miChkCnt] = azBegNew ;
+    miChkCnt++ ;
+} /* ufAddChk */
+
+/**
+ * Numeric header field: octal digits, optionally surrounded by blanks or
+ * nulls, or a base-256 number when the high bit of the first byte is set.
+ * @return the value, -1 = invalid
+ */
+off_t JTar::ufNum (const uchar *acFld, int aiLen)
+{
+    off_t lzVal = 0 ;
+    int liIdx = 0 ;
+
+    if (acFld[0] & 0x80) {
+        if (acFld[0] & 0x40)
+            return -1 ;     // negative
+        lzVal = acFld[0] & 0x3f ;
+        for (liIdx = 1; liIdx < aiLen; liIdx++) {
+            if (lzVal > (MAX_OFF_T >> 8))
+                return -1 ;
+            lzVal = (lzVal << 8) | acFld[liIdx] ;
+        }
+        return lzVal ;
+    }
+
+    while (liIdx < aiLen && acFld[liIdx] == ' ') liIdx++ ;
+    for (; liIdx < aiLen && acFld[liIdx] >= '0' && acFld[liIdx] <= '7'; liIdx++) {
+        if (lzVal > (MAX_OFF_T >> 3))
+            return -1 ;
+        lzVal = (lzVal << 3) + (acFld[liIdx] - '0') ;
+    }
+    for (; liIdx < aiLen; liIdx++) {
+        if (acFld[liIdx] != ' ' && acFld[liIdx] != '\0')
+            return -1 ;
+    }
+    return lzVal ;
+} /* ufNum */
+
+/**
+ * Value of a pax record ("<len> <key>=<value>\n"): terminated in place.
+ * @return the value, null = no such record
+ */
+char *JTar::ufPax (char *asDta, off_t azLen, const char *asKey)
+{
+    size_t llKey = strlen(asKey) ;
+    off_t lzPos = 0 ;
+    off_t lzRec ;
+    char *lsRec ;
+    char *lsEnd ;
+
+    while (lzPos < azLen) {
+        lsRec = asDta + lzPos ;
+        lzRec = strtoll(lsRec, &lsEnd, 10) ;
+        if (lzRec <= 0 || lzPos + lzRec > azLen || *lsEnd != ' ')
+            return null ;
+        lsEnd++ ;
+        if (strncmp(lsEnd, asKey, llKey) == 0 && lsEnd[llKey] == '=') {
+            lsRec[lzRec - 1] = '\0' ;   // the newline
+            return lsEnd + llKey + 1 ;
+        }
+        lzPos += lzRec ;
+    }
+    return null ;
+} /* ufPax */
+}
@@ -38,6 +38,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "JDefs.h"
 
 #define BLKSZE 4096
@@ -55,6 +57,7 @@
  */
 int giVerbse = 0;       /* Verbose level 0=no, 1=normal, 2=high            */
 int gbTst = false;      /* Test mode = only display contents of patch file, no i/o */
+int gbDir = false;      /* Directory mode = apply a container from jdiff --dir  */
 FILE *stddbg;           /* Debug output to stddbg or stdout                */
 
 /*******************************************************************************
@@ -293,6 +296,375 @@ void jpatch ( FILE *asFilOrg, FILE *asFilPch, FILE *asFilOut )
   }
 }
 
+/*******************************************************************************
+* Directory patch: rebuild the new tree from the original tree and a container
+* written by jdiff --dir (see JDC_HDR in JDefs.h).
+*******************************************************************************/
+
+/* Create a directory and its parents (up to, not including, the last slash when abPar) */
+void ufMkd ( char *asPth, int abPar )
+{
+  char *lsSep ;
+
+  for (lsSep = strchr(asPth + 1, '/'); lsSep != NULL; lsSep = strchr(lsSep + 1, '/')) {
+    *lsSep = '\0' ;
+#ifdef __MINGW32__
+    mkdir(asPth) ;
+#else
+    mkdir(asPth, 0777) ;
+#endif
+    *lsSep = '/' ;
+  }
+  if (! abPar) {
+#ifdef __MINGW32__
+    mkdir(asPth) ;
+#else
+    mkdir(asPth, 0777) ;
+#endif
+  }
+}
+
+/* Check a name from the container: relative, non-empty and without ".." components */
+int ufChkNam ( const char *asNam )
+{
+  const char *lsCmp ;
+
+  if (asNam[0] == '\0' || asNam[0] == '/' || asNam[0] == '\\')
+    return false ;
+#ifdef __MINGW32__
+  if (asNam[1] == ':')
+    return false ;
+#endif
+  for (lsCmp = asNam; *lsCmp != '\0'; lsCmp++) {
+    if ((lsCmp == asNam || lsCmp[-1] == '/' || lsCmp[-1] == '\\')
+        && lsCmp[0] == '.' && lsCmp[1] == '.'
+        && (lsCmp[2] == '\0' || lsCmp[2] == '/' || lsCmp[2] == '\\'))
+      return false ;
+  }
+  return true ;
+}
+
+/* Copy azLen bytes (all when < 0) from one file to another */
+void ufCpy ( FILE *apInp, FILE *apOut, off_t azLen )
+{
+  char lcDta[BLKSZE] ;
+  size_t llRed ;
+
+  while (azLen != 0) {
+    llRed = fread(lcDta, 1, (azLen < 0 || azLen > BLKSZE) ? BLKSZE : (size_t) azLen, apInp) ;
+    if (llRed == 0) {
+      if (azLen < 0 && ! ferror(apInp))
+        return ;
+      fprintf(stderr, "Error reading file.\n");
+      exit(EXI_RED);
+    }
+    if (fwrite(lcDta, 1, llRed, apOut) != llRed) {
+      fprintf(stderr, "Error writing output file.\n");
+      exit(EXI_WRI);
+    }
+    if (azLen > 0)
+      azLen -= llRed ;
+  }
+}
+
+/*
+ * Virtual original of a cross-file container: the V members, concatenated.
+ * With glibc, the members are read in place through a stream of their own
+ * (fopencookie), one member file open at a time. Elsewhere, they are copied
+ * into a temporary file when first needed, which takes their size on disk.
+ */
+typedef struct tVir {
+  int    iiCnt ;            /* number of members                          */
+  int    iiMax ;            /* allocated number of members                */
+  char **isNam ;            /* file name of each member                   */
+  off_t *izBeg ;            /* offset of each member, then the total size */
+  int    iiCur ;            /* member currently open (-1 = none)          */
+  FILE  *ipCur ;            /* its file                                   */
+  off_t  izPos ;            /* read position on the virtual original      */
+} rVir ;
+
+/* Add a member at the end of the virtual original */
+void ufVirAdd ( rVir *apVir, const char *asNam, off_t azLen )
+{
+  if (apVir->iiCnt == apVir->iiMax) {
+    apVir->iiMax = (apVir->iiMax == 0) ? 64 : apVir->iiMax * 2 ;
+    apVir->isNam = (char **) realloc(apVir->isNam, apVir->iiMax * sizeof(char *)) ;
+    apVir->izBeg = (off_t *) realloc(apVir->izBeg, (apVir->iiMax + 1) * sizeof(off_t)) ;
+    if (apVir->isNam == NULL || apVir->izBeg == NULL) {
+      fprintf(stderr, "Not enough memory.\n");
+      exit(EXI_MEM);
+    }
+    if (apVir->iiCnt == 0)
+      apVir->izBeg[0] = 0 ;
+  }
+  apVir->isNam[apVir->iiCnt] = strdup(asNam) ;
+  if (apVir->isNam[apVir->iiCnt] == NULL) {
+    fprintf(stderr, "Not enough memory.\n");
+    exit(EXI_MEM);
+  }
+  apVir->izBeg[apVir->iiCnt + 1] = apVir->izBeg[apVir->iiCnt] + azLen ;
+  apVir->iiCnt++ ;
+}
+
+#ifdef __GLIBC__
+/* Stream read: from the member(s) holding the read position */
+ssize_t ufVirRed ( void *apCki, char *acBuf, size_t alSze )
+{
+  rVir *lpVir = (rVir *) apCki ;
+  size_t llRed = 0 ;
+  size_t llLen ;
+  int liMbr ;
+
+  while (llRed < alSze && lpVir->izPos < lpVir->izBeg[lpVir->iiCnt]) {
+    /* usually the current member, or the next one */
+    liMbr = (lpVir->iiCur >= 0) ? lpVir->iiCur : 0 ;
+    while (lpVir->izPos < lpVir->izBeg[liMbr])
+      liMbr-- ;
+    while (lpVir->izPos >= lpVir->izBeg[liMbr + 1])
+      liMbr++ ;
+    if (liMbr != lpVir->iiCur) {
+      if (lpVir->ipCur != NULL)
+        jfclose(lpVir->ipCur) ;
+      lpVir->ipCur = jfopen(lpVir->isNam[liMbr], "rb") ;
+      lpVir->iiCur = (lpVir->ipCur == NULL) ? -1 : liMbr ;
+      if (lpVir->ipCur == NULL)
+        return -1 ;
+    }
+
+    llLen = alSze - llRed ;
+    if ((off_t) llLen > lpVir->izBeg[liMbr + 1] - lpVir->izPos)
+      llLen = (size_t) (lpVir->izBeg[liMbr + 1] - lpVir->izPos) ;
+    if (jftell(lpVir->ipCur) != lpVir->izPos - lpVir->izBeg[liMbr]
+        && jfseek(lpVir->ipCur, lpVir->izPos - lpVir->izBeg[liMbr], SEEK_SET) != 0)
+      return -1 ;
+    if (fread(acBuf + llRed, 1, llLen, lpVir->ipCur) != llLen)
+      return -1 ;
+    llRed += llLen ;
+    lpVir->izPos += llLen ;
+  }
+  return (ssize_t) llRed ;
+}
+
+/* Stream seek: only moves the read position */
+int ufVirSek ( void *apCki, off64_t *azPos, int aiWhn )
+{
+  rVir *lpVir = (rVir *) apCki ;
+  off_t lzPos ;
+
+  switch (aiWhn) {
+    case SEEK_SET: lzPos = *azPos ; break ;
+    case SEEK_CUR: lzPos = lpVir->izPos + *azPos ; break ;
+    case SEEK_END: lzPos = lpVir->izBeg[lpVir->iiCnt] + *azPos ; break ;
+    default: return -1 ;
+  }
+  if (lzPos < 0)
+    return -1 ;
+  lpVir->izPos = lzPos ;
+  *azPos = lzPos ;
+  return 0 ;
+}
+
+/* Stream close: close the open member */
+int ufVirCls ( void *apCki )
+{
+  rVir *lpVir = (rVir *) apCki ;
+
+  if (lpVir->ipCur != NULL)
+    jfclose(lpVir->ipCur) ;
+  lpVir->ipCur = NULL ;
+  lpVir->iiCur = -1 ;
+  return 0 ;
+}
+#endif
+
+/* Open the virtual original for reading (an empty one without members) */
+FILE *ufVirOpn ( rVir *apVir )
+{
+  FILE *lpFil ;
+
+  if (apVir->iiCnt == 0)
+    ufVirAdd(apVir, "", 0) ;  /* never opened: no data */
+#ifdef __GLIBC__
+  cookie_io_functions_t ltFun = { ufVirRed, NULL, ufVirSek, ufVirCls } ;
+
+  apVir->iiCur = -1 ;
+  apVir->ipCur = NULL ;
+  apVir->izPos = 0 ;
+  lpFil = fopencookie(apVir, "rb", ltFun) ;
+  if (lpFil == NULL) {
+    fprintf(stderr, "Not enough memory.\n");
+    exit(EXI_MEM);
+  }
+#else
+  FILE *lpFilOrg ;
+
+  lpFil = tmpfile() ;
+  if (lpFil == NULL) {
+    fprintf(stderr, "Error writing temporary file.\n");
+    exit(EXI_WRI);
+  }
+  for (int liMbr = 0; liMbr < apVir->iiCnt; liMbr++) {
+    if (apVir->izBeg[liMbr + 1] == apVir->izBeg[liMbr])
+      continue ;
+    lpFilOrg = jfopen(apVir->isNam[liMbr], "rb") ;
+    if (lpFilOrg == NULL) {
+      fprintf(stddbg, "Could not open data file %s for reading.\n", apVir->isNam[liMbr]) ;
+      exit(EXI_FRT);
+    }
+    ufCpy(lpFilOrg, lpFil, apVir->izBeg[liMbr + 1] - apVir->izBeg[liMbr]) ;
+    jfclose(lpFilOrg) ;
+  }
+#endif
+  return lpFil ;
+}
+
+void jpatchdir ( const char *asDirOrg, FILE *asFilPch, const char *asDirOut )
+{
+  char lcLin[JDC_LIN] ;     /* Current entry                          */
+  char lcOrg[JDC_LIN] ;     /* Full name of the original file         */
+  char lcOut[JDC_LIN] ;     /* Full name of the new file              */
+  char *lsOrg ;             /* Original file in the entry             */
+  char *lsNew ;             /* New file in the entry                  */
+  char *lsEnd ;
+  off_t lzLen = 0 ;         /* Length of the data of the entry        */
+  struct stat ltStt ;
+  rVir ltVir = { 0, 0, NULL, NULL, -1, NULL, 0 } ;  /* Virtual original: the V members */
+  FILE *lpFilVir = NULL ;   /* and its stream, opened on the first X entry */
+  FILE *lpFilOrg ;
+  FILE *lpFilPch ;
+  FILE *lpFilOut ;
+
+  if (fgets(lcLin, sizeof(lcLin), asFilPch) == NULL || strcmp(lcLin, JDC_HDR) != 0) {
+    fprintf(stderr, "Not a directory patch.\n");
+    exit(EXI_SCD);
+  }
+  snprintf(lcOut, sizeof(lcOut), "%s", asDirOut) ;
+  ufMkd(lcOut, false) ;
+
+  while (fgets(lcLin, sizeof(lcLin), asFilPch) != NULL && lcLin[0] != 'E') {
+    /* Parse: <type> [<len>] <original>[\t<new>] */
+    lsEnd = strchr(lcLin, '\n') ;
+    if (lsEnd == NULL || lcLin[1] != ' ') {
+      fprintf(stderr, "Invalid entry in directory patch.\n");
+      exit(EXI_RED);
+    }
+    *lsEnd = '\0' ;
+    lsOrg = lcLin + 2 ;
+    if (lcLin[0] == 'P' || lcLin[0] == 'N' || lcLin[0] == 'V' || lcLin[0] == 'X') {
+      lzLen = strtoll(lsOrg, &lsOrg, 10) ;
+      lsOrg++ ;
+    }
+    lsNew = strchr(lsOrg, '\t') ;
+    if (lsNew != NULL)
+      *lsNew++ = '\0' ;
+    else if (lcLin[0] == 'N' || lcLin[0] == 'M' || lcLin[0] == 'X')
+      lsNew = lsOrg ;
+    if (! ufChkNam(lsOrg) || (lsNew != NULL && ! ufChkNam(lsNew))) {
+      fprintf(stderr, "Invalid file name in directory patch.\n");
+      exit(EXI_RED);
+    }
+    snprintf(lcOrg, sizeof(lcOrg), "%s/%s", asDirOrg, lsOrg) ;
+    if (lsNew != NULL)
+      snprintf(lcOut, sizeof(lcOut), "%s/%s", asDirOut, lsNew) ;
+
+    if (giVerbse > 0)
+      fprintf(stddbg, "%c %s%s%s\n", lcLin[0], lsOrg, lsNew != NULL && lsNew != lsOrg ? " -> " : "",
+              lsNew != NULL && lsNew != lsOrg ? lsNew : "") ;
+
+    switch (lcLin[0]) {
+      case 'M':
+        ufMkd(lcOut, false) ;
+        break ;
+
+      case 'D':
+        break ;
+
+      case 'V':
+        /* Append the member to the virtual original: it must not have changed */
+        lpFilOrg = jfopen(lcOrg, "rb") ;
+        if (lpFilOrg == NULL || stat(lcOrg, &ltStt) != 0 || ltStt.st_size != lzLen) {
+          fprintf(stddbg, "Could not open data file %s for reading, or its size differs.\n", lcOrg) ;
+          exit(EXI_FRT);
+        }
+        jfclose(lpFilOrg) ;
+        ufVirAdd(&ltVir, lcOrg, lzLen) ;
+        break ;
+
+      case 'C':
+      case 'N':
+      case 'P':
+      case 'X':
+        if (lsNew == NULL) {
+          fprintf(stderr, "Invalid entry in directory patch.\n");
+          exit(EXI_RED);
+        }
+        ufMkd(lcOut, true) ;
+        lpFilOut = jfopen(lcOut, "wb") ;
+        if (lpFilOut == NULL) {
+          fprintf(stddbg, "Could not open output file %s for writing.\n", lcOut) ;
+          exit(EXI_OUT);
+        }
+        if (lcLin[0] == 'N') {
+          ufCpy(asFilPch, lpFilOut, lzLen) ;
+        } else if (lcLin[0] == 'X') {
+          /* Patch against the virtual original (empty without V members) */
+          if (lpFilVir == NULL)
+            lpFilVir = ufVirOpn(&ltVir) ;
+          lpFilPch = tmpfile() ;
+          if (lpFilPch == NULL) {
+            fprintf(stderr, "Error writing temporary file.\n");
+            exit(EXI_WRI);
+          }
+          ufCpy(asFilPch, lpFilPch, lzLen) ;
+          rewind(lpFilPch) ;
+          rewind(lpFilVir) ;
+          jpatch(lpFilVir, lpFilPch, lpFilOut) ;
+          jfclose(lpFilPch) ;
+        } else {
+          lpFilOrg = jfopen(lcOrg, "rb") ;
+          if (lpFilOrg == NULL) {
+            fprintf(stddbg, "Could not open data file %s for reading.\n", lcOrg) ;
+            exit(EXI_FRT);
+          }
+          if (lcLin[0] == 'C') {
+            ufCpy(lpFilOrg, lpFilOut, -1) ;
+          } else {
+            /* The patch is taken apart: jpatch reads up to the end of its file */
+            lpFilPch = tmpfile() ;
+            if (lpFilPch == NULL) {
+              fprintf(stderr, "Error writing temporary file.\n");
+              exit(EXI_WRI);
+            }
+            ufCpy(asFilPch, lpFilPch, lzLen) ;
+            rewind(lpFilPch) ;
+            jpatch(lpFilOrg, lpFilPch, lpFilOut) ;
+            jfclose(lpFilPch) ;
+          }
+          jfclose(lpFilOrg) ;
+        }
+        if (jfclose(lpFilOut) != 0) {
+          fprintf(stderr, "Error writing output file.\n");
+          exit(EXI_WRI);
+        }
+        break ;
+
+      default:
+        fprintf(stderr, "Invalid entry in directory patch.\n");
+        exit(EXI_RED);
+    }
+  }
+  if (lpFilVir != NULL)
+    jfclose(lpFilVir) ;
+  while (ltVir.iiCnt > 0)
+    free(ltVir.isNam[-- ltVir.iiCnt]) ;
+  free(ltVir.isNam) ;
+  free(ltVir.izBeg) ;
+  if (lcLin[0] != 'E') {
+    fprintf(stderr, "Directory patch is incomplete.\n");
+    exit(EXI_RED);
+  }
+}
+
 /*******************************************************************************
 * Main function
 *******************************************************************************/
@@ -328,6 +700,8 @@ int main(int aiArgCnt, char *acArg[])
     } else if (strcmp(acArg[liOptArgCnt], "-t") == 0) {
         giVerbse = 2;
         gbTst = true ;
+    } else if (strcmp(acArg[liOptArgCnt], "--dir") == 0) {
+        gbDir = true ;
     } else {
       lbOptArgDne = true;
       liOptArgCnt--;
@@ -358,11 +732,17 @@ int main(int aiArgCnt, char *acArg[])
 
   if ((aiArgCnt - liOptArgCnt < 3) || (lcHlp == 'h')) {
     fprintf(stddbg, "Usage: jpatch [options] <original file> <patch file> [<output file>]\n") ;
+    fprintf(stddbg, "       jpatch [options] --dir <original dir> <patch file> <output dir>\n") ;
     fprintf(stddbg, "  -v               Verbose: version and licence.\n");
     fprintf(stddbg, "  -vv              Verbose: debug info.\n");
     fprintf(stddbg, "  -vvv             Verbose: more debug info.\n");
     fprintf(stddbg, "  -h               Help (this text).\n");
     fprintf(stddbg, "  -t               Test: no output file.\n");
+    fprintf(stddbg, "  --dir            Directory patch (from jdiff --dir): rebuild the new tree.\n");
+#ifndef __GLIBC__
+    fprintf(stddbg, "                   With --cross patches, the original files are first copied\n");
+    fprintf(stddbg, "                   to a temporary file: this takes their size on disk.\n");
+#endif
     /*fprintf(stddbg, "  -l               Ascii patch file.\n");*/
     fprintf(stddbg, "Principles:\n");
     fprintf(stddbg, "  JPATCH reapplies a diff file, generated by jdiff, to the <original file>,\n") ;
@@ -375,6 +755,26 @@ int main(int aiArgCnt, char *acArg[])
     exit(EXI_ARG);
   }
 
+  /* Directory patch */
+  if (gbDir) {
+    if (aiArgCnt - liOptArgCnt < 4) {
+      fprintf(stddbg, "Option --dir needs an output directory.\n") ;
+      exit(EXI_ARG);
+    }
+    lcFilNamPch = acArg[liOptArgCnt + 2];
+    if ( strcmp(lcFilNamPch, std) == 0 )
+      lpFilPch = stdin ;
+    else
+      lpFilPch = jfopen(lcFilNamPch, "rb") ;
+    if ( lpFilPch == NULL ) {
+      fprintf(stddbg, "Could not open patch file %s for reading.\n", lcFilNamPch) ;
+      exit(EXI_SCD);
+    }
+    jpatchdir(acArg[liOptArgCnt + 1], lpFilPch, acArg[liOptArgCnt + 3]) ;
+    jfclose(lpFilPch);
+    exit(0);
+  }
+
   /* Read filenames */
   lcFilNamOrg = acArg[liOptArgCnt + 1];
   lcFilNamPch = acArg[liOptArgCnt + 2];
@@ -30,10 +30,27 @@
  *   -f          Try to be faster: no out of buffer compares.
  *   -ff         Try to be faster: no out of buffer compares, nor pre-scanning.
  *   -m size     Size (in kB) for look-ahead buffers (default 128).
+ *   -an size    Minimum lookahead (in kB): adapts up to -a on match distances (0=fixed).
  *   -bs size    Block size (in bytes) for reading from files (default 4096).
  *   -s size     Number of samples per file (e.g. 8192).
+ *   -sl size    Number of samples in the local hashtable in kB (0=none, default 128).
+ *   -x rate     Use an external (on-disk) index keeping one sample out of rate.
+ *   -xd dir     Directory for the external index files (default system temp).
+ *   -fp         Verify samples with strong fingerprints instead of out of buffer compares.
  *   -min count  Minimum number of solutions to find before choosing one.
  *   -max count  Maximum number of solutions to find before choosing one.
+ *   -mt count   Size of the matching table (default 2 x max, at least 256).
+ *   -cm mode    Compare out of buffer: 0=never, 1=always, 2=when worth the seek (default).
+ *   -opt        Select matches on encoded patch size instead of on distance.
+ *   -ab size    Compare aligned blocks of size bytes first (e.g. 4096 for disk images).
+ *   -j count    Compare chunks of the new file on count threads.
+ *   -jc size    Chunk size (in kB) for -j (default 65536).
+ *   -p          Report progress on standard error.
+ *   --mem-limit=bytes  Derive sizes from a memory budget (suffix k, m or g allowed).
+ *   --batch file  Compare the pairs listed in file ("original new output" per line) on -j threads.
+ *   --dir       Compare two directory trees into one container (apply with jptch --dir).
+ *   --cross     With --dir: match against all original files at once (moved contents).
+ *   --tar       Compare tar archives member by member, on -j threads (default one per cpu).
  *
  * Exit codes
  * ----------
@@ -125,6 +142,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <inttypes.h>
+#include <signal.h>
 
 using namespace std ;
 
@@ -145,10 +163,16 @@ using namespace std ;
 
 #include "JDefs.h"
 #include "JDiff.h"
+#include "JDiffPar.h"
+#include "JBatch.h"
+#include "JDirDiff.h"
+#include "JTar.h"
+#include "JProgressOut.h"
 #include "JOutBin.h"
 #include "JOutAsc.h"
 #include "JOutRgn.h"
 #include "JFile.h"
+#include "JHugeMem.h"
 
 using namespace JojoDiff ;
 
@@ -166,11 +190,154 @@ void *fillBuffer(void *in)
 
   p->fileHandler->read(buff, p->size);
 
-  p->dest = new istringstream(buff);
+  p->dest = new istringstream(string(buff, p->size));
+  delete[] buff;
 
   return NULL;
 }
 
+/*******************************************************************************
+* Interrupt (ctrl-c): cancel the comparison, a second one aborts.
+*******************************************************************************/
+static JProgress * volatile gpPrg = null ;
+
+static void ufSigInt(int)
+{
+  if (gpPrg != null)
+      gpPrg->cancel() ;
+  signal(SIGINT, SIG_DFL) ;
+}
+
+/*******************************************************************************
+* Parse a size with an optional k, m or g suffix (powers of 1024).
+*******************************************************************************/
+static long long ufSze(const char *asSze)
+{
+  char *lpEnd ;
+  long long llSze = strtoll(asSze, &lpEnd, 10) ;
+  switch (*lpEnd) {
+  case 'g': case 'G': llSze *= 1024 ;
+  /* no break */
+  case 'm': case 'M': llSze *= 1024 ;
+  /* no break */
+  case 'k': case 'K': llSze *= 1024 ;
+  }
+  return llSze ;
+}
+
+/*******************************************************************************
+* Memory budget: estimate of the memory used by a configuration (bytes).
+*
+* aiJDf JDiffs run at the same time (the master plus one per thread with -j),
+* each with its own file buffers, local hashtable and matching table. The
+* hashtable (or the run buffer of the external index) is shared.
+*******************************************************************************/
+static long long ufMemUse(int aiHshSze, int aiHshLcl, long alBufSze, int aiMchSze, int aiJDf,
+        bool abFpr, int aiIdxRat, int aiBlkAln, off_t azSzeOrg, off_t azSzeNew)
+{
+  long long llUse ;
+
+  /* per JDiff: buffers and tables as allocated (huge blocks are rounded up) */
+  llUse = (alBufSze > 0) ? 2LL * JHugeMem::size(alBufSze) : 0 ;
+  if (aiHshLcl > 0)
+      llUse += JHugeMem::size(JHashPos::memsize(aiHshLcl * 1024)) ;
+  llUse += JMatchTable::memsize(aiMchSze) ;
+  llUse *= aiJDf ;
+
+  /* shared */
+  if (aiIdxRat > 0)
+      llUse += (long long) IDX_RUN * (sizeof(hkey) + sizeof(off_t)) ;
+  else
+      llUse += JHugeMem::size(JHashPos::memsize(aiHshSze, abFpr)) ;
+  if (aiBlkAln > 0)
+      llUse += azSzeOrg / aiBlkAln / 8 + 1 ;
+  if (alBufSze == 0)
+      llUse += 2 * (azSzeOrg + azSzeNew) ;     // files preloaded in memory (and copied once)
+  return llUse ;
+}
+
+/*******************************************************************************
+* Memory budget: derive the sizes that were not set explicitly from the budget.
+*
+* The file buffers get up to a quarter of the budget (no more than needed to hold
+* the largest file), the local hashtable up to an eighth of the rest and the
+* hashtable takes what remains, up to one sample per byte of the original file.
+* The lookahead follows the buffers. The matching table shrinks only when the
+* budget would otherwise be exceeded.
+* Sizes of 0 are unknown (block devices, pipes) and do not limit anything.
+*******************************************************************************/
+static void ufMemCfg(long long alMemLmt, int aiJDf, bool abFpr, int aiIdxRat, int aiBlkAln,
+        off_t azSzeOrg, off_t azSzeNew, int aiBlkSze,
+        bool abSetHsh, bool abSetLcl, bool abSetBuf, bool abSetMch,
+        int &aiHshSze, int &aiHshLcl, long &alBufSze, int &aiMchSze)
+{
+  long long llRst ;
+  long long llMax ;
+
+  /* what is left once the sizes to derive are at their minimum */
+  llRst = alMemLmt - ufMemUse(abSetHsh ? aiHshSze : 0, abSetLcl ? aiHshLcl : 0,
+          abSetBuf ? alBufSze : 1, aiMchSze, aiJDf,
+          abFpr, aiIdxRat, aiBlkAln, azSzeOrg, azSzeNew) ;
+  if (llRst < 0) llRst = 0 ;
+
+  if (! abSetBuf) {
+      llMax = ((azSzeOrg > azSzeNew ? azSzeOrg : azSzeNew) / aiBlkSze + 1) * aiBlkSze ;
+      alBufSze = llRst / 4 / 2 / aiJDf ;
+      if (azSzeOrg > 0 && azSzeNew > 0 && alBufSze > llMax) alBufSze = llMax ;
+      alBufSze = alBufSze / aiBlkSze * aiBlkSze ;
+      if (alBufSze < aiBlkSze) alBufSze = aiBlkSze ;
+      llRst -= 2LL * alBufSze * aiJDf ;
+  }
+  if (! abSetLcl) {
+      llMax = (llRst > 0) ? llRst / 8 / aiJDf / (1024 * (sizeof(off_t) + sizeof(hkey))) : 0 ;
+      aiHshLcl = (llMax < 128) ? (int) llMax : 128 ;
+      llRst -= (long long) aiHshLcl * 1024 * (sizeof(off_t) + sizeof(hkey)) * aiJDf ;
+  }
+  if (! abSetHsh) {
+      llMax = (llRst > 0) ? llRst / (sizeof(off_t) + sizeof(hkey) + (abFpr ? sizeof(fkey) : 0)) : 0 ;
+      if (azSzeOrg > 0 && llMax > azSzeOrg) llMax = azSzeOrg ;
+      if (llMax > INT_MAX) llMax = INT_MAX ;
+      aiHshSze = JHashPos::get_size((int) llMax, azSzeOrg) ;
+  }
+  if (! abSetMch) {
+      while (aiMchSze > MCH_MIN && ufMemUse(aiHshSze, aiHshLcl, alBufSze, aiMchSze, aiJDf,
+              abFpr, aiIdxRat, aiBlkAln, azSzeOrg, azSzeNew) > alMemLmt)
+          aiMchSze /= 2 ;
+      if (aiMchSze < MCH_MIN) aiMchSze = MCH_MIN ;
+  }
+}
+
+/*******************************************************************************
+* Create a JDiff specialized on the actual file and output classes.
+* Falls back on the generic (virtual) JDiff for other combinations.
+*******************************************************************************/
+template <class TFile, class ... TArg>
+static JDiff *ufNewJDiffOut(JFile *apFilOrg, JFile *apFilNew, JOut *apOut, TArg ... aArg)
+{
+  if (dynamic_cast<JOutBin *>(apOut) != null)
+      return new JDiffT<TFile, JOutBin>(apFilOrg, apFilNew, apOut, aArg...) ;
+  if (dynamic_cast<JOutAsc *>(apOut) != null)
+      return new JDiffT<TFile, JOutAsc>(apFilOrg, apFilNew, apOut, aArg...) ;
+  if (dynamic_cast<JOutRgn *>(apOut) != null)
+      return new JDiffT<TFile, JOutRgn>(apFilOrg, apFilNew, apOut, aArg...) ;
+  return new JDiff(apFilOrg, apFilNew, apOut, aArg...) ;
+}
+
+template <class ... TArg>
+static JDiff *ufNewJDiff(JFile *apFilOrg, JFile *apFilNew, JOut *apOut, TArg ... aArg)
+{
+#ifdef __MINGW32__
+  if (dynamic_cast<JFileAhead *>(apFilOrg) != null && dynamic_cast<JFileAhead *>(apFilNew) != null)
+      return ufNewJDiffOut<JFileAhead>(apFilOrg, apFilNew, apOut, aArg...) ;
+#else
+  if (dynamic_cast<JFileIStreamAhead *>(apFilOrg) != null && dynamic_cast<JFileIStreamAhead *>(apFilNew) != null)
+      return ufNewJDiffOut<JFileIStreamAhead>(apFilOrg, apFilNew, apOut, aArg...) ;
+  if (dynamic_cast<JFileIStream *>(apFilOrg) != null && dynamic_cast<JFileIStream *>(apFilNew) != null)
+      return ufNewJDiffOut<JFileIStream>(apFilOrg, apFilNew, apOut, aArg...) ;
+#endif
+  return new JDiff(apFilOrg, apFilNew, apOut, aArg...) ;
+}
+
 /*******************************************************************************
 * Main function
 *******************************************************************************/
@@ -190,14 +357,35 @@ int main(int aiArgCnt, char *acArg[])
   int liOutTyp = 0 ;            /* 0 = JOutBin, 1 = JOutAsc, 2 = JOutRgn */
   int liVerbse = 0;             /* Verbose level 0=no, 1=normal, 2=high            */
   int lbSrcBkt = true;          /* Backtrace on sourcefile allowed?                */
-  bool lbCmpAll = true ;        /* Compare even if data not in buffer?             */
+  int  liCmpMod = CMP_CST ;     /* Compare out-of-buffer: never, always, cost-based */
   int liSrcScn = 1 ;            /* Prescan source file: 0=no, 1=do, 2=done         */
   int liMchMax = 32 ;           /* Maximum entries in matching table.              */
   int liMchMin = 8 ;            /* Minimum entries in matching table.              */
+  int liMchSze = 0 ;            /* Size of the matching table (0=auto)             */
   int liHshMbt = 8 ; 	        /* Hashtable size in mega-samples (default 8 * 1024 * 1024) */
+  int liHshLcl = 128 ;          /* Local hashtable size in kilo-samples (0=none)   */
+  int liIdxRat = 0 ;            /* External index sample rate (0=none)             */
+  const char *lsIdxDir = null ; /* External index directory (null=system temp)    */
+  bool lbFpr = false ;          /* Verify samples with strong fingerprints?        */
+  bool lbOpt = false ;          /* Select matches on encoded patch size?           */
   long llBufSze = 256*1024 ;    /* Default file-buffers size */
   int liBlkSze = 4096 ;         /* Default block size */
   int liAhdMax = 0;             /* Lookahead range (0=same as llBufSze) */
+  int liAhdMin = AHD_MIN ;      /* Minimum lookahead range (adaptive up to liAhdMax) */
+  int liBlkAln = 0 ;            /* Aligned block size for the block pre-pass (0=none) */
+  int liThrCnt = 0 ;            /* Number of threads for chunked diffing (0=sequential) */
+  off_t lzChkSze = PAR_CHK ;    /* Chunk size in kB for chunked diffing            */
+  bool lbPrg = false ;          /* Report progress on stderr?                      */
+  long long llMemLmt = 0 ;      /* Memory budget in bytes (0=none)                 */
+  const char *lsBatMan = null ; /* Batch manifest (null=none)                      */
+  bool lbDir = false ;          /* Compare directory trees?                        */
+  bool lbCrs = false ;          /* Trees: cross-file matching?                     */
+  bool lbTar = false ;          /* Compare tar archives member by member?          */
+  bool lbSetHsh = false ;       /* Sizes set explicitly (kept under --mem-limit)   */
+  bool lbSetLcl = false ;
+  bool lbSetBuf = false ;
+  bool lbSetAhd = false ;
+  bool lbSetMch = false ;
 
   JDebug::stddbg        = stderr ;
 
@@ -217,11 +405,19 @@ int main(int aiArgCnt, char *acArg[])
         liOptArgCnt ++;
         if (aiArgCnt > liOptArgCnt) {
           liAhdMax = atoi(acArg[liOptArgCnt]) / 2 * 1024;
+          lbSetAhd = true ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-an") == 0) {
+        liOptArgCnt ++;
+        if (aiArgCnt > liOptArgCnt) {
+          liAhdMin = atoi(acArg[liOptArgCnt]) / 2 * 1024;
+          if (liAhdMin <= 0) liAhdMin = INT_MAX ;   // fixed range
         }
     } else if (strcmp(acArg[liOptArgCnt], "-m") == 0) {
         liOptArgCnt ++;
         if (aiArgCnt > liOptArgCnt) {
           llBufSze = atoi(acArg[liOptArgCnt]) / 2 * 1024;
+          lbSetBuf = true ;
         }
     } else if (strcmp(acArg[liOptArgCnt], "-bs") == 0) {
         liOptArgCnt ++;
@@ -233,20 +429,91 @@ int main(int aiArgCnt, char *acArg[])
         if (aiArgCnt > liOptArgCnt) {
         	liHshMbt = atoi(acArg[liOptArgCnt]) ;
         	while (liHshMbt > 1024) liHshMbt /= 1024 ;
+        	lbSetHsh = true ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-sl") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+        	liHshLcl = atoi(acArg[liOptArgCnt]) ;
+        	while (liHshLcl > 1024) liHshLcl /= 1024 ;
+        	lbSetLcl = true ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-x") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+        	liIdxRat = atoi(acArg[liOptArgCnt]) ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-fp") == 0) {
+        lbFpr = true ;
+    } else if (strcmp(acArg[liOptArgCnt], "-opt") == 0) {
+        lbOpt = true ;
+    } else if (strcmp(acArg[liOptArgCnt], "-ab") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+        	liBlkAln = atoi(acArg[liOptArgCnt]) ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-j") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+        	liThrCnt = atoi(acArg[liOptArgCnt]) ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-jc") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+        	lzChkSze = atoi(acArg[liOptArgCnt]) ;
+        	if (lzChkSze < 1) lzChkSze = 1 ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-p") == 0) {
+        lbPrg = true ;
+    } else if (strncmp(acArg[liOptArgCnt], "--mem-limit=", 12) == 0) {
+        llMemLmt = ufSze(acArg[liOptArgCnt] + 12) ;
+        if (llMemLmt < 0) llMemLmt = 0 ;
+    } else if (strcmp(acArg[liOptArgCnt], "--batch") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+        	lsBatMan = acArg[liOptArgCnt] ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "--dir") == 0) {
+        lbDir = true ;
+    } else if (strcmp(acArg[liOptArgCnt], "--cross") == 0) {
+        lbCrs = true ;
+    } else if (strcmp(acArg[liOptArgCnt], "--tar") == 0) {
+        lbTar = true ;
+    } else if (strcmp(acArg[liOptArgCnt], "-xd") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+        	lsIdxDir = acArg[liOptArgCnt] ;
         }
     } else if (strcmp(acArg[liOptArgCnt], "-min") == 0) {
         liOptArgCnt++;
         if (aiArgCnt > liOptArgCnt) {
           liMchMin = atoi(acArg[liOptArgCnt]) ;
-          if (liMchMin > MCH_MAX)
-              liMchMin = MCH_MAX ;
+          if (liMchMin > MCH_LIM)
+              liMchMin = MCH_LIM ;
         }
     } else if (strcmp(acArg[liOptArgCnt], "-max") == 0) {
         liOptArgCnt++;
         if (aiArgCnt > liOptArgCnt) {
           liMchMax = atoi(acArg[liOptArgCnt]) ;
-          if (liMchMax > MCH_MAX)
-              liMchMax = MCH_MAX ;
+          if (liMchMax > MCH_LIM)
+              liMchMax = MCH_LIM ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-cm") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+          liCmpMod = atoi(acArg[liOptArgCnt]) ;
+          if (liCmpMod < CMP_NVR || liCmpMod > CMP_CST)
+              liCmpMod = CMP_CST ;
+        }
+    } else if (strcmp(acArg[liOptArgCnt], "-mt") == 0) {
+        liOptArgCnt++;
+        if (aiArgCnt > liOptArgCnt) {
+          liMchSze = atoi(acArg[liOptArgCnt]) ;
+          if (liMchSze < MCH_MIN)
+              liMchSze = MCH_MIN ;
+          else if (liMchSze > MCH_LIM)
+              liMchSze = MCH_LIM ;
+          lbSetMch = true ;
         }
 
     } else if (strcmp(acArg[liOptArgCnt], "-l") == 0) {
@@ -255,7 +522,7 @@ int main(int aiArgCnt, char *acArg[])
         liOutTyp = 2 ;
     } else if (strcmp(acArg[liOptArgCnt], "-b") == 0) {
         // Larger hashtables
-    	lbCmpAll = true ;
+    	liCmpMod = CMP_ALL ;
         llBufSze = 4096 * 1024 ;
         lbSrcBkt = true;
         liSrcScn = 1 ;
@@ -264,7 +531,7 @@ int main(int aiArgCnt, char *acArg[])
         liHshMbt = 32 ; // 32meg elements
     } else if (strcmp(acArg[liOptArgCnt], "-f") == 0) {
         // No compare out-of-buffer
-    	lbCmpAll = false ;
+    	liCmpMod = CMP_NVR ;
         llBufSze = 64 * 1024 ;
         lbSrcBkt = true ;
         liSrcScn = 1  ;
@@ -273,7 +540,7 @@ int main(int aiArgCnt, char *acArg[])
         liHshMbt = 4 ; // 4Meg samples
     } else if (strcmp(acArg[liOptArgCnt], "-ff") == 0) {
         // No compare out-of-buffer and no backtracing
-    	lbCmpAll = false ;
+    	liCmpMod = CMP_NVR ;
         llBufSze = 4096 * 1024 ;
         lbSrcBkt = true ;
         liSrcScn = 0 ;
@@ -314,8 +581,56 @@ int main(int aiArgCnt, char *acArg[])
     }
   }
 
+  /* Fingerprints replace out of buffer compares */
+  if (lbFpr) liCmpMod = CMP_NVR ;
+
+  /* Matching table: room for twice the maximum number of solutions, unless specified */
+  if (liMchSze == 0) {
+      liMchSze = (liMchMax * 2 > MCH_MAX) ? liMchMax * 2 : MCH_MAX ;
+      if (liMchSze > MCH_LIM) liMchSze = MCH_LIM ;
+  }
+  if (liMchMax > liMchSze) liMchMax = liMchSze ;
+  if (liMchMin > liMchMax) liMchMin = liMchMax ;
+
+  /* Chunked diffing needs seekable, buffered files, a shared (prescanned) hashtable
+   * and binary output. Compares are not decided on measured seek times, which
+   * would make the output depend on timing. */
+  if (lbTar && liThrCnt == 0 && lsBatMan == null && ! lbDir) {
+#ifdef __MINGW32__
+      liThrCnt = 1 ;
+#else
+      liThrCnt = (int) sysconf(_SC_NPROCESSORS_ONLN) ;
+      if (liThrCnt < 1) liThrCnt = 1 ;
+#endif
+  }
+  if (liThrCnt > 0 && lsBatMan == null && ! lbDir) {
+      if (liOutTyp != 0 || llBufSze == 0 || liSrcScn == 0 || ! lbSrcBkt) {
+          if (liVerbse > 0)
+              fprintf(JDebug::stddbg, "Option -j%s ignored: requires binary output, buffers and a prescan.\n",
+                      lbTar ? " or --tar" : "") ;
+          liThrCnt = 0 ;
+          lbTar = false ;
+      } else if (liCmpMod == CMP_CST) {
+          liCmpMod = CMP_ALL ;
+      }
+  }
+
+  /* Same for batches and trees: a pair's output must not depend on the worker
+   * or on the order in which the pairs are compared */
+  if ((lsBatMan != null || lbDir) && liCmpMod == CMP_CST)
+      liCmpMod = CMP_ALL ;
+
+  if (lbCrs && ! lbDir) {
+      if (liVerbse > 0)
+          fprintf(JDebug::stddbg, "Option --cross ignored: requires --dir.\n") ;
+      lbCrs = false ;
+  }
+
+  /* Number of arguments after the options: none with --batch */
+  int liArgMin = (lsBatMan == null || lbDir) ? 3 : 1 ;
+
   /* Output greetings */
-  if ((liVerbse>0) || (lcHlp == 'h') || (aiArgCnt - liOptArgCnt < 3)) {
+  if ((liVerbse>0) || (lcHlp == 'h') || (aiArgCnt - liOptArgCnt < liArgMin)) {
     fprintf(JDebug::stddbg, "JDIFF - Jojo's binary diff version " JDIFF_VERSION "\n") ;
     fprintf(JDebug::stddbg, JDIFF_COPYRIGHT "\n");
     fprintf(JDebug::stddbg, "\n") ;
@@ -343,8 +658,11 @@ int main(int aiArgCnt, char *acArg[])
         sizeof(off_t) * 8, maxoff_t_gb, maxoff_t_mul, SMPSZE) ;
   }
 
-  if ((aiArgCnt - liOptArgCnt < 3) || (lcHlp == 'h') || (liVerbse>2)) {
+  if ((aiArgCnt - liOptArgCnt < liArgMin) || (lcHlp == 'h') || (liVerbse>2)) {
     fprintf(JDebug::stddbg, "Usage: jdiff [options] <original file> <new file> [<output file>]\n") ;
+    fprintf(JDebug::stddbg, "       jdiff [options] --batch <manifest>\n") ;
+    fprintf(JDebug::stddbg, "       jdiff [options] --dir <original dir> <new dir> [<output file>]\n") ;
+    fprintf(JDebug::stddbg, "Options come before the file names.\n") ;
     fprintf(JDebug::stddbg, "  -v          Verbose (greeting, results and tips).\n");
     fprintf(JDebug::stddbg, "  -vv         Verbose (debug info).\n");
     fprintf(JDebug::stddbg, "  -h          Help (this text).\n");
@@ -361,9 +679,46 @@ int main(int aiArgCnt, char *acArg[])
     fprintf(JDebug::stddbg, ").\n");
     fprintf(JDebug::stddbg, "  -bs size    Block size (in bytes) for reading from files (default 4096).\n");
     fprintf(JDebug::stddbg, "  -s size     Number of samples per file in MB (default 8).\n");
+    fprintf(JDebug::stddbg, "  -sl size    Number of samples in the local window in kB (default 128, 0=none).\n");
+    fprintf(JDebug::stddbg, "  -x rate     Use an external index on disk, keeping 1 sample out of rate\n");
+    fprintf(JDebug::stddbg, "              (for originals larger than memory, e.g. 64).\n");
+    fprintf(JDebug::stddbg, "  -xd dir     Directory for the external index (default=system temp).\n");
+    fprintf(JDebug::stddbg, "  -fp         Verify samples with strong fingerprints: no out of buffer\n");
+    fprintf(JDebug::stddbg, "              compares (faster), with nearly the accuracy of -b.\n");
     fprintf(JDebug::stddbg, "  -a size     Number of kB to look ahead (default=same as buffer-size).\n");
-    fprintf(JDebug::stddbg, "  -min count  Minimum number of solutions to find (default %d, max %d).\n", liMchMin, MCH_MAX);
-    fprintf(JDebug::stddbg, "  -max count  Maximum number of solutions to find (default %d, max %d).\n", liMchMax, MCH_MAX);
+    fprintf(JDebug::stddbg, "  -an size    Minimum number of kB to look ahead: the range adapts between -an\n");
+    fprintf(JDebug::stddbg, "              and -a to the distances of the matches found (default %d, 0=fixed).\n", AHD_MIN * 2 / 1024);
+    fprintf(JDebug::stddbg, "  -min count  Minimum number of solutions to find (default %d, max %d).\n", liMchMin, MCH_LIM);
+    fprintf(JDebug::stddbg, "  -max count  Maximum number of solutions to find (default %d, max %d).\n", liMchMax, MCH_LIM);
+    fprintf(JDebug::stddbg, "  -mt count   Size of the matching table (default 2 x max, at least %d, %d-%d).\n", MCH_MAX, MCH_MIN, MCH_LIM);
+    fprintf(JDebug::stddbg, "  -cm mode    Compare out of buffer: 0=never, 1=always, 2=when worth the\n");
+    fprintf(JDebug::stddbg, "              measured seek time (default, 1 with -b, 0 with -f/-ff/-fp).\n");
+    fprintf(JDebug::stddbg, "  -opt        Select matches on encoded patch size instead of on distance\n");
+    fprintf(JDebug::stddbg, "              (smaller patches and less backtracking, more cpu).\n");
+    fprintf(JDebug::stddbg, "  -ab size    Compare aligned blocks of size bytes at the same offsets first and\n");
+    fprintf(JDebug::stddbg, "              only look for differences elsewhere (e.g. 4096 for disk images).\n");
+    fprintf(JDebug::stddbg, "  -j count    Compare chunks of the new file on count threads: same output\n");
+    fprintf(JDebug::stddbg, "              for any count (binary output with buffers and prescan only).\n");
+    fprintf(JDebug::stddbg, "  -jc size    Chunk size (in kB) for -j (default %d).\n", PAR_CHK);
+    fprintf(JDebug::stddbg, "  -p          Report progress (phase, percentage, rate and eta) on stderr.\n");
+    fprintf(JDebug::stddbg, "              Ctrl-c stops the comparison and closes the output.\n");
+    fprintf(JDebug::stddbg, "  --mem-limit=bytes  Derive the hashtable, buffer, lookahead and matching table\n");
+    fprintf(JDebug::stddbg, "              sizes from the file sizes and a memory budget (e.g. 512m).\n");
+    fprintf(JDebug::stddbg, "              Sizes given with -s, -sl, -m, -a or -mt are kept.\n");
+    fprintf(JDebug::stddbg, "  --batch file  Compare all pairs listed in file, one \"original new output\"\n");
+    fprintf(JDebug::stddbg, "              triple per line (tab-separated if names contain blanks, - =\n");
+    fprintf(JDebug::stddbg, "              stdin), on -j threads (default one per cpu), largest first.\n");
+    fprintf(JDebug::stddbg, "              Binary output only. Writes a summary on stderr.\n");
+    fprintf(JDebug::stddbg, "  --dir       Compare two directory trees into one container, to be applied\n");
+    fprintf(JDebug::stddbg, "              with jptch --dir. Files are paired on path, renamed files on\n");
+    fprintf(JDebug::stddbg, "              size and sampled contents or on name, and compared on -j threads.\n");
+    fprintf(JDebug::stddbg, "              Files with the same size and time are taken as unchanged.\n");
+    fprintf(JDebug::stddbg, "  --cross     With --dir: compare against all original files at once, as one\n");
+    fprintf(JDebug::stddbg, "              prescanned original, so that contents moved between files are\n");
+    fprintf(JDebug::stddbg, "              found too (one hashtable of -s MB for the whole tree).\n");
+    fprintf(JDebug::stddbg, "  --tar       Compare tar archives member by member: members are paired on\n");
+    fprintf(JDebug::stddbg, "              name and compared in chunks on -j threads (default one per\n");
+    fprintf(JDebug::stddbg, "              cpu). The output is a normal patch for the whole archive.\n");
     fprintf(JDebug::stddbg, "Principles:\n");
     fprintf(JDebug::stddbg, "  JDIFF tries to find equal regions between two binary files using a heuristic\n");
     fprintf(JDebug::stddbg, "  hash algorithm and outputs the differences between both files.\n");
@@ -382,10 +737,153 @@ int main(int aiArgCnt, char *acArg[])
     fprintf(JDebug::stddbg, "  the jdiff's output file afterwards.\n");
     fprintf(JDebug::stddbg, "\n");
                     /******************************************************************************/
-    if ((aiArgCnt - liOptArgCnt < 3) || (lcHlp == 'h'))
+    if ((aiArgCnt - liOptArgCnt < liArgMin) || (lcHlp == 'h'))
         exit(EXI_ARG);
   }
 
+  /* Options after the file names would be taken as file names (e.g. an output file named --cross) */
+  for (int liArg = liOptArgCnt + 1; liArg < aiArgCnt; liArg++) {
+      if (strncmp(acArg[liArg], "--", 2) == 0) {
+          fprintf(JDebug::stddbg, "Option %s must come before the file names.\n", acArg[liArg]) ;
+          exit(EXI_ARG) ;
+      }
+  }
+
+  /* Batch or trees: compare the pairs on a pool of workers, one engine each */
+  if (lsBatMan != null || lbDir) {
+      JBatch loBat ;
+      JDirDiff *lpDir = null ;
+      JFileConcat *lpCat = null ;
+      off_t lzMaxOrg ;
+      int liWrk ;
+      int liRet ;
+
+      if (lbDir) {
+          lpDir = new JDirDiff(acArg[1 + liOptArgCnt], acArg[2 + liOptArgCnt]) ;
+          if (lbCrs)
+              lpCat = new JFileConcat("Org", llBufSze == 0 ? 256 * 1024 : llBufSze, liBlkSze) ;
+          liRet = lpDir->scan(loBat, lpCat) ;
+          if (liRet == - EXI_FRT || liRet == - EXI_SCD) {
+              fprintf(JDebug::stddbg, "Could not read %s tree %s.\n", liRet == - EXI_FRT ? "original" : "new",
+                      acArg[(liRet == - EXI_FRT ? 1 : 2) + liOptArgCnt]) ;
+              exit(- liRet) ;
+          }
+          lcFilNamOut = (aiArgCnt - liOptArgCnt >= 4) ? acArg[3 + liOptArgCnt] : "-" ;
+          lpFilOut = (strcmp(lcFilNamOut, "-") == 0) ? stdout : fopen(lcFilNamOut, "wb") ;
+          if (lpFilOut == null) {
+              fprintf(JDebug::stddbg, "Could not open output file %s for writing.\n", lcFilNamOut) ;
+              exit(EXI_OUT) ;
+          }
+      } else {
+          liRet = loBat.load(lsBatMan) ;
+          if (liRet < 0) {
+              fprintf(JDebug::stddbg, "Could not open manifest %s for reading.\n", lsBatMan) ;
+              exit(EXI_FRT) ;
+          } else if (liRet > 0) {
+              fprintf(JDebug::stddbg, "Invalid line %d in manifest %s: <original> <new> <output> expected.\n", liRet, lsBatMan) ;
+              exit(EXI_ARG) ;
+          }
+      }
+
+      if (liOutTyp != 0 || llBufSze == 0 || liIdxRat > 0 || lbPrg) {
+          if (liVerbse > 0)
+              fprintf(JDebug::stddbg, "Options -l, -lr, -m 0, -x and -p ignored with --batch or --dir.\n") ;
+          if (llBufSze == 0) llBufSze = 256 * 1024 ;
+      }
+#ifdef __MINGW32__
+      liWrk = (liThrCnt > 0) ? liThrCnt : 1 ;
+#else
+      liWrk = (liThrCnt > 0) ? liThrCnt : (int) sysconf(_SC_NPROCESSORS_ONLN) ;
+#endif
+      if (liWrk > loBat.getJobCnt()) liWrk = loBat.getJobCnt() ;
+      if (liWrk < 1) liWrk = 1 ;
+
+      /* Tables sized for the largest pair (or the virtual original), the memory budget is shared by the workers */
+      lzMaxOrg = (lpCat != null) ? lpCat->size() : loBat.getMaxOrg() ;
+      int liHshSze = JHashPos::get_size(liHshMbt * 1024 * 1024, lzMaxOrg) ;
+      if (llMemLmt > 0) {
+          long long llMemUse ;
+
+          ufMemCfg(llMemLmt / liWrk, 1, lbFpr, 0, liBlkAln, lzMaxOrg, loBat.getMaxNew(), liBlkSze,
+                   lbSetHsh, lbSetLcl, lbSetBuf, lbSetMch, liHshSze, liHshLcl, llBufSze, liMchSze) ;
+          if (! lbSetAhd) liAhdMax = 0 ;
+          if (liMchMax > liMchSze) liMchMax = liMchSze ;
+          if (liMchMin > liMchMax) liMchMin = liMchMax ;
+
+          llMemUse = liWrk * ufMemUse(liHshSze, liHshLcl, llBufSze, liMchSze, 1, lbFpr, 0, liBlkAln,
+                                      lzMaxOrg, loBat.getMaxNew()) ;
+          if (liVerbse > 0)
+              fprintf(JDebug::stddbg, "Memory limit     : %lld kb. (about %lld kb. used by %d workers).\n",
+                      llMemLmt / 1024, (llMemUse + 1023) / 1024, liWrk) ;
+          if (llMemUse > llMemLmt) {
+              fprintf(JDebug::stddbg, "Memory limit of %lld bytes is too small: about %lld bytes are needed.\n", llMemLmt, llMemUse) ;
+              exit(EXI_MEM) ;
+          }
+      }
+
+      /* Engines are quiet: the report replaces the verbose output of each pair */
+      if (loBat.getJobCnt() > 0) {
+          JEngine **lpEng = new JEngine *[liWrk] ;
+          JOutBin *lpOutMst = null ;
+          JDiff *lpMst = null ;
+
+          /* Cross-file matching: one master prescans the virtual original for all engines
+           * (no aligned blocks: the new files are not laid out as the original) */
+          if (lpCat != null) {
+              lpOutMst = new JOutBin(null) ;
+              lpMst = new JDiff(lpCat, lpCat, lpOutMst, liHshSze, 0,
+                  lbSrcBkt, 1, liMchMax, liMchMin, liAhdMax==0?llBufSze:liAhdMax, liCmpMod,
+                  liHshLcl * 1024, 0, null, lbFpr, liMchSze, lbOpt, 0, liAhdMin) ;
+              liRet = lpMst->prescan() ;
+              if (liRet < 0) {
+                  fprintf(JDebug::stddbg, "Could not read original tree %s.\n", acArg[1 + liOptArgCnt]) ;
+                  exit(- liRet) ;
+              }
+              if (liVerbse > 1) {
+                  fprintf(JDebug::stddbg, "Virtual original : %d files, %" PRIzd " bytes, %d samples.\n",
+                          lpCat->count(), lpCat->size(), lpMst->getHsh()->get_hashprime()) ;
+              }
+          }
+          for (int liEng = 0; liEng < liWrk; liEng++){
+              if (lpMst != null)
+                  lpEng[liEng] = new JEngine(lpMst, *lpCat, llBufSze, liBlkSze) ;
+              else
+                  lpEng[liEng] = new JEngine(liHshSze, llBufSze, liBlkSze, 0,
+                      lbSrcBkt, liSrcScn, liMchMax, liMchMin, liAhdMax==0?llBufSze:liAhdMax, liCmpMod,
+                      liHshLcl * 1024, lbFpr, liMchSze, lbOpt, liBlkAln, liAhdMin) ;
+          }
+          if (liVerbse > 1) {
+              fprintf(JDebug::stddbg, "Batch engines    : %d x %lu kb.\n", liWrk,
+                      (unsigned long) (lpEng[0]->getArena()->get_size() / 1024)) ;
+          }
+
+          liRet = loBat.run(lpEng, liWrk) ;
+
+          for (int liEng = 0; liEng < liWrk; liEng++){
+              delete lpEng[liEng] ;
+          }
+          delete [] lpEng ;
+          delete lpMst ;
+          delete lpOutMst ;
+      }
+
+      /* Trees: the container (the pairs' errors are reported there), a summary with -v */
+      if (lpDir != null) {
+          liRet = lpDir->write(loBat, lpFilOut) ;
+          if (lpFilOut != stdout && fclose(lpFilOut) != 0 && liRet == 0)
+              liRet = - EXI_WRI ;
+          if (liVerbse > 1 || liRet < 0)
+              loBat.report(JDebug::stddbg) ;
+          if (liVerbse > 0)
+              lpDir->report(JDebug::stddbg) ;
+          delete lpDir ;
+          delete lpCat ;
+      } else {
+          loBat.report(JDebug::stddbg) ;
+      }
+      exit(liRet < 0 ? - liRet : 0) ;
+  }
+
   /* Read filenames */
   lcFilNamOrg = acArg[1 + liOptArgCnt];
   lcFilNamNew = acArg[2 + liOptArgCnt];
@@ -429,38 +927,71 @@ int main(int aiArgCnt, char *acArg[])
   paramNew.fileHandler = liFilNew;
   paramOrg.fileHandler = liFilOrg;
 
-  stat(lcFilNamOrg, &fileOrgStatus );
-  stat(lcFilNamNew, &fileNewStatus );
+  /* Size 0 when unknown: stat failed, or a block device or pipe */
+  size_t fileOrgSize = (stat(lcFilNamOrg, &fileOrgStatus) == 0) ? fileOrgStatus.st_size : 0 ;
+  size_t fileNewSize = (stat(lcFilNamNew, &fileNewStatus) == 0) ? fileNewStatus.st_size : 0 ;
+
+  /* Hashtable size (samples) */
+  int liHshSze = JHashPos::get_size(liHshMbt * 1024 * 1024, fileOrgSize) ;
 
-  size_t fileOrgSize = fileOrgStatus.st_size;
-  size_t fileNewSize = fileNewStatus.st_size;
+  /* Derive the sizes that were not given explicitly from the memory budget */
+  if (llMemLmt > 0) {
+      int liJDf = (liThrCnt > 0) ? liThrCnt + 1 : 1 ;
+      long long llMemUse ;
+
+      ufMemCfg(llMemLmt, liJDf, lbFpr, liIdxRat, liBlkAln, fileOrgSize, fileNewSize, liBlkSze,
+               lbSetHsh, lbSetLcl, lbSetBuf, lbSetMch, liHshSze, liHshLcl, llBufSze, liMchSze) ;
+      if (! lbSetAhd) liAhdMax = 0 ;
+      if (liMchMax > liMchSze) liMchMax = liMchSze ;
+      if (liMchMin > liMchMax) liMchMin = liMchMax ;
+
+      llMemUse = ufMemUse(liHshSze, liHshLcl, llBufSze, liMchSze, liJDf, lbFpr, liIdxRat, liBlkAln,
+                          fileOrgSize, fileNewSize) ;
+      if (liVerbse > 0) {
+          fprintf(JDebug::stddbg, "Memory limit     : %lld kb. (about %lld kb. used).\n", llMemLmt / 1024, (llMemUse + 1023) / 1024) ;
+          fprintf(JDebug::stddbg, "Hashtable        : %d samples%s.\n", liHshSze, liIdxRat > 0 ? " (not used: external index)" : "") ;
+          fprintf(JDebug::stddbg, "Local hashtable  : %d kilo-samples.\n", liHshLcl) ;
+          fprintf(JDebug::stddbg, "Buffers          : %ld kb. per file.\n", llBufSze / 1024) ;
+          fprintf(JDebug::stddbg, "Lookahead        : %ld kb.\n", (liAhdMax == 0 ? llBufSze : liAhdMax) / 1024) ;
+          fprintf(JDebug::stddbg, "Matching table   : %d matches (min %d, max %d).\n", liMchSze, liMchMin, liMchMax) ;
+      }
+      if (llMemUse > llMemLmt) {
+          fprintf(JDebug::stddbg, "Memory limit of %lld bytes is too small: about %lld bytes are needed.\n", llMemLmt, llMemUse) ;
+          exit(EXI_MEM) ;
+      }
+  }
 
   paramNew.size = fileNewSize;
   paramOrg.size = fileOrgSize;
+  paramNew.dest = NULL;
+  paramOrg.dest = NULL;
+
+  /* Preload both files in memory only when running without buffers (-m 0) */
+  if (llBufSze == 0) {
+    rc = pthread_create(&threadNew, NULL, fillBuffer, (void *)(&paramNew));
+    if(rc) {
+      fprintf(stderr, "error creating threads\n");
+      return -1;
+    }
+
+    rc = pthread_create(&threadOrg, NULL, fillBuffer, (void *)(&paramOrg));
+    if(rc) {
+      fprintf(stderr, "error creating threads\n");
+      return -1;
+    }
 
-  rc = pthread_create(&threadNew, NULL, fillBuffer, (void *)(&paramNew));
-	if(rc) {
-		fprintf(stderr, "error creating threads\n");
-		return -1;
-	}
-
-  rc = pthread_create(&threadOrg, NULL, fillBuffer, (void *)(&paramOrg));
-	if(rc) {
-		fprintf(stderr, "error creating threads\n");
-		return -1;
-	}
-
-  rc = pthread_join(threadNew, NULL);
-  if(rc) {
-		fprintf(stderr, "error joining threads\n");
-		return -1;
-	}
-
-  rc = pthread_join(threadOrg, NULL);
-  if(rc) {
-		fprintf(stderr, "error joining threads\n");
-		return -1;
-	}
+    rc = pthread_join(threadNew, NULL);
+    if(rc) {
+      fprintf(stderr, "error joining threads\n");
+      return -1;
+    }
+
+    rc = pthread_join(threadOrg, NULL);
+    if(rc) {
+      fprintf(stderr, "error joining threads\n");
+      return -1;
+    }
+  }
 
   /* Open first file */
 #ifdef __MINGW32__
@@ -532,29 +1063,110 @@ int main(int aiArgCnt, char *acArg[])
   }
 
   /* Go ... */
-  JDiff loJDiff(lpFilOrg, lpFilNew, lpOut,
-      liHshMbt * 1024 * 1024, liVerbse,
-      lbSrcBkt, liSrcScn, liMchMax, liMchMin, liAhdMax==0?llBufSze:liAhdMax, lbCmpAll);
+  JDiff *lpJDiff = ufNewJDiff(lpFilOrg, lpFilNew, lpOut,
+      liHshSze, liVerbse,
+      lbSrcBkt, liSrcScn, liMchMax, liMchMin, liAhdMax==0?llBufSze:liAhdMax, liCmpMod,
+      liHshLcl * 1024, liIdxRat, lsIdxDir, lbFpr, liMchSze, lbOpt, liBlkAln, liAhdMin);
   if (liVerbse>1) {
       fprintf(JDebug::stddbg, "Lookahead buffers: %lu kb. (%lu kb. per file).\n",llBufSze * 2 / 1024, llBufSze / 1024) ;
-      fprintf(JDebug::stddbg, "Hastable size    : %d kb. (%d samples).\n", (loJDiff.getHsh()->get_hashsize() + 512) / 1024, loJDiff.getHsh()->get_hashprime()) ;
+      fprintf(JDebug::stddbg, "Hastable size    : %d kb. (%d samples).\n", (lpJDiff->getHsh()->get_hashsize() + 512) / 1024, lpJDiff->getHsh()->get_hashprime()) ;
+      fprintf(JDebug::stddbg, "Matching table   : %d matches.\n", lpJDiff->getMch()->get_size()) ;
   }
 
-  int liRet = loJDiff.jdiff();
+  /* Progress and cancellation */
+  JProgress *lpPrg = new JProgressOut(lbPrg ? JDebug::stddbg : null, fileOrgSize, fileNewSize) ;
+  lpJDiff->setProgress(lpPrg) ;
+  gpPrg = lpPrg ;
+  signal(SIGINT, ufSigInt) ;
+
+  int liRet ;
+  long llSekPar = 0 ;
+  int liChkPar = 0 ;
+  int liTarMbr = -1 ;
+  int liTarPar = 0 ;
+  if (liThrCnt > 0) {
+      liRet = lpJDiff->prescan() ;
+      if (liRet == 0) {
+          JDiffPar *lpJDiffPar = null ;
+
+          /* Archives: chunks on the members, fixed chunks when either is not a tar archive */
+          if (lbTar) {
+              JTar loTarOrg ;
+              JTar loTarNew ;
+              if (loTarOrg.load(lcFilNamOrg) == 0 && loTarNew.load(lcFilNamNew) == 0) {
+                  loTarNew.pair(loTarOrg, fileOrgSize, fileNewSize, lzChkSze * 1024) ;
+                  lpJDiffPar = new JDiffPar(lpJDiff, lcFilNamOrg, lcFilNamNew, fileNewSize,
+                      lpFilOut, lpOut, liThrCnt, loTarNew.getChkCnt(), loTarNew.getBegOrg(), loTarNew.getBegNew(),
+                      llBufSze, liBlkSze) ;
+                  liTarMbr = loTarNew.getMbrCnt() ;
+                  liTarPar = loTarNew.getParCnt() ;
+              } else if (liVerbse > 0) {
+                  fprintf(JDebug::stddbg, "Option --tar ignored: not a tar archive.\n") ;
+              }
+          }
+          if (lpJDiffPar == null) {
+              lpJDiffPar = new JDiffPar(lpJDiff, lcFilNamOrg, lcFilNamNew, fileOrgSize, fileNewSize,
+                  lpFilOut, lpOut, liThrCnt, lzChkSze * 1024, llBufSze, liBlkSze) ;
+          }
+          liRet = lpJDiffPar->jdiff() ;
+          llSekPar = lpJDiffPar->getSekCnt() ;
+          liChkPar = lpJDiffPar->getChkCnt() ;
+          delete lpJDiffPar ;
+      }
+  } else {
+      liRet = lpJDiff->jdiff();
+  }
+  signal(SIGINT, SIG_DFL) ;
+  gpPrg = null ;
+  if (liRet == 0)
+      lpPrg->update(PRG_END, fileOrgSize, fileNewSize) ;
 
   /* Write statistics */
   if (liVerbse > 1) {
       fprintf(JDebug::stddbg, "Hashtable size          = %d samples, %d KB, %d MB\n",
-              loJDiff.getHsh()->get_hashsize(),
-              (loJDiff.getHsh()->get_hashsize() + 512) / 1024,
-              ((loJDiff.getHsh()->get_hashsize() + 512) / 1024 + 512) / 1024) ;
-      fprintf(JDebug::stddbg, "Hashtable prime         = %d\n",   loJDiff.getHsh()->get_hashprime()) ;
-      fprintf(JDebug::stddbg, "Hashtable hits          = %d\n",   loJDiff.getHsh()->get_hashhits()) ;
-      fprintf(JDebug::stddbg, "Hashtable errors        = %d\n",   loJDiff.getHshErr()) ;
-      fprintf(JDebug::stddbg, "Hashtable repairs       = %d\n",   JMatchTable::siHshRpr) ;
-      fprintf(JDebug::stddbg, "Hashtable overloading   = %d\n",   loJDiff.getHsh()->get_hashcolmax() / 3 - 1);
-      fprintf(JDebug::stddbg, "Reliability distance    = %d\n",   loJDiff.getHsh()->get_reliability());
-      fprintf(JDebug::stddbg, "Random    accesses      = %ld\n",  lpFilOrg->seekcount() + lpFilNew->seekcount());
+              lpJDiff->getHsh()->get_hashsize(),
+              (lpJDiff->getHsh()->get_hashsize() + 512) / 1024,
+              ((lpJDiff->getHsh()->get_hashsize() + 512) / 1024 + 512) / 1024) ;
+      fprintf(JDebug::stddbg, "Hashtable prime         = %d\n",   lpJDiff->getHsh()->get_hashprime()) ;
+      fprintf(JDebug::stddbg, "Hashtable hits          = %d\n",   lpJDiff->giHshHit) ;
+      if (lpJDiff->getHshLcl() != null) {
+          fprintf(JDebug::stddbg, "Local hashtable prime   = %d\n",   lpJDiff->getHshLcl()->get_hashprime()) ;
+          fprintf(JDebug::stddbg, "Local hashtable hits    = %d\n",   lpJDiff->giLclHit) ;
+      }
+      if (lpJDiff->getIdx() != null) {
+          fprintf(JDebug::stddbg, "External index rate     = %d\n",   lpJDiff->getIdx()->get_samplerate()) ;
+          fprintf(JDebug::stddbg, "External index samples  = %" PRIzd "\n", lpJDiff->getIdx()->get_count()) ;
+          fprintf(JDebug::stddbg, "External index runs     = %d\n",   lpJDiff->getIdx()->get_runs()) ;
+          fprintf(JDebug::stddbg, "External index hits     = %d\n",   lpJDiff->giIdxHit) ;
+      }
+      fprintf(JDebug::stddbg, "Hashtable errors        = %d\n",   lpJDiff->getHshErr()) ;
+      fprintf(JDebug::stddbg, "Resync probe hits       = %d\n",   lpJDiff->getSynHit()) ;
+      fprintf(JDebug::stddbg, "Lookahead range         = %d-%d, last %d (grown %d, shrunk %d)\n",
+              lpJDiff->getAhdMin(), lpJDiff->getAhdMax(), lpJDiff->getAhdCur(),
+              lpJDiff->giAhdGrw, lpJDiff->giAhdShr) ;
+      if (liBlkAln > 0)
+          fprintf(JDebug::stddbg, "Aligned blocks equal    = %" PRIzd " of %" PRIzd "\n", lpJDiff->getBlkEql(), lpJDiff->getBlkCnt()) ;
+      fprintf(JDebug::stddbg, "Hashtable repairs       = %d\n",   lpJDiff->getMch()->miHshRpr) ;
+      if (lbFpr)
+          fprintf(JDebug::stddbg, "Fingerprint matches     = %d\n",   lpJDiff->getMch()->miFprHit) ;
+      fprintf(JDebug::stddbg, "Compares reused         = %d\n",   lpJDiff->getMch()->miChkMem) ;
+      fprintf(JDebug::stddbg, "Compares declined       = %d\n",   lpJDiff->getMch()->miCmpSft) ;
+      if (lbOpt)
+          fprintf(JDebug::stddbg, "Optimal selections      = %d\n",   lpJDiff->getMch()->miOptSel) ;
+      fprintf(JDebug::stddbg, "Seek latency            = %ld / %ld us\n", lpFilOrg->seektime(), lpFilNew->seektime()) ;
+      fprintf(JDebug::stddbg, "Hashtable overloading   = %d\n",   lpJDiff->getHsh()->get_hashcolmax() / 3 - 1);
+      fprintf(JDebug::stddbg, "Reliability distance    = %d\n",   lpJDiff->getHsh()->get_reliability());
+      fprintf(JDebug::stddbg, "Huge pages requested    = %d blocks, %ld KB (%d blocks refused)\n",
+              JHugeMem::giHugAdv.load(), JHugeMem::glHugReq.load() / 1024, JHugeMem::giHugErr.load()) ;
+      if (JHugeMem::hugepages() >= 0)
+          fprintf(JDebug::stddbg, "Huge pages obtained     = %ld KB\n", JHugeMem::hugepages()) ;
+      else
+          fprintf(JDebug::stddbg, "Huge pages obtained     = unknown\n") ;
+      fprintf(JDebug::stddbg, "Random    accesses      = %ld\n",  lpFilOrg->seekcount() + lpFilNew->seekcount() + llSekPar);
+      if (liThrCnt > 0)
+          fprintf(JDebug::stddbg, "Parallel chunks         = %d on %d threads\n", liChkPar, liThrCnt) ;
+      if (liTarMbr >= 0)
+          fprintf(JDebug::stddbg, "Tar members             = %d (%d paired on name)\n", liTarMbr, liTarPar) ;
       fprintf(JDebug::stddbg, "Delete    bytes         = %"PRIzd"\n", lpOut->gzOutBytDel);
       fprintf(JDebug::stddbg, "Backtrack bytes         = %"PRIzd"\n", lpOut->gzOutBytBkt);
       fprintf(JDebug::stddbg, "Escape    bytes written = %"PRIzd"\n", lpOut->gzOutBytEsc);
@@ -567,6 +1179,8 @@ int main(int aiArgCnt, char *acArg[])
   }
 
   /* Cleanup */
+  delete lpJDiff;
+  delete lpPrg;
   delete lpFilOrg;
   delete lpFilNew;
   delete paramOrg.dest;
@@ -602,6 +1216,9 @@ int main(int aiArgCnt, char *acArg[])
   case - EXI_MEM:
       fprintf(JDebug::stddbg, "Error allocating memory !");
       exit (EXI_MEM);
+  case - EXI_CNL:
+      fprintf(JDebug::stddbg, "Cancelled !");
+      exit (EXI_CNL);
   case - EXI_ERR:
       fprintf(JDebug::stddbg, "Spurious error occured !");
       exit (EXI_ERR);